@@ -232,6 +232,17 @@
 #define SPAMFILTER_DETECTSLOW
 #endif
 
+/* Write log files from a separate thread, so a slow disk does not cause
+ * lag on IRC. Log lines are queued in a ring buffer of LOG_QUEUE_SIZE
+ * bytes. If the disk can't keep up and the queue is full then new log
+ * lines are dropped (and IRCOps are notified) instead of blocking.
+ * Comment this out to have ircd_log() write the log files directly.
+ */
+#if !defined(_WIN32) && defined(HAVE_PTHREAD)
+#define LOG_ASYNC
+#endif
+#define LOG_QUEUE_SIZE	(1024*1024)
+
 /* Maximum number of ModData objects that may be attached to an object */
 /* UnrealIRCd 4.0.0 - 4.0.13:  8,    8, 4, 4
  * UnrealIRCd 4.0.14+       : 12,    8, 4, 4
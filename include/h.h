@@ -34,8 +34,6 @@ extern MODVAR int tainted;
 extern char *getreply(int);
 #define rpl_str(x) getreply(x)
 #define err_str(x) getreply(x)
-extern MODVAR Member *freemember;
-extern MODVAR Membership *freemembership;
 extern MODVAR Client me;
 extern MODVAR Channel *channels;
 extern MODVAR ModData local_variable_moddata[MODDATA_MAX_LOCAL_VARIABLE];
@@ -44,6 +42,7 @@ extern MODVAR IRCStatistics ircstats;
 extern MODVAR int bootopt;
 extern MODVAR time_t timeofday;
 extern MODVAR struct timeval timeofday_tv;
+extern MODVAR LoopStats loopstats;
 extern MODVAR char cmodestring[512];
 extern MODVAR char umodestring[UMODETABLESZ+1];
 /* newconf */
@@ -95,6 +94,7 @@ extern void		completed_connection(int, int, void *);
 extern void clear_unknown();
 extern EVENT(e_unload_module_delayed);
 extern EVENT(throttling_check_expire);
+extern EVENT(sno_coalesce_flush);
 
 extern void  module_loadall(void);
 extern long set_usermode(char *umode);
@@ -138,6 +138,10 @@ extern ConfigItem_help 	*find_Help(char *command);
 
 extern OperPermission ValidatePermissionsForPath(char *path, Client *client, Client *victim, Channel *channel, void *extra);
 extern void OperClassValidatorDel(OperClassValidator *validator);
+extern int OperClassGetPermissionID(char *path);
+extern OperPermission ValidatePermissionsForID(int id, Client *client, Client *victim, Channel *channel, void *extra);
+extern void OperClassPermissionsReset(Client *client);
+extern MODVAR int operclass_generation;
 
 extern ConfigItem_ban  *find_ban_ip(Client *client);
 extern void add_ListItem(ListStruct *, ListStruct **);
@@ -186,6 +190,21 @@ extern Ban *is_banned(Client *, Channel *, int, char **, char **);
 extern Ban *is_banned_with_nick(Client *, Channel *, int, char *, char **, char **);
 
 extern void ircd_log(int, FORMAT_STRING(const char *), ...) __attribute__((format(printf,2,3)));
+extern char *log_type_name(int flags);
+extern int log_format_line(ConfigItem_log *log, int flags, const char *timebuf, const char *msg, int msglen, char *out, size_t outlen);
+#ifdef LOG_ASYNC
+extern void log_writer_start(void);
+extern void log_writer_stop(void);
+extern void log_writer_crash_flush(void);
+extern void log_writer_reopen(void);
+extern int log_queue_write(ConfigItem_log *log, const char *text, int len);
+extern int log_queue_stats(size_t *size, size_t *used, unsigned long *queued, unsigned long *dropped);
+extern EVENT(log_writer_check);
+#endif
+extern void latency_add(LatencyHistogram *h, long long value);
+extern unsigned long long latency_percentile(LatencyHistogram *h, int percentile);
+extern unsigned long long latency_count_below(LatencyHistogram *h, unsigned long long value);
+extern void profile_report(Client *client);
 extern Client *find_client(char *, Client *);
 extern Client *find_name(char *, Client *);
 extern Client *find_nickserv(char *, Client *);
@@ -194,6 +213,10 @@ extern Client *find_server(char *, Client *);
 extern Client *find_service(char *, Client *);
 #define find_server_quick(x) find_server(x, NULL)
 extern char *find_or_add(char *);
+extern char *scache_add(const char *str);
+extern void scache_del(char *str);
+extern void scache_set(char **dst, const char *str);
+extern void scache_stats(int *entries, long *refs, long *bytes);
 extern void inittoken();
 extern void reset_help();
 
@@ -268,6 +291,7 @@ extern void sendto_umode(int, FORMAT_STRING(const char *), ...) __attribute__((f
 extern void sendto_umode_global(int, FORMAT_STRING(const char *), ...) __attribute__((format(printf,2,3)));
 extern void sendto_snomask(int snomask, FORMAT_STRING(const char *pattern), ...) __attribute__((format(printf,2,3)));
 extern void sendto_snomask_global(int snomask, FORMAT_STRING(const char *pattern), ...) __attribute__((format(printf,2,3)));
+extern void sendto_snomask_coalesced(int snomask, FORMAT_STRING(const char *pattern), ...) __attribute__((format(printf,2,3)));
 extern void sendnotice(Client *to, FORMAT_STRING(const char *pattern), ...) __attribute__((format(printf,2,3)));
 extern void sendnumeric(Client *to, int numeric, ...);
 extern void sendnumericfmt(Client *to, int numeric, FORMAT_STRING(const char *pattern), ...) __attribute__((format(printf,3,4)));
@@ -333,6 +357,7 @@ extern void del_queries(char *);
 /* Hash stuff */
 #define NICK_HASH_TABLE_SIZE 32768
 #define CHAN_HASH_TABLE_SIZE 32768
+#define CHAN_SIZE_BUCKETS 56
 #define WATCH_HASH_TABLE_SIZE 32768
 #define WHOWAS_HASH_TABLE_SIZE 32768
 #define THROTTLING_HASH_TABLE_SIZE 8192
@@ -356,6 +381,10 @@ extern int hash_del_watch_list(Client *);
 extern void count_watch_memory(int *, u_long *);
 extern Watch *hash_get_watch(char *);
 extern Channel *hash_get_chan_bucket(uint64_t);
+extern int channel_size_bucket(int users);
+extern void channel_size_bucket_range(int bucket, int *min, int *max);
+extern void update_channel_size_index(Channel *channel);
+extern Channel *hash_get_chan_size_bucket(int bucket);
 extern Client *hash_find_client(const char *, Client *);
 extern Client *hash_find_id(const char *, Client *);
 extern Client *hash_find_nickatserver(const char *, Client *);
@@ -463,6 +492,9 @@ extern int rehash(Client *client, int sig);
 extern void s_die();
 extern int match_simple(const char *mask, const char *name);
 extern int match_esc(const char *mask, const char *name);
+extern MatchGlob *match_glob_compile(const char *mask);
+extern int match_glob(const MatchGlob *g, const char *name);
+extern void match_glob_free(MatchGlob *g);
 extern int add_listener(ConfigItem_listen *conf);
 extern void link_cleanup(ConfigItem_link *link_ptr);
 extern void       listen_cleanup();
@@ -748,6 +780,7 @@ extern MODVAR void *(*labeled_response_save_context)(void);
 extern MODVAR void (*labeled_response_set_context)(void *ctx);
 extern MODVAR void (*labeled_response_force_end)(void);
 extern MODVAR void (*kick_user)(MessageTag *mtags, Channel *channel, Client *client, Client *victim, char *comment);
+extern MODVAR void (*burst_continue)(Client *client);
 /* /Efuncs */
 
 /* SSL/TLS functions */
@@ -824,6 +857,30 @@ extern MODVAR char serveropts[];
 extern MODVAR char *ISupportStrings[];
 extern void read_packet(int fd, int revents, void *data);
 extern int process_packet(Client *cptr, char *readbuf, int length, int killsafely);
+#ifdef HAVE_ZLIB
+extern int zip_start_out(Client *client);
+extern int zip_start_in(Client *client);
+extern int zip_in_active(Client *client);
+extern int zip_out_active(Client *client);
+extern int zip_uncompress(Client *client, char *buf, int len);
+extern int zip_uncompress_more(Client *client);
+extern void zip_compress(Client *client, char *buf, int len);
+extern void zip_flush(Client *client);
+extern void zip_free(Client *client);
+extern char *zip_stats(Client *client);
+#endif
+extern void burst_start(Client *client);
+extern Client *burst_next_user(Client *client);
+extern Channel *burst_next_channel(Client *client);
+extern int burst_introduced(Client *client, Client *acptr);
+extern void burst_register_user(Client *client);
+extern int burst_hold(Client *to, char *msg, int len);
+extern void burst_remove_client(Client *acptr);
+extern void burst_remove_channel(Channel *channel);
+extern void burst_finish(Client *client);
+extern void burst_free(Client *client);
+extern char *burst_stats(Client *client);
+extern MODVAR unsigned long long client_list_serial;
 extern void sendto_realops_and_log(FORMAT_STRING(const char *fmt), ...) __attribute__((format(printf,1,2)));
 extern int parse_chanmode(ParseMode *pm, char *modebuf_in, char *parabuf_in);
 extern void config_report_ssl_error(void);
@@ -925,7 +982,12 @@ extern void charsys_check_for_changes(void);
 extern int maxclients;
 extern int fast_badword_match(ConfigItem_badword *badword, char *line);
 extern int fast_badword_replace(ConfigItem_badword *badword, char *line, char *buf, int max);
-extern char *stripbadwords(char *str, ConfigItem_badword *start_bw, int *blocked);
+extern char *stripbadwords(char *str, ConfigItem_badword *start_bw, WordFilter **filter, int *blocked);
+extern WordFilter *wordfilter_create(void);
+extern void wordfilter_add(WordFilter *wf, const char *word, int type, int action, const char *replace);
+extern int wordfilter_run(WordFilter *wf, const char *line, char *buf, int max, int *blocked);
+extern int wordfilter_count(WordFilter *wf);
+extern void wordfilter_free(WordFilter *wf);
 extern int badword_config_process(ConfigItem_badword *ca, char *str);
 extern void badword_config_free(ConfigItem_badword *ca);
 extern char *badword_config_check_regex(char *s, int fastsupport, int check_broadness);
@@ -942,7 +1004,10 @@ extern void new_message_special(Client *sender, MessageTag *recv_mtags, MessageT
 extern void generate_batch_id(char *str);
 extern MessageTag *find_mtag(MessageTag *mtags, const char *token);
 extern MessageTag *duplicate_mtag(MessageTag *mtag);
+extern MessageTag *new_mtag(const char *name, const char *value);
 extern void free_message_tags(MessageTag *m);
+extern void mtag_arena_begin(void);
+extern void mtag_arena_end(void);
 extern time_t server_time_to_unix_time(const char *tbuf);
 extern int history_set_limit(char *object, int max_lines, long max_t);
 extern int history_add(char *object, MessageTag *mtags, char *line);
@@ -957,6 +1022,9 @@ extern int read_data(FILE *fd, void *buf, size_t len);
 extern int write_data(FILE *fd, const void *buf, size_t len);
 extern int write_str(FILE *fd, char *x);
 extern int read_str(FILE *fd, char **x);
+extern int sync_file(FILE *fd);
+extern int background_write_start(int (*writefunc)(void));
+extern int background_write_done(int pid, int block);
 extern int char_to_channelflag(char c);
 extern void _free_entire_name_list(NameList *n);
 extern void _add_name_list(NameList **list, char *name);
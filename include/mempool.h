@@ -48,10 +48,21 @@
 * details. */
 typedef struct mp_pool_t mp_pool_t;
 
+/** Usage of a memory pool, see mp_pool_stats(). */
+typedef struct mp_pool_stats_t {
+  const char *name; /**< Name of the pool, as passed to mp_pool_new() */
+  size_t item_size; /**< Size of each item, including overhead */
+  int n_chunks; /**< Number of chunks allocated */
+  uint64_t items_used; /**< Number of items currently in use */
+  uint64_t items_capacity; /**< Number of items that fit in all chunks */
+  uint64_t bytes_allocated; /**< Total bytes allocated for the chunks */
+} mp_pool_stats_t;
+
 extern void mp_pool_init(void);
 extern void *mp_pool_get(mp_pool_t *);
 extern void mp_pool_release(void *);
-extern mp_pool_t *mp_pool_new(size_t, size_t);
+extern mp_pool_t *mp_pool_new(size_t, size_t, const char *);
+extern int mp_pool_stats(int, mp_pool_stats_t *);
 extern void mp_pool_clean(mp_pool_t *, int, int);
 extern void mp_pool_destroy(mp_pool_t *);
 extern void mp_pool_assert_ok(mp_pool_t *);
@@ -90,6 +101,9 @@ struct mp_pool_t {
   /** Size to allocate for each item, including overhead and alignment
    * padding. */
   size_t item_alloc_size;
+
+  /** Name of the pool, shown in /STATS mem */
+  const char *name;
 #ifdef MEMPOOL_STATS
   /** Total number of items allocated ever. */
   uint64_t total_items_allocated;
@@ -517,16 +517,33 @@ typedef struct {
 	int (*history_destroy)(char *object);
 } HistoryBackendInfo;
 
+/** Only call this packet hook (HOOKTYPE_PACKET, HOOKTYPE_RAWPACKET_IN)
+ * for clients that the module opted in via SetPacketHooks(), such as
+ * websocket clients. This saves a function call per line for everyone
+ * else. Set it with HookOptinClient(), not directly: every module has
+ * its own bit, so opting in for one module does not call the packet
+ * hooks of another module.
+ */
+#define HOOK_FLAG_OPTIN_CLIENT	0x1
+
+/** Should packet hook 'h' be called for traffic of client 'x'? */
+#define PacketHookWanted(h, x)	(!((h)->flags & HOOK_FLAG_OPTIN_CLIENT) || ((x)->local->packet_hooks & (h)->optin))
+
 struct Hook {
 	Hook *prev, *next;
 	int priority;
 	int type;
+	int flags;	/**< One or more of HOOK_FLAG_* */
+	unsigned int optin;	/**< Bit of the owner in LocalClient::packet_hooks, see HookOptinClient() */
 	union {
 		int (*intfunc)();
 		void (*voidfunc)();
 		char *(*pcharfunc)();
 	} func;
 	Module *owner;
+	unsigned long long calls;	/**< Number of times the hook was called */
+	unsigned long long total;	/**< Total time spent in the hook, in nanoseconds */
+	unsigned long long max;		/**< Longest time spent in a single call, in nanoseconds */
 };
 
 struct Callback {
@@ -658,6 +675,7 @@ struct Event {
 	struct timeval	last_run;	/**< Last time this event ran */
 	char		deleted;	/**< Set to 1 if this event is marked for deletion */
 	Module		*owner;		/**< To which module this event belongs */
+	LatencyHistogram latency;	/**< Time spent running this event */
 };
 
 #define EMOD_EVERY 0x0001
@@ -761,19 +779,26 @@ __extension__ ({ \
 
 extern Hook	*HookAddMain(Module *module, int hooktype, int priority, int (*intfunc)(), void (*voidfunc)(), char *(*pcharfunc)());
 extern Hook	*HookDel(Hook *hook);
+extern unsigned int PacketHooksBit(Module *module);
+extern void HookOptinClient(Hook *hook);
 
 extern Hooktype *HooktypeAdd(Module *module, char *string, int *type);
 extern void HooktypeDel(Hooktype *hooktype, Module *module);
+extern long long profile_now(void);
+extern void hook_profile_done(Hook *h, long long start);
 
-#define RunHook0(hooktype) do { Hook *h; for (h = Hooks[hooktype]; h; h = h->next)(*(h->func.intfunc))(); } while(0)
-#define RunHook(hooktype,x) do { Hook *h; for (h = Hooks[hooktype]; h; h = h->next) (*(h->func.intfunc))(x); } while(0)
+#define RunHook0(hooktype) do { Hook *h; for (h = Hooks[hooktype]; h; h = h->next) { long long hook_start = profile_now(); (*(h->func.intfunc))(); hook_profile_done(h, hook_start); } } while(0)
+#define RunHook(hooktype,x) do { Hook *h; for (h = Hooks[hooktype]; h; h = h->next) { long long hook_start = profile_now(); (*(h->func.intfunc))(x); hook_profile_done(h, hook_start); } } while(0)
 #define RunHookReturn(hooktype,x,retchk) \
 { \
  int retval; \
  Hook *h; \
+ long long hook_start; \
  for (h = Hooks[hooktype]; h; h = h->next) \
  { \
+  hook_start = profile_now(); \
   retval = (*(h->func.intfunc))(x); \
+  hook_profile_done(h, hook_start); \
   if (retval retchk) return; \
  } \
 }
@@ -781,9 +806,12 @@ extern void HooktypeDel(Hooktype *hooktype, Module *module);
 { \
  int retval; \
  Hook *h; \
+ long long hook_start; \
  for (h = Hooks[hooktype]; h; h = h->next) \
  { \
+  hook_start = profile_now(); \
   retval = (*(h->func.intfunc))(x,y); \
+  hook_profile_done(h, hook_start); \
   if (retval retchk) return; \
  } \
 }
@@ -791,9 +819,12 @@ extern void HooktypeDel(Hooktype *hooktype, Module *module);
 { \
  int retval; \
  Hook *h; \
+ long long hook_start; \
  for (h = Hooks[hooktype]; h; h = h->next) \
  { \
+  hook_start = profile_now(); \
   retval = (*(h->func.intfunc))(x,y,z); \
+  hook_profile_done(h, hook_start); \
   if (retval retchk) return; \
  } \
 }
@@ -801,9 +832,12 @@ extern void HooktypeDel(Hooktype *hooktype, Module *module);
 { \
  int retval; \
  Hook *h; \
+ long long hook_start; \
  for (h = Hooks[hooktype]; h; h = h->next) \
  { \
+  hook_start = profile_now(); \
   retval = (*(h->func.intfunc))(a,b,c,d); \
+  hook_profile_done(h, hook_start); \
   if (retval retchk) return; \
  } \
 }
@@ -811,9 +845,12 @@ extern void HooktypeDel(Hooktype *hooktype, Module *module);
 { \
  int retval; \
  Hook *h; \
+ long long hook_start; \
  for (h = Hooks[hooktype]; h; h = h->next) \
  { \
+  hook_start = profile_now(); \
   retval = (*(h->func.intfunc))(x); \
+  hook_profile_done(h, hook_start); \
   if (retval retchk) return retval; \
  } \
 }
@@ -821,9 +858,12 @@ extern void HooktypeDel(Hooktype *hooktype, Module *module);
 { \
  int retval; \
  Hook *h; \
+ long long hook_start; \
  for (h = Hooks[hooktype]; h; h = h->next) \
  { \
+  hook_start = profile_now(); \
   retval = (*(h->func.intfunc))(x,y); \
+  hook_profile_done(h, hook_start); \
   if (retval retchk) return retval; \
  } \
 }
@@ -831,9 +871,12 @@ extern void HooktypeDel(Hooktype *hooktype, Module *module);
 { \
  int retval; \
  Hook *h; \
+ long long hook_start; \
  for (h = Hooks[hooktype]; h; h = h->next) \
  { \
+  hook_start = profile_now(); \
   retval = (*(h->func.intfunc))(x,y,z); \
+  hook_profile_done(h, hook_start); \
   if (retval retchk) return retval; \
  } \
 }
@@ -841,21 +884,24 @@ extern void HooktypeDel(Hooktype *hooktype, Module *module);
 { \
  int retval; \
  Hook *h; \
+ long long hook_start; \
  for (h = Hooks[hooktype]; h; h = h->next) \
  { \
+  hook_start = profile_now(); \
   retval = (*(h->func.intfunc))(a,b,c,d); \
+  hook_profile_done(h, hook_start); \
   if (retval retchk) return retval; \
  } \
 }
 
-#define RunHookReturnVoid(hooktype,x,ret) do { Hook *hook; for (hook = Hooks[hooktype]; hook; hook = hook->next) if((*(hook->func.intfunc))(x) ret) return; } while(0)
-#define RunHook2(hooktype,x,y) do { Hook *hook; for (hook = Hooks[hooktype]; hook; hook = hook->next) (*(hook->func.intfunc))(x,y); } while(0)
-#define RunHook3(hooktype,a,b,c) do { Hook *hook; for (hook = Hooks[hooktype]; hook; hook = hook->next) (*(hook->func.intfunc))(a,b,c); } while(0)
-#define RunHook4(hooktype,a,b,c,d) do { Hook *hook; for (hook = Hooks[hooktype]; hook; hook = hook->next) (*(hook->func.intfunc))(a,b,c,d); } while(0)
-#define RunHook5(hooktype,a,b,c,d,e) do { Hook *hook; for (hook = Hooks[hooktype]; hook; hook = hook->next) (*(hook->func.intfunc))(a,b,c,d,e); } while(0)
-#define RunHook6(hooktype,a,b,c,d,e,f) do { Hook *hook; for (hook = Hooks[hooktype]; hook; hook = hook->next) (*(hook->func.intfunc))(a,b,c,d,e,f); } while(0)
-#define RunHook7(hooktype,a,b,c,d,e,f,g) do { Hook *hook; for (hook = Hooks[hooktype]; hook; hook = hook->next) (*(hook->func.intfunc))(a,b,c,d,e,f,g); } while(0)
-#define RunHook8(hooktype,a,b,c,d,e,f,g,h) do { Hook *hook; for (hook = Hooks[hooktype]; hook; hook = hook->next) (*(hook->func.intfunc))(a,b,c,d,e,f,g,h); } while(0)
+#define RunHookReturnVoid(hooktype,x,ret) do { Hook *hook; for (hook = Hooks[hooktype]; hook; hook = hook->next) { long long hook_start = profile_now(); int hook_ret = (*(hook->func.intfunc))(x); hook_profile_done(hook, hook_start); if (hook_ret ret) return; } } while(0)
+#define RunHook2(hooktype,x,y) do { Hook *hook; for (hook = Hooks[hooktype]; hook; hook = hook->next) { long long hook_start = profile_now(); (*(hook->func.intfunc))(x,y); hook_profile_done(hook, hook_start); } } while(0)
+#define RunHook3(hooktype,a,b,c) do { Hook *hook; for (hook = Hooks[hooktype]; hook; hook = hook->next) { long long hook_start = profile_now(); (*(hook->func.intfunc))(a,b,c); hook_profile_done(hook, hook_start); } } while(0)
+#define RunHook4(hooktype,a,b,c,d) do { Hook *hook; for (hook = Hooks[hooktype]; hook; hook = hook->next) { long long hook_start = profile_now(); (*(hook->func.intfunc))(a,b,c,d); hook_profile_done(hook, hook_start); } } while(0)
+#define RunHook5(hooktype,a,b,c,d,e) do { Hook *hook; for (hook = Hooks[hooktype]; hook; hook = hook->next) { long long hook_start = profile_now(); (*(hook->func.intfunc))(a,b,c,d,e); hook_profile_done(hook, hook_start); } } while(0)
+#define RunHook6(hooktype,a,b,c,d,e,f) do { Hook *hook; for (hook = Hooks[hooktype]; hook; hook = hook->next) { long long hook_start = profile_now(); (*(hook->func.intfunc))(a,b,c,d,e,f); hook_profile_done(hook, hook_start); } } while(0)
+#define RunHook7(hooktype,a,b,c,d,e,f,g) do { Hook *hook; for (hook = Hooks[hooktype]; hook; hook = hook->next) { long long hook_start = profile_now(); (*(hook->func.intfunc))(a,b,c,d,e,f,g); hook_profile_done(hook, hook_start); } } while(0)
+#define RunHook8(hooktype,a,b,c,d,e,f,g,h) do { Hook *hook; for (hook = Hooks[hooktype]; hook; hook = hook->next) { long long hook_start = profile_now(); (*(hook->func.intfunc))(a,b,c,d,e,f,g,h); hook_profile_done(hook, hook_start); } } while(0)
 
 #define CallbackAdd(cbtype, func) CallbackAddMain(NULL, cbtype, func, NULL, NULL)
 #define CallbackAddEx(module, cbtype, func) CallbackAddMain(module, cbtype, func, NULL, NULL)
@@ -2273,6 +2319,7 @@ enum EfunctionType {
 	EFUNC_LABELED_RESPONSE_SET_CONTEXT,
 	EFUNC_LABELED_RESPONSE_FORCE_END,
 	EFUNC_KICK_USER,
+	EFUNC_BURST_CONTINUE,
 };
 
 /* Module flags */
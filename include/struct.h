@@ -111,6 +111,8 @@ typedef struct ConfigItem_offchans ConfigItem_offchans;
 typedef struct SecurityGroup SecurityGroup;
 typedef struct ListStruct ListStruct;
 typedef struct ListStructPrio ListStructPrio;
+typedef struct LatencyHistogram LatencyHistogram;
+typedef struct LoopStats LoopStats;
 
 #define CFG_TIME 0x0001
 #define CFG_SIZE 0x0002
@@ -119,6 +121,8 @@ typedef struct ListStructPrio ListStructPrio;
 typedef struct Watch Watch;
 typedef struct Client Client;
 typedef struct LocalClient LocalClient;
+typedef struct ZipLink ZipLink;
+typedef struct Burst Burst;
 typedef struct Channel Channel;
 typedef struct User ClientUser;
 typedef struct Server Server;
@@ -155,6 +159,7 @@ typedef struct OperClassACL OperClassACL;
 typedef struct OperClassACLEntry OperClassACLEntry;
 typedef struct OperClassACLEntryVar OperClassACLEntryVar;
 typedef struct OperClassCheckParams OperClassCheckParams;
+typedef struct OperPermissionCache OperPermissionCache;
 
 typedef OperPermission (*OperClassEntryEvalCallback)(OperClassACLEntryVar* variables,OperClassCheckParams* params);
 
@@ -213,6 +218,10 @@ typedef OperPermission (*OperClassEntryEvalCallback)(OperClassACLEntryVar* varia
 #define LOG_SPAMFILTER 0x0400
 #define LOG_DBG    0x0800 /* fixme */
 
+/* Log file formats (log::format) */
+#define LOG_FORMAT_TEXT	0
+#define LOG_FORMAT_JSON	1
+
 /*
 ** 'offsetof' is defined in ANSI-C. The following definition
 ** is not absolutely portable (I have been told), but so far
@@ -344,6 +353,7 @@ typedef enum ClientStatus {
 #define PROTO_EXTSWHOIS 0x004000	/* extended SWHOIS support */
 #define PROTO_SJSBY	0x008000	/* SJOIN setby information (TS and nick) */
 #define PROTO_MTAGS	0x010000	/* Support message tags and big buffers */
+#define PROTO_ZIP	0x020000	/* Can receive a compressed link (PROTOCTL ZIP) */
 
 /* For client capabilities: */
 #define CAP_INVERT	1L
@@ -454,6 +464,7 @@ typedef enum ClientStatus {
 #define SetPingSent(x)			do { (x)->flags |= CLIENT_FLAG_PINGSENT; } while(0)
 #define SetPingWarning(x)		do { (x)->flags |= CLIENT_FLAG_PINGWARN; } while(0)
 #define SetNoHandshakeDelay(x)		do { (x)->flags |= CLIENT_FLAG_NOHANDSHAKEDELAY; } while(0)
+#define SetPacketHooks(x, bit)		do { (x)->local->packet_hooks |= (bit); } while(0)
 #define SetProtoctlReceived(x)		do { (x)->flags |= CLIENT_FLAG_PROTOCTL; } while(0)
 #define SetQuarantined(x)		do { (x)->flags |= CLIENT_FLAG_QUARANTINE; } while(0)
 #define SetShunned(x)			do { (x)->flags |= CLIENT_FLAG_SHUNNED; } while(0)
@@ -518,12 +529,14 @@ typedef enum ClientStatus {
 #define SupportVHP(x)		(CHECKSERVERPROTO(x, PROTO_VHP))
 #define SupportCLK(x)		(CHECKSERVERPROTO(x, PROTO_CLK))
 #define SupportMTAGS(x)		(CHECKSERVERPROTO(x, PROTO_MTAGS))
+#define SupportZIP(x)		(CHECKSERVERPROTO(x, PROTO_ZIP))
 
 #define SetVL(x)		((x)->local->proto |= PROTO_VL)
 #define SetSJSBY(x)		((x)->local->proto |= PROTO_SJSBY)
 #define SetVHP(x)		((x)->local->proto |= PROTO_VHP)
 #define SetCLK(x)		((x)->local->proto |= PROTO_CLK)
 #define SetMTAGS(x)		((x)->local->proto |= PROTO_MTAGS)
+#define SetZIP(x)		((x)->local->proto |= PROTO_ZIP)
 
 /*
  * defined debugging levels
@@ -766,12 +779,21 @@ typedef enum {
 	MATCH_PCRE_REGEX=2, /**< PCRE2 Perl-like regex (new) */
 } MatchType;
 
+/** A precompiled simple (glob) pattern, see match_glob_compile() */
+typedef struct MatchGlob MatchGlob;
+
 /** Match struct, which allows various matching styles, see MATCH_* */
 typedef struct Match {
 	char *str; /**< Text of the glob/regex/whatever. Always set. */
 	MatchType type;
+	int jit; /**< Regex is JIT compiled (MATCH_PCRE_REGEX only) */
+	unsigned long checks; /**< Number of unreal_match() calls */
+	unsigned long hits; /**< Number of unreal_match() calls that matched */
+	long long usec; /**< Total time spent in unreal_match() (MATCH_PCRE_REGEX only) */
+	long last_usec; /**< Time spent in the last unreal_match() (MATCH_PCRE_REGEX only) */
 	union {
 		pcre2_code *pcre2_expr; /**< PCRE2 Perl-like Regex */
+		MatchGlob *glob; /**< Compiled simple pattern */
 	} ext;
 } Match;
 
@@ -1018,6 +1040,33 @@ struct IRCCounts {
 /** The /LUSERS stats information */
 extern MODVAR IRCCounts irccounts;
 
+/** Number of buckets in a LatencyHistogram */
+#define LATENCY_BUCKETS	128
+
+/** Histogram of measured times, see profile.c */
+struct LatencyHistogram {
+	unsigned long long count;	/**< Number of measurements */
+	unsigned long long total;	/**< Sum of all measurements, in nanoseconds */
+	unsigned long long max;		/**< Highest measurement, in nanoseconds */
+	unsigned long long buckets[LATENCY_BUCKETS];	/**< Log-linear buckets, see latency_add() */
+};
+
+/** Statistics of the main loop, see SocketLoop() and fd_select().
+ * All times are in nanoseconds.
+ */
+struct LoopStats {
+	unsigned long long iterations;		/**< Number of SocketLoop() iterations */
+	LatencyHistogram iteration_time;	/**< Time of one iteration, excluding waiting for I/O */
+	LatencyHistogram io_wait_time;		/**< Time spent waiting for I/O (epoll_wait and the like) */
+	LatencyHistogram io_time;		/**< Time spent in I/O callbacks in fd_select() */
+	LatencyHistogram events_time;		/**< Time spent in DoEvents() */
+	LatencyHistogram process_clients_time;	/**< Time spent in process_clients() */
+	LatencyHistogram fd_events;		/**< Number of fds with events per wakeup (not a time) */
+	unsigned long long read_callbacks;	/**< Number of read callbacks called */
+	unsigned long long write_callbacks;	/**< Number of write callbacks called */
+	long long io_wait;			/**< Time spent waiting for I/O in the current iteration */
+};
+
 #include "modules.h"
 
 /** A "real" command (internal interface, not for modules) */
@@ -1033,6 +1082,7 @@ struct RealCommand {
 	Module 			*owner;
 	RealCommand		*friend; /* cmd if token, token if cmd */
 	CommandOverride		*overriders;
+	LatencyHistogram	latency; /**< Time spent in the command handler */
 #ifdef DEBUGMODE
 	unsigned long 		lticks;
 	unsigned long 		rticks;
@@ -1050,12 +1100,15 @@ struct CommandOverride {
 
 extern MODVAR Umode *Usermode_Table;
 extern MODVAR short	 Usermode_highest;
+extern MODVAR long Usermode_Bychar[256];
 
 extern MODVAR Snomask *Snomask_Table;
 extern MODVAR short Snomask_highest;
 
 extern MODVAR Cmode *Channelmode_Table;
 extern MODVAR unsigned short Channelmode_highest;
+extern MODVAR Cmode_t Channelmode_Bychar[256];
+extern MODVAR long Corechannelmode_Bychar[256];
 
 extern Umode *UmodeAdd(Module *module, char ch, int options, int unset_on_deoper, int (*allowed)(Client *client, int what), long *mode);
 extern void UmodeDel(Umode *umode);
@@ -1077,11 +1130,13 @@ extern void unload_all_unused_moddata(void);
 #define LISTENER_TLS		0x000010
 #define LISTENER_BOUND		0x000020
 #define LISTENER_DEFER_ACCEPT	0x000040
+#define LISTENER_METRICS	0x000080	/**< Serves metrics instead of IRC, set by the metrics module */
 
 #define IsServersOnlyListener(x)	((x) && ((x)->options & LISTENER_SERVERSONLY))
+#define IsMetricsListener(x)	((x) && ((x)->options & LISTENER_METRICS))
 
 #define CONNECT_TLS		0x000001
-//0x000002 unused (was ziplinks)
+#define CONNECT_ZIP		0x000002
 #define CONNECT_AUTO		0x000004
 #define CONNECT_QUARANTINE	0x000008
 #define CONNECT_NODNSCACHE	0x000010
@@ -1100,50 +1155,56 @@ extern void unload_all_unused_moddata(void);
 /** A client on this or a remote server - can be a user, server, unknown, etc..
  */
 struct Client {
-	struct list_head client_node;		/**< For global client list (client_list) */
-	struct list_head lclient_node;		/**< For local client list (lclient_list) */
-	struct list_head special_node;		/**< For special lists (server || unknown || oper) */
-	LocalClient *local;			/**< Additional information regarding locally connected clients */
-	ClientUser *user;			/**< Additional information, if this client is a user */
-	Server *serv;				/**< Additional information, if this is a server */
+	/* The first 64 bytes (one cache line) hold the fields that are
+	 * looked at for every client when walking a channel or client list,
+	 * such as in sendto_channel() and check_pings(). Keep it that way.
+	 */
 	ClientStatus status;			/**< Client status, one of CLIENT_STATUS_* */
-	struct list_head client_hash;		/**< For name hash table (clientTable) */
-	char name[HOSTLEN + 1];			/**< Unique name of the client: nickname for users, hostname for servers */
-	time_t lastnick;			/**< Timestamp on nick */
+	unsigned char hopcount;			/**< Number of servers to this, 0 means local client */
 	long flags;				/**< Client flags (one or more of CLIENT_FLAG_*) */
 	long umodes;				/**< Client usermodes (if user) */
 	Client *direction;			/**< Direction from which this client originated.
 	                                             This always points to a directly connected server or &me.
 	                                             It is never NULL */
-	unsigned char hopcount;			/**< Number of servers to this, 0 means local client */
-	char ident[USERLEN + 1];		/**< Ident of the user, if available. Otherwise set to "unknown". */
-	char info[REALLEN + 1];			/**< Additional client information text. For users this is gecos/realname */
+	LocalClient *local;			/**< Additional information regarding locally connected clients */
+	ClientUser *user;			/**< Additional information, if this client is a user */
+	Server *serv;				/**< Additional information, if this is a server */
+	Client *srvptr;				/**< Server on where this client is connected to (can be &me) */
+	/* Less frequently used fields */
 	char id[IDLEN + 1];			/**< Unique ID: SID or UID */
+	char name[HOSTLEN + 1];			/**< Unique name of the client: nickname for users, hostname for servers */
+	time_t lastnick;			/**< Timestamp on nick */
+	char *ip;				/**< IP address of user or server (never NULL), interned: see scache_set() */
+	struct list_head client_node;		/**< For global client list (client_list) */
+	struct list_head lclient_node;		/**< For local client list (lclient_list) */
+	struct list_head special_node;		/**< For special lists (server || unknown || oper) */
+	struct list_head client_hash;		/**< For name hash table (clientTable) */
 	struct list_head id_hash;		/**< For UID/SID hash table (idTable) */
-	Client *srvptr;				/**< Server on where this client is connected to (can be &me) */
-	char *ip;				/**< IP address of user or server (never NULL) */
+	unsigned long long list_serial;		/**< Increasing number, set when the user is introduced, 0 for others (used by the server burst) */
+	char ident[USERLEN + 1];		/**< Ident of the user, if available. Otherwise set to "unknown". */
+	char info[REALLEN + 1];			/**< Additional client information text. For users this is gecos/realname */
 	ModData moddata[MODDATA_MAX_CLIENT];	/**< Client attached module data, used by the ModData system */
 };
 
 /** Local client information, use client->local to access these (see also @link Client @endlink).
  */
 struct LocalClient {
+	/* Hot fields first: these are used by the send and read paths
+	 * and by check_pings() for every local client.
+	 */
 	int fd;				/**< File descriptor, can be <0 if socket has been closed already. */
+	int proto;			/**< PROTOCTL options */
+	long caps;			/**< User: enabled capabilities (via CAP command) */
+	long serial;			/**< Current serial number for send.c functions (to avoid sending duplicate messages) */
 	SSL *ssl;			/**< OpenSSL/LibreSSL struct for SSL/TLS connection */
 	time_t since;			/**< Time when user will next be allowed to send something (actually since<currenttime+10) */
-	time_t firsttime;		/**< Time user was created (connected on IRC) */
 	time_t lasttime;		/**< Last time any message was received */
+	ConfigItem_class *class;	/**< The class { } block associated to this client */
 	dbuf sendQ;			/**< Outgoing send queue (data to be sent) */
 	dbuf recvQ;			/**< Incoming receive queue (incoming data yet to be parsed) */
-	ConfigItem_class *class;	/**< The class { } block associated to this client */
-	int proto;			/**< PROTOCTL options */
-	long caps;			/**< User: enabled capabilities (via CAP command) */
-	time_t nexttarget;		/**< Next time that a new target will be allowed (msg/notice/invite) */
-	u_char targets[MAXCCUSERS];	/**< Hash values of targets for target limiting */
-	ConfigItem_listen *listener;	/**< If this client IsListening() then this is the listener configuration attached to it */
-	long serial;			/**< Current serial number for send.c functions (to avoid sending duplicate messages) */
-	time_t nextnick;		/**< Time the next nick change will be allowed */
-	time_t last;			/**< Last time a RESETIDLE message was received (PRIVMSG) */
+	ZipLink *zip;			/**< Server: link compression state (PROTOCTL ZIP), NULL if not compressed */
+	Burst *burst;			/**< Server: state of the burst we are sending, NULL if not bursting */
+	unsigned int packet_hooks;	/**< Modules that opted in to their packet hooks for this client, see PacketHooksBit() */
 	long sendM;			/**< Statistics: protocol messages send */
 	long sendK;			/**< Statistics: total k-bytes send */
 	long receiveM;			/**< Statistics: protocol messages received */
@@ -1151,45 +1212,49 @@ struct LocalClient {
 	u_short sendB;			/**< Statistics: counters to count upto 1-k lots of bytes */
 	u_short receiveB;		/**< Statistics: sent and received (???) */
 	short lastsq;			/**< # of 2k blocks when sendqueued called last */
+	/* Less frequently used fields */
+	time_t firsttime;		/**< Time user was created (connected on IRC) */
+	time_t nexttarget;		/**< Next time that a new target will be allowed (msg/notice/invite) */
+	ConfigItem_listen *listener;	/**< If this client IsListening() then this is the listener configuration attached to it */
+	time_t nextnick;		/**< Time the next nick change will be allowed */
+	time_t last;			/**< Last time a RESETIDLE message was received (PRIVMSG) */
 	Link *watch;			/**< Watch notification list (WATCH) for this user */
 	u_short watches;		/**< Number of entries in the watch list */
-	ModData moddata[MODDATA_MAX_LOCAL_CLIENT];	/**< LocalClient attached module data, used by the ModData system */
+	u_short port;			/**< Remote TCP port of client */
+	uint32_t nospoof;		/**< Anti-spoofing random number (used in user handshake PING/PONG) */
+	char *error_str;		/**< Quit reason set by dead_socket() in case of socket/buffer error, later used by exit_client() */
 #ifdef DEBUGMODE
 	time_t cputime;			/**< Something with debugging (why is this a time_t? TODO) */
 #endif
-	char *error_str;		/**< Quit reason set by dead_socket() in case of socket/buffer error, later used by exit_client() */
-	char sasl_agent[NICKLEN + 1];	/**< SASL: SASL Agent the user is interacting with */
 	unsigned char sasl_out;		/**< SASL: Number of outgoing sasl messages */
 	unsigned char sasl_complete;	/**< SASL: >0 if SASL authentication was successful */
 	time_t sasl_sent_time;		/**< SASL: 0 or the time that the (last) AUTHENTICATE command has been sent */
 	char *sni_servername;		/**< Servername as sent by client via SNI (Server Name Indication) in SSL/TLS, otherwise NULL */
 	int cap_protocol;		/**< CAP protocol in use. At least 300 for any CAP capable client. 302 for 3.2, etc.. */
-	uint32_t nospoof;		/**< Anti-spoofing random number (used in user handshake PING/PONG) */
-	char *passwd;			/**< Password used during connect, if any (freed once connected and set to NULL) */
 	int authfd;			/**< File descriptor for ident checking (RFC931) */
 	int identbufcnt;		/**< Counter for 'ident' reading code */
+	char *passwd;			/**< Password used during connect, if any (freed once connected and set to NULL) */
 	struct hostent *hostp;		/**< Host record for this client (used by DNS code) */
+	ModData moddata[MODDATA_MAX_LOCAL_CLIENT];	/**< LocalClient attached module data, used by the ModData system */
+	u_char targets[MAXCCUSERS];	/**< Hash values of targets for target limiting */
+	char sasl_agent[NICKLEN + 1];	/**< SASL: SASL Agent the user is interacting with */
 	char sockhost[HOSTLEN + 1];	/**< Hostname from the socket */
-	u_short port;			/**< Remote TCP port of client */
 };
 
 /** User information (persons, not servers), you use client->user to access these (see also @link Client @endlink).
  */
 struct User {
 	Membership *channel;		/**< Channels that the user is in (linked list) */
-	Link *invited;			/**< Channels has the user been invited to (linked list) */
-	Link *dccallow;			/**< DCCALLOW list (linked list) */
-	char *away;			/**< AWAY message, or NULL if not away */
-	char svid[SVIDLEN + 1];		/**< Unique value assigned by services (SVID) */
 	unsigned short joined;		/**< Number of channels joined */
-	char username[USERLEN + 1];	/**< Username, the user portion in nick!user@host. */
-	char realhost[HOSTLEN + 1];	/**< Realhost, the real host of the user (IP or hostname) - usually this is not shown to other users */
-	char cloakedhost[HOSTLEN + 1];	/**< Cloaked host - generated by cloaking algorithm */
-	char *virthost;			/**< Virtual host - when user has user mode +x this is the active host */
+	int snomask;			/**< Server Notice Mask (snomask) - only for IRCOps */
+	char *virthost;			/**< Virtual host - when user has user mode +x this is the active host, interned: see scache_set() */
 	char *server;			/**< Server name the user is on (?) */
+	OperPermissionCache *operperms;	/**< Compiled oper permissions (see operclass.c), NULL if not compiled yet */
+	char *away;			/**< AWAY message, or NULL if not away */
+	Link *invited;			/**< Channels has the user been invited to (linked list) */
+	Link *dccallow;			/**< DCCALLOW list (linked list) */
 	SWhois *swhois;			/**< Special "additional" WHOIS entries such as "a Network Administrator" */
 	aWhowas *whowas;		/**< Something for whowas :D :D */
-	int snomask;			/**< Server Notice Mask (snomask) - only for IRCOps */
 	char *operlogin;		/**< Which oper { } block was used to oper up, otherwise NULL - used by oper::maxlogins */
 	struct {
 		time_t nick_t;		/**< For set::anti-flood::nick-flood: time */
@@ -1201,6 +1266,10 @@ struct User {
 		unsigned char knock_c;	/**< For set::anti-flood::knock-flood: counter */
 		unsigned char invite_c;	/**< For set::anti-flood::invite-flood: counter */
 	} flood;			/**< Anti-flood counters */
+	char svid[SVIDLEN + 1];		/**< Unique value assigned by services (SVID) */
+	char username[USERLEN + 1];	/**< Username, the user portion in nick!user@host. */
+	char realhost[HOSTLEN + 1];	/**< Realhost, the real host of the user (IP or hostname) - usually this is not shown to other users */
+	char cloakedhost[HOSTLEN + 1];	/**< Cloaked host - generated by cloaking algorithm */
 	time_t lastaway;		/**< Last time the user went AWAY */
 };
 
@@ -1226,14 +1295,51 @@ struct Server {
 	} features;
 };
 
+/** Amount of burst data that is generated in one go, see burst_continue() */
+#define BURST_CHUNK_SIZE	16384
+
+/** Burst phases, see Burst::phase */
+typedef enum BurstPhase {
+	BURST_PHASE_USERS=1,	/**< Sending users (UID) */
+	BURST_PHASE_CHANNELS=2,	/**< Sending channels (SJOIN, TOPIC) */
+} BurstPhase;
+
+/** State of the burst that we are sending to a directly connected server,
+ * use client->local->burst to access this. See src/burst.c for details.
+ */
+struct Burst {
+	BurstPhase phase;		/**< What we are currently sending */
+	char generating;		/**< Set while generating burst data (output is not held back) */
+	unsigned long long last_serial;	/**< Users with a higher Client::list_serial were created during the burst */
+	unsigned long long user_serial;	/**< Users up to this Client::list_serial have been sent (or skipped) */
+	Client *next_user;		/**< Next user to send (cursor in client_list) */
+	Channel *next_channel;		/**< Next channel to send (cursor in channels) */
+	unsigned long long *sent;	/**< Users that were sent ahead of the cursor (sorted list of serials) */
+	int sent_count;			/**< Number of entries in 'sent' */
+	int sent_size;			/**< Allocated number of entries in 'sent' */
+	dbuf held;			/**< Other traffic to this server, held back until the burst is complete */
+	long long bytes;		/**< Statistics: bytes of burst data generated */
+	int users;			/**< Statistics: users sent */
+	int channels;			/**< Statistics: channels sent */
+	time_t started;			/**< Statistics: time the burst started */
+};
+
 /** @} */
 
 struct MessageTag {
 	MessageTag *prev, *next;
 	char *name;
 	char *value;
+	int flags;		/**< One or more of MTAG_FLAG_* */
 };
 
+/** The MessageTag was allocated by new_mtag() from the per-command
+ * arena. The name and value live in the same block, so they must not
+ * be changed or freed. The tag is gone once parse() is done with the
+ * command: use duplicate_mtag() if you need to keep it.
+ */
+#define MTAG_FLAG_ARENA		0x1
+
 typedef struct NameValueList NameValueList;
 struct NameValueList {
 	NameValueList *prev, *next;
@@ -1446,6 +1552,21 @@ struct OperClassCheckParams
         void *extra;
 };
 
+/** Compiled permissions of a local IRCOp.
+ * Each permission path is assigned a small integer ID (see
+ * OperClassGetPermissionID()). Permissions that do not depend on
+ * the victim, channel, etc. are evaluated once and stored as a bit.
+ */
+struct OperPermissionCache
+{
+	int generation;			/**< Value of operclass_generation when this was compiled */
+	ConfigItem_operclass *operclass; /**< Operclass of the oper block that was used */
+	int size;			/**< Number of permission IDs that fit in the bitsets below */
+	unsigned char *compiled;	/**< Bit is set if this permission ID has been looked at */
+	unsigned char *dynamic;		/**< Bit is set if the result depends on the victim/channel/.. (evaluated on each call) */
+	unsigned char *allowed;		/**< Bit is set if the permission is granted (only if compiled and not dynamic) */
+};
+
 struct ConfigItem_operclass {
 	ConfigItem_operclass *prev, *next;
 	OperClass *classStruct;
@@ -1638,6 +1759,7 @@ struct ConfigItem_log {
 	long maxsize;
 	int  flags;
 	int  logfd;
+	int  format; /**< One of LOG_FORMAT_* */
 };
 
 struct ConfigItem_unknown {
@@ -1838,6 +1960,9 @@ struct Channel {
 	struct Channel *nextch;			/**< Next channel in linked list (channel) */
 	struct Channel *prevch;			/**< Previous channel in linked list (channel) */
 	struct Channel *hnextch;		/**< Next channel in hash table */
+	struct Channel *snextch;		/**< Next channel in the size index (see hash_get_chan_size_bucket()) */
+	struct Channel *sprevch;		/**< Previous channel in the size index */
+	int sizebucket;				/**< Bucket in the size index */
 	Mode mode;				/**< Channel Mode set on this channel */
 	time_t creationtime;			/**< When the channel was first created */
 	char *topic;				/**< Channel TOPIC */
@@ -1849,6 +1974,7 @@ struct Channel {
 	Ban *banlist;				/**< List of bans (+b) */
 	Ban *exlist;				/**< List of ban exceptions (+e) */
 	Ban *invexlist;				/**< List of invite exceptions (+I) */
+	unsigned int listmode_version;		/**< Changes whenever a +beI entry is added or removed */
 	char *mode_lock;			/**< Mode lock (MLOCK) applied to channel - usually by Services */
 	ModData moddata[MODDATA_MAX_CHANNEL];	/**< Channel attached module data, used by the ModData system */
 	char chname[1];				/**< Channel name */
@@ -2158,8 +2284,12 @@ struct ConfigItem_badword {
 	unsigned short	type;
 	char		action;
 	pcre2_code	*pcre2_expr;
+	int		jit;
 };
 
+/** A set of words compiled for matching in a single pass, see wordfilter_run() */
+typedef struct WordFilter WordFilter;
+
 /*-- end of badwords --*/
 
 /* Flags for 'sendflags' in 'sendto_channel' */
@@ -37,6 +37,10 @@
 Cmode *Channelmode_Table = NULL;
 /** Highest index in Channelmode_Table */
 unsigned short Channelmode_highest = 0;
+/** Extended channel mode character to mode bit, 0 if not in use */
+Cmode_t Channelmode_Bychar[256];
+/** Core channel mode character to mode bit (MODE_*), 0 if not a core mode */
+long Corechannelmode_Bychar[256];
 
 /** @} */
 
@@ -47,6 +51,7 @@ char extchmstr[4][64];
 
 /* Private functions (forward declaration) and variables */
 static void make_cmodestr(void);
+static void make_cmode_lookup(void);
 static char previous_chanmodes[256];
 static Cmode *ParamTable[MAXPARAMMODES+1];
 static void unload_extcmode_commit(Cmode *cmode);
@@ -104,6 +109,24 @@ static void make_cmodestr(void)
 	*p = '\0';
 }
 
+/** Rebuild the character to mode bit tables used by has_channel_mode()
+ * and get_extmode_bitbychar(). Called whenever a mode is added or removed.
+ */
+static void make_cmode_lookup(void)
+{
+	CoreChannelModeTable *tab;
+	int i;
+
+	memset(Corechannelmode_Bychar, 0, sizeof(Corechannelmode_Bychar));
+	for (tab = &corechannelmodetable[0]; tab->mode; tab++)
+		Corechannelmode_Bychar[(unsigned char)tab->flag] = tab->mode;
+
+	memset(Channelmode_Bychar, 0, sizeof(Channelmode_Bychar));
+	for (i = 0; i < EXTCMODETABLESZ; i++)
+		if (Channelmode_Table[i].flag)
+			Channelmode_Bychar[(unsigned char)Channelmode_Table[i].flag] = Channelmode_Table[i].mode;
+}
+
 /** Check for changes - if any are detected, we broadcast the change */
 void extcmodes_check_for_changes(void)
 {
@@ -165,6 +188,7 @@ void extcmode_init(void)
 	memset(&extchmstr, 0, sizeof(extchmstr));
 	memset(&param_to_slot_mapping, 0, sizeof(param_to_slot_mapping));
 	*previous_chanmodes = '\0';
+	make_cmode_lookup();
 }
 
 /** Update letter->slot mapping and slot->handler mapping */
@@ -273,6 +297,8 @@ Cmode *CmodeAdd(Module *module, CmodeInfo req, Cmode_t *mode)
 			if (j > Channelmode_highest)
 				Channelmode_highest = j;
 
+	make_cmode_lookup();
+
         if (Channelmode_Table[i].paracount == 1)
                 extcmode_para_addslot(&Channelmode_Table[i], paraslot);
                 
@@ -384,6 +410,7 @@ static void unload_extcmode_commit(Cmode *cmode)
 	}
 
 	cmode->flag = '\0';
+	make_cmode_lookup();
 }
 
 /** Unload all unused channel modes after a REHASH */
@@ -213,7 +213,9 @@ void DoEvents(void)
 		}
 		if ((e->every_msec == 0) || minimum_msec_since_last_run(&e->last_run, e->every_msec))
 		{
+			long long start = profile_now();
 			(*e->event)(e->data);
+			latency_add(&e->latency, profile_now() - start);
 			if (e->count > 0)
 			{
 				e->count--;
@@ -238,6 +240,10 @@ void SetupEvents(void)
 	EventAdd(NULL, "unrealdns_removeoldrecords", unrealdns_removeoldrecords, NULL, 15000, 0);
 	EventAdd(NULL, "check_pings", check_pings, NULL, 1000, 0);
 	EventAdd(NULL, "check_deadsockets", check_deadsockets, NULL, 1000, 0);
+	EventAdd(NULL, "sno_coalesce_flush", sno_coalesce_flush, NULL, 1000, 0);
+#ifdef LOG_ASYNC
+	EventAdd(NULL, "log_writer_check", log_writer_check, NULL, 5000, 0);
+#endif
 	EventAdd(NULL, "handshake_timeout", handshake_timeout, NULL, 1000, 0);
 	EventAdd(NULL, "try_connections", try_connections, NULL, 2000, 0);
 	EventAdd(NULL, "tls_check_expiry", tls_check_expiry, NULL, (86400/2)*1000, 0);
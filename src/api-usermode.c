@@ -26,6 +26,8 @@ char umodestring[UMODETABLESZ+1];
 
 Umode *Usermode_Table = NULL;
 short	 Usermode_highest = 0;
+/** User mode character to mode bit, 0 if not in use. Used by find_user_mode(). */
+long Usermode_Bychar[256];
 
 Snomask *Snomask_Table = NULL;
 short	 Snomask_highest = 0;
@@ -125,6 +127,16 @@ void make_umodestr(void)
 			*m++ = Usermode_Table[i].flag;
 	}
 	*m = '\0';
+
+	/* And the character lookup table, which excludes modes that are
+	 * pending unload (like find_user_mode() always did).
+	 */
+	memset(Usermode_Bychar, 0, sizeof(Usermode_Bychar));
+	for (i = 0; i < UMODETABLESZ; i++)
+	{
+		if (Usermode_Table[i].flag && !Usermode_Table[i].unloaded)
+			Usermode_Bychar[(unsigned char)Usermode_Table[i].flag] = Usermode_Table[i].mode;
+	}
 }
 
 static char previous_umodestring[256];
@@ -225,7 +237,10 @@ Umode *UmodeAdd(Module *module, char ch, int global, int unset_on_deoper, int (*
 void UmodeDel(Umode *umode)
 {
 	if (loop.ircd_rehashing)
+	{
 		umode->unloaded = 1;
+		make_umodestr();
+	}
 	else	
 	{
 		Client *client;
@@ -503,14 +518,7 @@ void remove_oper_privileges(Client *client, int broadcast_mode_change)
 /** Return long integer mode for a user mode character (eg: 'x' -> 0x10) */
 long find_user_mode(char flag)
 {
-	int i;
-
-	for (i = 0; i < UMODETABLESZ; i++)
-	{
-		if ((Usermode_Table[i].flag == flag) && !(Usermode_Table[i].unloaded))
-			return Usermode_Table[i].mode;
-	}
-	return 0;
+	return Usermode_Bychar[(unsigned char)flag];
 }
 
 /** Returns 1 if user has this user mode set and 0 if not */
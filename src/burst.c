@@ -0,0 +1,357 @@
+/* Resumable server burst
+ * (C) Copyright 2020-present the UnrealIRCd team
+ * License: GPLv2
+ */
+
+/** @file
+ * @brief Resumable server burst.
+ *
+ * When a server links in we have to send it all our users, channels,
+ * TKLs, etc. Previously this was all done from server_sync() in one go,
+ * which could block the event loop for several seconds on large
+ * networks and put the entire burst in the sendQ at once.
+ *
+ * Now the users and channels are sent in chunks by burst_continue()
+ * (in the server module). It is called from send_queued() whenever the
+ * sendQ of the server has (nearly) drained, so the burst is generated
+ * only as fast as the other side can receive it, and other clients
+ * are served in between.
+ *
+ * Keeping the stream consistent:
+ * - All other traffic to the server (eg. a user changing nick or
+ *   joining a channel) is held back in Burst::held and is only sent
+ *   after the burst. So, just like before, the other side receives
+ *   the complete burst first and then all changes in order.
+ * - Users and channels created during the burst are not part of it.
+ *   Their creation is in the held back traffic. For users this means
+ *   the moment they are introduced (registered), not when they
+ *   connected, see burst_register_user().
+ * - Users and channels that are destroyed before we get to them are
+ *   simply not sent. Their destruction is in the held back traffic.
+ *   The cursors are moved if they point to such a user or channel.
+ * - If a user that was not sent yet causes traffic (eg: NICK, JOIN),
+ *   then the user is sent right away, ahead of the cursor. This way
+ *   the other side knows the source of all held back traffic. Since
+ *   NICK is sent before the nick is changed, the user is sent with
+ *   the old nick and replaying the NICK cannot cause a collision.
+ */
+
+#include "unrealircd.h"
+
+/** Last serial handed out in burst_register_user() */
+MODVAR unsigned long long client_list_serial = 0;
+
+/** Number of bursts in progress, so we can skip the checks quickly */
+static int bursts_in_progress = 0;
+
+/** Start sending the burst of users and channels to a server.
+ * @param client	The server (directly connected)
+ */
+void burst_start(Client *client)
+{
+	Burst *burst;
+
+	if (client->local->burst)
+		return;
+
+	burst = client->local->burst = safe_alloc(sizeof(Burst));
+	burst->phase = BURST_PHASE_USERS;
+	burst->last_serial = client_list_serial;
+	/* New clients are added to the head of client_list, so start at the tail */
+	if (!list_empty(&client_list))
+		burst->next_user = list_entry(client_list.prev, Client, client_node);
+	burst->next_channel = channels;
+	dbuf_queue_init(&burst->held);
+	burst->started = TStime();
+	bursts_in_progress++;
+}
+
+/** Returns the user after 'acptr' in the burst order, or NULL if none */
+static Client *burst_user_after(Burst *burst, Client *acptr)
+{
+	if (acptr->client_node.prev == &client_list)
+		return NULL;
+	acptr = list_entry(acptr->client_node.prev, Client, client_node);
+	if (acptr->list_serial > burst->last_serial)
+		return NULL; /* this and the rest were created during the burst */
+	return acptr;
+}
+
+/** Returns 1 if the user with this serial was sent ahead of the cursor */
+static int burst_sent_ahead(Burst *burst, unsigned long long serial)
+{
+	int low = 0, high = burst->sent_count - 1, mid;
+
+	while (low <= high)
+	{
+		mid = (low + high) / 2;
+		if (burst->sent[mid] == serial)
+			return 1;
+		if (burst->sent[mid] < serial)
+			low = mid + 1;
+		else
+			high = mid - 1;
+	}
+	return 0;
+}
+
+/** Remember that the user with this serial was sent ahead of the cursor */
+static void burst_add_sent_ahead(Burst *burst, unsigned long long serial)
+{
+	unsigned long long *n;
+	int i;
+
+	if (burst->sent_count == burst->sent_size)
+	{
+		burst->sent_size = burst->sent_size ? burst->sent_size * 2 : 64;
+		n = safe_alloc(sizeof(unsigned long long) * burst->sent_size);
+		if (burst->sent_count)
+			memcpy(n, burst->sent, sizeof(unsigned long long) * burst->sent_count);
+		safe_free(burst->sent);
+		burst->sent = n;
+	}
+	for (i = burst->sent_count; (i > 0) && (burst->sent[i-1] > serial); i--)
+		burst->sent[i] = burst->sent[i-1];
+	burst->sent[i] = serial;
+	burst->sent_count++;
+}
+
+/** Get the next user to send in the burst and move the cursor.
+ * @param client	The server we are bursting to
+ * @returns The user, or NULL if all users have been sent.
+ */
+Client *burst_next_user(Client *client)
+{
+	Burst *burst = client->local->burst;
+	Client *acptr;
+
+	while ((acptr = burst->next_user))
+	{
+		if (acptr->list_serial)
+			burst->user_serial = acptr->list_serial; /* not for unregistered clients */
+		burst->next_user = burst_user_after(burst, acptr);
+		if ((acptr->direction == client) || !IsUser(acptr) ||
+		    burst_sent_ahead(burst, acptr->list_serial))
+		{
+			continue;
+		}
+		burst->users++;
+		return acptr;
+	}
+	return NULL;
+}
+
+/** Get the next channel to send in the burst and move the cursor.
+ * @param client	The server we are bursting to
+ * @returns The channel, or NULL if all channels have been sent.
+ */
+Channel *burst_next_channel(Client *client)
+{
+	Burst *burst = client->local->burst;
+	Channel *channel = burst->next_channel;
+
+	if (channel)
+	{
+		burst->next_channel = channel->nextch;
+		burst->channels++;
+	}
+	return channel;
+}
+
+/** Has the user been sent to this server (so far) by the burst?
+ * This is used to leave out users from SJOIN and MD that the other
+ * side does not know about yet. Users that were created during the
+ * burst will be introduced by the held back traffic later.
+ * @param client	The server we are bursting to
+ * @param acptr		The user
+ * @returns 1 if sent, 0 if not (or if the user is from that server)
+ */
+int burst_introduced(Client *client, Client *acptr)
+{
+	Burst *burst = client->local->burst;
+
+	if (acptr->direction == client)
+		return 0;
+	if (!burst)
+		return 1;
+	if (acptr->list_serial > burst->last_serial)
+		return 0;
+	if (acptr->list_serial <= burst->user_serial)
+		return 1;
+	return burst_sent_ahead(burst, acptr->list_serial);
+}
+
+/** A user is introduced: a local user completed registration or a
+ * remote user was introduced by UID. This hands out the serial and
+ * moves the user to the head of client_list, so that all users in
+ * client_list stay ordered by serial, as the burst cursor assumes.
+ * Unregistered clients and servers have a serial of 0.
+ * @param client	The user
+ */
+void burst_register_user(Client *client)
+{
+	burst_remove_client(client);
+	list_move(&client->client_node, &client_list);
+	client->list_serial = ++client_list_serial;
+}
+
+/** Hold back traffic to a server while we are sending the burst.
+ * This is called from sendbufto_one() for servers with a burst in progress.
+ * @param to		The server
+ * @param msg		The message
+ * @param len		Length of the message
+ * @returns 1 if the message was held back, 0 if it should be sent now.
+ */
+int burst_hold(Client *to, char *msg, int len)
+{
+	Burst *burst = to->local->burst;
+	char sender[HOSTLEN + 1], *p, *s;
+	Client *acptr;
+	int introduce;
+
+	if (burst->generating)
+	{
+		burst->bytes += len;
+		return 0;
+	}
+
+	/* Skip message tags */
+	p = msg;
+	if (*p == '@')
+	{
+		p = strchr(p, ' ');
+		if (!p)
+			return 0;
+		p++;
+	}
+
+	/* Messages without a source (PING, ERROR) are about the link itself */
+	if (*p != ':')
+		return 0;
+
+	/* Note: copy the sender first, sending below may overwrite 'msg' */
+	for (p++, s = sender; *p && (*p != ' ') && (s < sender + sizeof(sender) - 1); p++)
+		*s++ = *p;
+	*s = '\0';
+	for (; *p == ' '; p++);
+
+	/* If the source is a user that we did not send yet, then send it below */
+	acptr = find_client(sender, NULL);
+	introduce = acptr && IsUser(acptr) && (acptr->direction != to) &&
+	            (acptr->list_serial <= burst->last_serial) && !burst_introduced(to, acptr);
+
+	/* Never hold back PING and PONG, the link could ping out during a
+	 * long burst otherwise. The exception is a (relayed) PONG from a
+	 * user that the other side doesn't know yet, that is held as usual.
+	 */
+	if (!introduce && (!strncmp(p, "PING ", 5) || !strncmp(p, "PONG ", 5)))
+		return 0;
+
+	dbuf_put(&burst->held, msg, len);
+
+	if (introduce)
+	{
+		burst_add_sent_ahead(burst, acptr->list_serial);
+		burst->users++;
+		burst->generating = 1;
+		introduce_user(to, acptr);
+		burst->generating = 0;
+	}
+
+	return 1;
+}
+
+/** A client is about to be removed from client_list, move any cursor pointing to it */
+void burst_remove_client(Client *acptr)
+{
+	Client *server;
+	Burst *burst;
+
+	if (!bursts_in_progress)
+		return;
+
+	list_for_each_entry(server, &server_list, special_node)
+	{
+		burst = server->local->burst;
+		if (burst && (burst->next_user == acptr))
+			burst->next_user = burst_user_after(burst, acptr);
+	}
+}
+
+/** A channel is about to be destroyed, move any cursor pointing to it */
+void burst_remove_channel(Channel *channel)
+{
+	Client *server;
+	Burst *burst;
+
+	if (!bursts_in_progress)
+		return;
+
+	list_for_each_entry(server, &server_list, special_node)
+	{
+		burst = server->local->burst;
+		if (burst && (burst->next_channel == channel))
+			burst->next_channel = channel->nextch;
+	}
+}
+
+/** The burst is complete: send the held back traffic.
+ * @param client	The server
+ */
+void burst_finish(Client *client)
+{
+	Burst *burst = client->local->burst;
+	dbufbuf *block;
+
+	if (!burst)
+		return;
+
+#ifdef HAVE_ZLIB
+	if (zip_out_active(client))
+	{
+		list_for_each_entry(block, &burst->held.dbuf_list, dbuf_node)
+			zip_compress(client, block->data, block->size);
+	} else
+#endif
+	{
+		/* Simply move the blocks over to the sendQ */
+		list_splice_tail_init(&burst->held.dbuf_list, &client->local->sendQ.dbuf_list);
+		client->local->sendQ.length += burst->held.length;
+		burst->held.length = 0;
+	}
+
+	burst_free(client);
+}
+
+/** Free the burst state of a client (if any) */
+void burst_free(Client *client)
+{
+	Burst *burst = client->local->burst;
+
+	if (!burst)
+		return;
+
+	DBufClear(&burst->held);
+	safe_free(burst->sent);
+	safe_free(client->local->burst);
+	bursts_in_progress--;
+}
+
+/** Burst statistics for a link, for /STATS L.
+ * @returns A string with the statistics, or NULL if no burst is in progress.
+ */
+char *burst_stats(Client *client)
+{
+	static char buf[256];
+	Burst *burst = client->local->burst;
+
+	if (!burst)
+		return NULL;
+
+	snprintf(buf, sizeof(buf),
+	         "%s, %d users, %d channels, %lld bytes generated, %u bytes held back, running for %lld seconds",
+	         (burst->phase == BURST_PHASE_USERS) ? "sending users" : "sending channels",
+	         burst->users, burst->channels, burst->bytes, DBufLength(&burst->held),
+	         (long long)(TStime() - burst->started));
+	return buf;
+}
@@ -145,26 +145,18 @@ Membership *find_membership_link(Membership *lp, Channel *ptr)
 	return NULL;
 }
 
+static mp_pool_t *member_pool = NULL;
+static mp_pool_t *membership_pool = NULL;
+
 /** Allocate and return an empty Member struct */
 static Member *make_member(void)
 {
 	Member *lp;
-	unsigned int	i;
 
-	if (freemember == NULL)
-	{
-		for (i = 1; i <= (4072/sizeof(Member)); ++i)
-		{
-			lp = safe_alloc(sizeof(Member));
-			lp->client = NULL;
-			lp->flags = 0;
-			lp->next = freemember;
-			freemember = lp;
-		}
-	}
-	lp = freemember;
-	freemember = freemember->next;
-	lp->next = NULL;
+	if (!member_pool)
+		member_pool = mp_pool_new(sizeof(Member), 512 * 1024, "Member");
+	lp = mp_pool_get(member_pool);
+	memset(lp, 0, sizeof(Member));
 	return lp;
 }
 
@@ -174,35 +166,17 @@ static void free_member(Member *lp)
 	if (!lp)
 		return;
 	moddata_free_member(lp);
-	memset(lp, 0, sizeof(Member));
-	lp->next = freemember;
-	lp->client = NULL;
-	lp->flags = 0;
-	freemember = lp;
+	mp_pool_release(lp);
 }
 
 /** Allocate and return an empty Membership struct */
 static Membership *make_membership(void)
 {
-	Membership *m = NULL;
-	unsigned int	i;
+	Membership *m;
 
-	if (freemembership == NULL)
-	{
-		for (i = 1; i <= (4072/sizeof(Membership)); i++)
-		{
-			m = safe_alloc(sizeof(Membership));
-			m->next = freemembership;
-			freemembership = m;
-		}
-		m = freemembership;
-		freemembership = m->next;
-	}
-	else
-	{
-		m = freemembership;
-		freemembership = freemembership->next;
-	}
+	if (!membership_pool)
+		membership_pool = mp_pool_new(sizeof(Membership), 512 * 1024, "Membership");
+	m = mp_pool_get(membership_pool);
 	memset(m, 0, sizeof(Membership));
 	return m;
 }
@@ -213,9 +187,7 @@ static void free_membership(Membership *m)
 	if (m)
 	{
 		moddata_free_membership(m);
-		memset(m, 0, sizeof(Membership));
-		m->next = freemembership;
-		freemembership = m;
+		mp_pool_release(m);
 	}
 }
 
@@ -339,6 +311,7 @@ int add_listmode_ex(Ban **list, Client *client, Channel *channel, char *banid, c
 	safe_strdup(ban->banstr, banid); /* cAsE may differ, use oldest version of it */
 	safe_strdup(ban->who, setby);
 	ban->when = seton;
+	channel->listmode_version++;
 	return 0;
 }
 
@@ -374,6 +347,7 @@ int del_listmode(Ban **list, Channel *channel, char *banid)
 			safe_free(tmp->banstr);
 			safe_free(tmp->who);
 			free_ban(tmp);
+			channel->listmode_version++;
 			return 0;
 		}
 	}
@@ -512,6 +486,7 @@ void add_user_to_channel(Channel *channel, Client *who, int flags)
 		m->next = channel->members;
 		channel->members = m;
 		channel->users++;
+		update_channel_size_index(channel);
 
 		mb = make_membership();
 		mb->channel = channel;
@@ -586,23 +561,13 @@ long get_access(Client *client, Channel *channel)
 /** Returns 1 if channel has this channel mode set and 0 if not */
 int has_channel_mode(Channel *channel, char mode)
 {
-	CoreChannelModeTable *tab = &corechannelmodetable[0];
-	int i;
-
 	/* Extended channel modes */
-	for (i=0; i <= Channelmode_highest; i++)
-	{
-		if ((Channelmode_Table[i].flag == mode) && (channel->mode.extmode & Channelmode_Table[i].mode))
-			return 1;
-	}
+	if (channel->mode.extmode & Channelmode_Bychar[(unsigned char)mode])
+		return 1;
 
 	/* Built-in channel modes */
-	while (tab->mode != 0x0)
-	{
-		if ((channel->mode.mode & tab->mode) && (tab->flag == mode))
-			return 1;
-		tab++;
-	}
+	if (channel->mode.mode & Corechannelmode_Bychar[(unsigned char)mode])
+		return 1;
 
 	/* Special handling for +l (needed??) */
 	if (channel->mode.limit && (mode == 'l'))
@@ -618,27 +583,13 @@ int has_channel_mode(Channel *channel, char mode)
 /** Get the extended channel mode 'bit' value (eg: 0x20) by character (eg: 'Z') */
 Cmode_t get_extmode_bitbychar(char m)
 {
-        int extm;
-        for (extm=0; extm <= Channelmode_highest; extm++)
-        {
-                if (Channelmode_Table[extm].flag == m)
-                        return Channelmode_Table[extm].mode;
-        }
-        return 0;
+	return Channelmode_Bychar[(unsigned char)m];
 }
 
 /** Get the extended channel mode character (eg: 'Z') by the 'bit' value (eg: 0x20) */
 long get_mode_bitbychar(char m)
 {
-	CoreChannelModeTable *tab = &corechannelmodetable[0];
-
-	while(tab->mode != 0x0)
-	{
-		if (tab->flag == m)
-			return tab->mode;
-		tab++;;
-	}
-	return 0;
+	return Corechannelmode_Bychar[(unsigned char)m];
 }
 
 /** Write the "simple" list of channel modes for channel channel onto buffer mbuf with the parameters in pbuf.
@@ -1066,10 +1017,14 @@ int sub1_from_channel(Channel *channel)
 
 	--channel->users;
 	if (channel->users > 0)
+	{
+		update_channel_size_index(channel);
 		return 0;
+	}
 
 	/* No users in the channel anymore */
 	channel->users = 0; /* to be sure */
+	update_channel_size_index(channel);
 
 	/* If the channel is +P then this hook will actually stop destruction. */
 	RunHook2(HOOKTYPE_CHANNEL_DESTROY, channel, &should_destroy);
@@ -1117,6 +1072,7 @@ int sub1_from_channel(Channel *channel)
 	safe_free(channel->topic);
 	safe_free(channel->topic_nick);
 
+	burst_remove_channel(channel);
 	if (channel->prevch)
 		channel->prevch->nextch = channel->nextch;
 	else
@@ -149,6 +149,7 @@ static NameValue _ListenerFlags[] = {
 /* This MUST be alphabetized */
 static NameValue _LinkFlags[] = {
 	{ CONNECT_AUTO,	"autoconnect" },
+	{ CONNECT_ZIP,	"compression" },
 	{ CONNECT_INSECURE,	"insecure" },
 	{ CONNECT_QUARANTINE, "quarantine"},
 	{ CONNECT_TLS, "ssl" },
@@ -170,6 +171,19 @@ static NameValue _LogFlags[] = {
 	{ LOG_TKL, "tkl" },
 };
 
+/** Returns the name of a log type as used in log::flags (eg: LOG_ERROR -> "errors").
+ * If more than one flag is set then the name of the first one is returned.
+ */
+char *log_type_name(int flags)
+{
+	int i;
+
+	for (i = 0; i < ARRAY_SIZEOF(_LogFlags); i++)
+		if (flags & _LogFlags[i].flag)
+			return _LogFlags[i].name;
+	return "other";
+}
+
 /* This MUST be alphabetized */
 static NameValue _TLSFlags[] = {
 	{ TLSFLAG_FAILIFNOCERT, "fail-if-no-clientcert" },
@@ -977,6 +991,7 @@ ConfigFile *config_parse_with_offset(char *filename, char *confdata, unsigned in
 	int n;
 	ConfigEntry	*curce;
 	ConfigEntry	**lastce;
+	ConfigEntry	**toplevel_lastce = NULL;
 	ConfigEntry	*cursection;
 	ConfigFile	*curcf;
 	int preprocessor_level = 0;
@@ -1026,6 +1041,11 @@ ConfigFile *config_parse_with_offset(char *filename, char *confdata, unsigned in
 					continue;
 				}
 				curce->ce_sectlinenum = linenumber;
+				/* Remember where the top level list ends, so we don't
+				 * have to walk the entire file again when the block closes.
+				 */
+				if (!cursection)
+					toplevel_lastce = lastce;
 				lastce = &(curce->ce_entries);
 				cursection = curce;
 				curce = NULL;
@@ -1052,7 +1072,7 @@ ConfigFile *config_parse_with_offset(char *filename, char *confdata, unsigned in
 				cursection->ce_fileposend = (ptr - confdata);
 				cursection = cursection->ce_prevlevel;
 				if (!cursection)
-					lastce = &(curcf->cf_entries);
+					lastce = toplevel_lastce;
 				else
 					lastce = &(cursection->ce_entries);
 				for(;*lastce;lastce = &((*lastce)->ce_next))
@@ -2364,6 +2384,9 @@ void	config_rehash()
 
 	USE_BAN_VERSION = 0;
 
+	/* Oper blocks and operclasses are about to be freed */
+	operclass_generation++;
+
 	for (admin_ptr = conf_admin; admin_ptr; admin_ptr = (ConfigItem_admin *)next)
 	{
 		next = (ListStruct *)admin_ptr->next;
@@ -2556,6 +2579,9 @@ void	config_rehash()
 		DelListItem(log_ptr, conf_log);
 		safe_free(log_ptr);
 	}
+#ifdef LOG_ASYNC
+	log_writer_reopen();
+#endif
 	for (alias_ptr = conf_alias; alias_ptr; alias_ptr = (ConfigItem_alias *)next) {
 		RealCommand *cmptr = find_command(alias_ptr->alias, 0);
 		ConfigItem_alias_format *fmt;
@@ -6104,6 +6130,13 @@ int     _conf_log(ConfigFile *conf, ConfigEntry *ce)
 		{
 			ca->maxsize = config_checkval(cep->ce_vardata,CFG_SIZE);
 		}
+		else if (!strcmp(cep->ce_varname, "format"))
+		{
+			if (!strcmp(cep->ce_vardata, "json"))
+				ca->format = LOG_FORMAT_JSON;
+			else
+				ca->format = LOG_FORMAT_TEXT;
+		}
 		else if (!strcmp(cep->ce_varname, "flags"))
 		{
 			for (cepp = cep->ce_entries; cepp; cepp = cepp->ce_next)
@@ -6121,7 +6154,7 @@ int     _conf_log(ConfigFile *conf, ConfigEntry *ce)
 int _test_log(ConfigFile *conf, ConfigEntry *ce) {
 	int fd, errors = 0;
 	ConfigEntry *cep, *cepp;
-	char has_flags = 0, has_maxsize = 0;
+	char has_flags = 0, has_maxsize = 0, has_format = 0;
 
 	if (!ce->ce_vardata)
 	{
@@ -6184,6 +6217,28 @@ int _test_log(ConfigFile *conf, ConfigEntry *ce) {
 				errors++;
 			}
 		}
+		else if (!strcmp(cep->ce_varname, "format"))
+		{
+			if (has_format)
+			{
+				config_warn_duplicate(cep->ce_fileptr->cf_filename,
+					cep->ce_varlinenum, "log::format");
+				continue;
+			}
+			has_format = 1;
+			if (!cep->ce_vardata)
+			{
+				config_error_empty(cep->ce_fileptr->cf_filename,
+					cep->ce_varlinenum, "log", cep->ce_varname);
+				errors++;
+			} else
+			if (strcmp(cep->ce_vardata, "text") && strcmp(cep->ce_vardata, "json"))
+			{
+				config_error("%s:%i: log::format must be either 'text' or 'json'",
+					cep->ce_fileptr->cf_filename, cep->ce_varlinenum);
+				errors++;
+			}
+		}
 		else
 		{
 			config_error_unknown(cep->ce_fileptr->cf_filename, cep->ce_varlinenum,
@@ -6518,9 +6573,17 @@ int	_test_link(ConfigFile *conf, ConfigEntry *ce)
 			{
 				if (!strcmp(cepp->ce_varname, "quarantine"))
 					;
+				else if (!strcmp(cepp->ce_varname, "compression"))
+				{
+#ifndef HAVE_ZLIB
+					config_error("%s:%d: link::options::compression: UnrealIRCd was compiled without zlib support",
+					             cepp->ce_fileptr->cf_filename, cepp->ce_varlinenum);
+					errors++;
+#endif
+				}
 				else
 				{
-					config_error("%s:%d: link::options only has one possible option ('quarantine', rarely used). "
+					config_error("%s:%d: link::options only has two possible options ('quarantine' and 'compression'). "
 					             "Option '%s' is unrecognized. "
 					             "Perhaps you meant to set an outgoing option in link::outgoing::options instead?",
 					             cepp->ce_fileptr->cf_filename, cepp->ce_varlinenum, cepp->ce_varname);
@@ -23,7 +23,7 @@ static mp_pool_t *dbuf_bufpool = NULL;
 
 void dbuf_init(void)
 {
-	dbuf_bufpool = mp_pool_new(sizeof(struct dbufbuf), 512 * 1024);
+	dbuf_bufpool = mp_pool_new(sizeof(struct dbufbuf), 512 * 1024, "dbufbuf");
 }
 
 /*
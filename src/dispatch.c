@@ -87,6 +87,17 @@ void fd_setselect(int fd, int flags, IOCallbackFunc iocb, void *data)
 		fd_refresh(fd);
 }
 
+/** Update the loop statistics after waiting for I/O, called by fd_select().
+ * @param wait_start	The profile_now() time from before waiting
+ * @param num		The number of fds with events (or -1 on error)
+ */
+static void fd_select_stats(long long wait_start, int num)
+{
+	loopstats.io_wait = profile_now() - wait_start;
+	latency_add(&loopstats.io_wait_time, loopstats.io_wait);
+	latency_add(&loopstats.fd_events, (num > 0) ? num : 0);
+}
+
 /***************************************************************************************
  * select() backend.                                                                   *
  ***************************************************************************************/
@@ -151,6 +162,7 @@ void fd_select(time_t delay)
 {
 	struct timeval to;
 	int num, fd;
+	long long wait_start;
 	fd_set work_read_fds;
 	fd_set work_write_fds;
 #ifdef _WIN32
@@ -172,11 +184,13 @@ void fd_select(time_t delay)
 	ircd_log(LOG_ERROR, "fd_select() on 0-%d...", highest_fd+1);
 #endif
 
+	wait_start = profile_now();
 #ifdef _WIN32
 	num = select(highest_fd + 1, &work_read_fds, &work_write_fds, &work_except_fds, &to);
 #else
 	num = select(highest_fd + 1, &work_read_fds, &work_write_fds, NULL, &to);
 #endif
+	fd_select_stats(wait_start, num);
 	if (num < 0)
 	{
 		extern void report_baderror(char *text, Client *client);
@@ -232,7 +246,10 @@ void fd_select(time_t delay)
 			iocb = fde->read_callback;
 
 			if (iocb != NULL)
+			{
 				iocb(fd, evflags, fde->data);
+				loopstats.read_callbacks++;
+			}
 		}
 
 		if (evflags & FD_SELECT_WRITE)
@@ -240,7 +257,10 @@ void fd_select(time_t delay)
 			iocb = fde->write_callback;
 
 			if (iocb != NULL)
+			{
 				iocb(fd, evflags, fde->data);
+				loopstats.write_callbacks++;
+			}
 		}
 
 		num--;
@@ -350,6 +370,7 @@ void fd_select(time_t delay)
 {
 	struct timespec ts;
 	int num, p, revents, fd;
+	long long wait_start;
 	struct kevent *ke;
 
 	if (kqueue_fd == -1)
@@ -362,7 +383,9 @@ void fd_select(time_t delay)
 	ts.tv_sec = delay / 1000;
 	ts.tv_nsec = delay % 1000 * 1000000;
 
+	wait_start = profile_now();
 	num = kevent(kqueue_fd, NULL, 0, kqueue_events, MAXCONNECTIONS * 2, &ts);
+	fd_select_stats(wait_start, num);
 	if (num <= 0)
 		return;
 
@@ -382,7 +405,10 @@ void fd_select(time_t delay)
 			iocb = fde->read_callback;
 
 			if (iocb != NULL)
+			{
 				iocb(fd, FD_SELECT_READ, fde->data);
+				loopstats.read_callbacks++;
+			}
 		}
 
 		if (revents == EVFILT_WRITE)
@@ -390,7 +416,10 @@ void fd_select(time_t delay)
 			iocb = fde->write_callback;
 
 			if (iocb != NULL)
+			{
 				iocb(fd, FD_SELECT_WRITE, fde->data);
+				loopstats.write_callbacks++;
+			}
 		}
 	}
 }
@@ -455,6 +484,7 @@ void fd_select(time_t delay)
 {
 	int num, p, revents, fd;
 	struct epoll_event *epfd;
+	long long wait_start;
 #ifdef DEBUG_IOENGINE
 	int read_callbacks = 0, write_callbacks = 0;
 	struct timeval oldt, t;
@@ -463,7 +493,9 @@ void fd_select(time_t delay)
 	if (epoll_fd == -1)
 		epoll_fd = epoll_create(MAXCONNECTIONS);
 
+	wait_start = profile_now();
 	num = epoll_wait(epoll_fd, epfds, MAXCONNECTIONS, delay);
+	fd_select_stats(wait_start, num);
 	if (num <= 0)
 		return;
 
@@ -497,7 +529,10 @@ void fd_select(time_t delay)
 			iocb = fde->read_callback;
 
 			if (iocb != NULL)
+			{
 				iocb(fd, evflags, fde->data);
+				loopstats.read_callbacks++;
+			}
 
 #ifdef DEBUG_IOENGINE
 			read_callbacks++;
@@ -509,7 +544,10 @@ void fd_select(time_t delay)
 			iocb = fde->write_callback;
 
 			if (iocb != NULL)
+			{
 				iocb(fd, evflags, fde->data);
+				loopstats.write_callbacks++;
+			}
 
 #ifdef DEBUG_IOENGINE
 			write_callbacks++;
@@ -587,8 +625,11 @@ void fd_select(time_t delay)
 {
 	int num, p, revents, fd;
 	struct pollfd *pfd;
+	long long wait_start;
 
+	wait_start = profile_now();
 	num = poll(pollfds, nfds + 1, delay);
+	fd_select_stats(wait_start, num);
 	if (num <= 0)
 		return;
 
@@ -618,14 +659,20 @@ void fd_select(time_t delay)
 			iocb = fde->read_callback;
 
 			if (iocb != NULL)
+			{
 				iocb(fd, evflags, fde->data);
+				loopstats.read_callbacks++;
+			}
 		}
 
 		if (evflags & FD_SELECT_WRITE)
 		{
 			iocb = fde->write_callback;
 			if (iocb != NULL)
+			{
 				iocb(fd, evflags, fde->data);
+				loopstats.write_callbacks++;
+			}
 		}
 	}
 }
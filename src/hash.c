@@ -19,6 +19,10 @@
 
 #include "unrealircd.h"
 
+/* Forward declarations */
+static void add_to_channel_size_index(Channel *channel);
+static void del_from_channel_size_index(Channel *channel);
+
 /* Next #define's, the siphash_raw() and siphash_nocase() functions are based
  * on the SipHash reference C implementation to which the following applies:
  * Copyright (c) 2012-2016 Jean-Philippe Aumasson
@@ -367,6 +371,7 @@ int add_to_channel_hash_table(char *name, Channel *channel)
 	hashv = hash_channel_name(name);
 	channel->hnextch = channelTable[hashv];
 	channelTable[hashv] = channel;
+	add_to_channel_size_index(channel);
 	return 0;
 }
 /*
@@ -405,6 +410,7 @@ void del_from_channel_hash_table(char *name, Channel *channel)
 	{
 		if (tmp == channel)
 		{
+			del_from_channel_size_index(channel);
 			if (prev)
 				prev->hnextch = tmp->hnextch;
 			else
@@ -599,6 +605,100 @@ Channel *hash_get_chan_bucket(uint64_t hashv)
 	return channelTable[hashv];
 }
 
+/** @defgroup ChannelSizeIndex Channel size index
+ * Channels are also kept in lists by the number of users, so /LIST can
+ * show the biggest channels first and skip all the small ones for
+ * queries like "LIST >2" without looking at them.
+ * Channels with less than CHAN_SIZE_EXACT users each have their own
+ * bucket, above that the buckets are powers of two (32-63, 64-127, ...).
+ * New entries are added at the end of a bucket.
+ * @{
+ */
+#define CHAN_SIZE_EXACT 32
+
+static Channel *chanSizeHead[CHAN_SIZE_BUCKETS];
+static Channel *chanSizeTail[CHAN_SIZE_BUCKETS];
+
+/** Return the size bucket for a channel with this number of users */
+int channel_size_bucket(int users)
+{
+	int bucket = CHAN_SIZE_EXACT;
+
+	if (users < CHAN_SIZE_EXACT)
+		return users < 0 ? 0 : users;
+
+	for (users /= CHAN_SIZE_EXACT * 2; users; users >>= 1)
+		bucket++;
+	return MIN(bucket, CHAN_SIZE_BUCKETS - 1);
+}
+
+/** Return the range of user counts that fall in a size bucket.
+ * @param bucket	The size bucket (0 to CHAN_SIZE_BUCKETS-1)
+ * @param min		Set to the minimum number of users
+ * @param max		Set to the maximum number of users
+ */
+void channel_size_bucket_range(int bucket, int *min, int *max)
+{
+	if (bucket < CHAN_SIZE_EXACT)
+	{
+		*min = *max = bucket;
+		return;
+	}
+	*min = CHAN_SIZE_EXACT << (bucket - CHAN_SIZE_EXACT);
+	*max = (bucket == CHAN_SIZE_BUCKETS - 1) ? INT_MAX : (*min * 2) - 1;
+}
+
+static void del_from_channel_size_index(Channel *channel)
+{
+	int bucket = channel->sizebucket;
+
+	if (channel->sprevch)
+		channel->sprevch->snextch = channel->snextch;
+	else
+		chanSizeHead[bucket] = channel->snextch;
+	if (channel->snextch)
+		channel->snextch->sprevch = channel->sprevch;
+	else
+		chanSizeTail[bucket] = channel->sprevch;
+	channel->snextch = channel->sprevch = NULL;
+}
+
+static void add_to_channel_size_index(Channel *channel)
+{
+	int bucket = channel_size_bucket(channel->users);
+
+	channel->sizebucket = bucket;
+	channel->snextch = NULL;
+	channel->sprevch = chanSizeTail[bucket];
+	if (chanSizeTail[bucket])
+		chanSizeTail[bucket]->snextch = channel;
+	else
+		chanSizeHead[bucket] = channel;
+	chanSizeTail[bucket] = channel;
+}
+
+/** Move the channel to the right size bucket after channel->users changed.
+ * This is cheap if the bucket stays the same, which is the common case
+ * for bigger channels.
+ */
+void update_channel_size_index(Channel *channel)
+{
+	if (channel_size_bucket(channel->users) == channel->sizebucket)
+		return;
+	del_from_channel_size_index(channel);
+	add_to_channel_size_index(channel);
+}
+
+/** Return the first channel in this size bucket (use channel->snextch for the next) */
+Channel *hash_get_chan_size_bucket(int bucket)
+{
+	if ((bucket < 0) || (bucket >= CHAN_SIZE_BUCKETS))
+		return NULL;
+	return chanSizeHead[bucket];
+}
+
+/** @} */
+
 void  count_watch_memory(int *count, u_long *memory)
 {
 	int i = WATCH_HASH_TABLE_SIZE;
@@ -946,7 +1046,7 @@ struct ThrottlingBucket *find_throttling_bucket(Client *client)
 	
 	for (p = ThrottlingHash[hash]; p; p = p->next)
 	{
-		if (!strcmp(p->ip, client->ip))
+		if (p->ip == client->ip) /* both interned */
 			return p;
 	}
 	
@@ -967,7 +1067,7 @@ EVENT(throttling_check_expire)
 			if ((TStime() - n->since) > (THROTTLING_PERIOD ? THROTTLING_PERIOD : 15))
 			{
 				DelListItem(n, ThrottlingHash[i]);
-				safe_free(n->ip);
+				scache_set(&n->ip, NULL);
 				safe_free(n);
 			}
 		}
@@ -1003,7 +1103,7 @@ void add_throttling_bucket(Client *client)
 
 	n = safe_alloc(sizeof(struct ThrottlingBucket));	
 	n->next = n->prev = NULL; 
-	safe_strdup(n->ip, client->ip);
+	scache_set(&n->ip, client->ip);
 	n->since = TStime();
 	n->count = 1;
 	hash = hash_throttling(client->ip);
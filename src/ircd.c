@@ -40,6 +40,7 @@ gid_t irc_gid = 0;
 #endif
 
 MODVAR IRCCounts irccounts;
+MODVAR LoopStats loopstats;
 MODVAR Client me;			/* That's me */
 MODVAR char *me_hash;
 extern char backupbuf[8192];
@@ -96,10 +97,27 @@ void s_die()
 #else
 	unload_all_modules();
 	unlink(conf_files ? conf_files->pid_file : IRCD_PIDFILE);
+#ifdef LOG_ASYNC
+	log_writer_stop();
+#endif
 	exit(0);
 #endif
 }
 
+#ifdef LOG_ASYNC
+/** Signal handler for crashes (SIGSEGV, SIGABRT, ..).
+ * The last log lines before a crash are often the most interesting
+ * ones, so let the log writer thread write them out first. The handler
+ * is reset on entry, so raising the signal again crashes (and dumps
+ * core) as usual.
+ */
+static void s_crash(int sig)
+{
+	log_writer_crash_flush();
+	raise(sig);
+}
+#endif
+
 #ifndef _WIN32
 static void s_rehash()
 {
@@ -180,6 +198,10 @@ void server_reboot(char *mesg)
 	list_for_each_entry(client, &lclient_list, lclient_node)
 		(void) send_queued(client);
 
+#ifdef LOG_ASYNC
+	log_writer_stop();
+#endif
+
 	/*
 	 * ** fd 0 must be 'preserved' if either the -d or -i options have
 	 * ** been passed to us before restarting.
@@ -1340,6 +1362,9 @@ int InitUnrealIRCd(int argc, char *argv[])
 #endif
 
 	fix_timers();
+#ifdef LOG_ASYNC
+	log_writer_start();
+#endif
 	write_pidfile();
 	Debug((DEBUG_NOTICE, "Server ready..."));
 	init_throttling();
@@ -1368,19 +1393,26 @@ int InitUnrealIRCd(int argc, char *argv[])
 void SocketLoop(void *dummy)
 {
 	struct timeval doevents_tv, process_clients_tv;
+	long long iteration_start, start;
 
 	memset(&doevents_tv, 0, sizeof(doevents_tv));
 	memset(&process_clients_tv, 0, sizeof(process_clients_tv));
 
 	while (1)
 	{
+		iteration_start = profile_now();
+
 		gettimeofday(&timeofday_tv, NULL);
 		timeofday = timeofday_tv.tv_sec;
 
 		detect_timeshift_and_warn();
 
 		if (minimum_msec_since_last_run(&doevents_tv, 250))
+		{
+			start = profile_now();
 			DoEvents();
+			latency_add(&loopstats.events_time, profile_now() - start);
+		}
 
 		/* Update statistics */
 		if (irccounts.clients > irccounts.global_max)
@@ -1388,11 +1420,20 @@ void SocketLoop(void *dummy)
 		if (irccounts.me_clients > irccounts.me_max)
 			irccounts.me_max = irccounts.me_clients;
 
-		/* Process I/O */
+		/* Process I/O. The time waiting for I/O is set
+		 * by fd_select() in loopstats.io_wait.
+		 */
+		loopstats.io_wait = 0;
+		start = profile_now();
 		fd_select(SOCKETLOOP_MAX_DELAY);
+		latency_add(&loopstats.io_time, profile_now() - start - loopstats.io_wait);
 
 		if (minimum_msec_since_last_run(&process_clients_tv, 200))
+		{
+			start = profile_now();
 			process_clients();
+			latency_add(&loopstats.process_clients_time, profile_now() - start);
+		}
 
 		/* Check if there are pending "actions".
 		 * These are actions that should be done outside of
@@ -1413,6 +1454,9 @@ void SocketLoop(void *dummy)
 			reinit_ssl(NULL);
 			doreloadcert = 0;
 		}
+
+		loopstats.iterations++;
+		latency_add(&loopstats.iteration_time, profile_now() - iteration_start - loopstats.io_wait);
 	}
 }
 
@@ -1500,5 +1544,15 @@ static void setup_signals()
 	(void)sigemptyset(&act.sa_mask);
 	(void)sigaddset(&act.sa_mask, SIGUSR1);
 	(void)sigaction(SIGUSR1, &act, NULL);
+#ifdef LOG_ASYNC
+	act.sa_handler = s_crash;
+	act.sa_flags = SA_RESETHAND;
+	(void)sigemptyset(&act.sa_mask);
+	(void)sigaction(SIGSEGV, &act, NULL);
+	(void)sigaction(SIGBUS, &act, NULL);
+	(void)sigaction(SIGABRT, &act, NULL);
+	(void)sigaction(SIGFPE, &act, NULL);
+	(void)sigaction(SIGILL, &act, NULL);
+#endif
 #endif
 }
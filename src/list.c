@@ -37,8 +37,6 @@ static struct liststats {
 MODVAR int  flinks = 0;
 MODVAR int  freelinks = 0;
 MODVAR Link *freelink = NULL;
-MODVAR Member *freemember = NULL;
-MODVAR Membership *freemembership = NULL;
 MODVAR int  numclients = 0;
 
 // TODO: Document whether servers are included or excluded in these lists...
@@ -55,6 +53,7 @@ static mp_pool_t *client_pool = NULL;
 static mp_pool_t *local_client_pool = NULL;
 static mp_pool_t *user_pool = NULL;
 static mp_pool_t *link_pool = NULL;
+static mp_pool_t *ban_pool = NULL;
 
 void initlists(void)
 {
@@ -74,10 +73,11 @@ void initlists(void)
 	INIT_LIST_HEAD(&global_server_list);
 	INIT_LIST_HEAD(&dead_list);
 
-	client_pool = mp_pool_new(sizeof(Client), 512 * 1024);
-	local_client_pool = mp_pool_new(sizeof(LocalClient), 512 * 1024);
-	user_pool = mp_pool_new(sizeof(ClientUser), 512 * 1024);
-	link_pool = mp_pool_new(sizeof(Link), 512 * 1024);
+	client_pool = mp_pool_new(sizeof(Client), 512 * 1024, "Client");
+	local_client_pool = mp_pool_new(sizeof(LocalClient), 512 * 1024, "LocalClient");
+	user_pool = mp_pool_new(sizeof(ClientUser), 512 * 1024, "ClientUser");
+	link_pool = mp_pool_new(sizeof(Link), 512 * 1024, "Link");
+	ban_pool = mp_pool_new(sizeof(Ban), 512 * 1024, "Ban");
 }
 
 /*
@@ -175,7 +175,7 @@ void free_client(Client *client)
 		}
 	}
 	
-	safe_free(client->ip);
+	scache_set(&client->ip, NULL);
 
 	mp_pool_release(client);
 }
@@ -273,8 +273,9 @@ void free_user(Client *client)
 		}
 		client->user->swhois = NULL;
 	}
-	safe_free(client->user->virthost);
+	scache_set(&client->user->virthost, NULL);
 	safe_free(client->user->operlogin);
+	OperClassPermissionsReset(client);
 	mp_pool_release(client->user);
 #ifdef	DEBUGMODE
 	users.inuse--;
@@ -288,6 +289,7 @@ void free_user(Client *client)
  */
 void remove_client_from_list(Client *client)
 {
+	burst_remove_client(client);
 	list_del(&client->client_node);
 	if (MyConnect(client))
 	{
@@ -402,7 +404,8 @@ Ban *make_ban(void)
 {
 	Ban *lp;
 
-	lp = safe_alloc(sizeof(Ban));
+	lp = mp_pool_get(ban_pool);
+	memset(lp, 0, sizeof(Ban));
 #ifdef	DEBUGMODE
 	links.inuse++;
 #endif
@@ -411,7 +414,7 @@ Ban *make_ban(void)
 
 void free_ban(Ban *lp)
 {
-	safe_free(lp);
+	mp_pool_release(lp);
 #ifdef	DEBUGMODE
 	links.inuse--;
 #endif
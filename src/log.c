@@ -0,0 +1,541 @@
+/* Asynchronous log file writer
+ * (C) Copyright 2020-present the UnrealIRCd team
+ * License: GPLv2
+ */
+
+/** @file
+ * @brief Asynchronous log file writer.
+ *
+ * ircd_log() used to write (and stat() and rotate) every log file
+ * directly from the main loop, so a slow or busy disk directly
+ * caused lag on IRC. During floods there can be many log lines
+ * (connects, kills, spamfilter hits) per second.
+ *
+ * Now ircd_log() only formats the line and puts it in a ring buffer
+ * (see log_queue_write()). A separate writer thread takes the lines
+ * from the ring, groups them per file, checks the log::maxsize and
+ * writes them. The ring is a single-producer single-consumer queue:
+ * only the main thread writes to it and only the writer thread reads
+ * from it, so no locks are needed, just the two position counters.
+ * When the ring is empty the writer sleeps in poll() on a pipe, the
+ * main thread only writes a byte to the pipe if it is actually sleeping.
+ * A pipe rather than a condition variable, so waking up the writer is
+ * async-signal-safe and never blocks the main thread.
+ *
+ * The ring has a fixed size (LOG_QUEUE_SIZE). If the writer can't keep
+ * up, new log lines are dropped rather than blocking the main loop.
+ * Dropped lines are counted, reported to IRCOps and shown in STATS z.
+ *
+ * The writer thread is started after we fork into the background.
+ * Until then, in forked child processes and on Windows, ircd_log()
+ * writes the log files directly like it always did.
+ */
+
+#include "unrealircd.h"
+
+#ifdef LOG_ASYNC
+#include <pthread.h>
+#include <poll.h>
+
+/** Record in the ring. Followed by the file name and the text. */
+typedef struct LogRecord LogRecord;
+struct LogRecord {
+	unsigned int size;	/**< Size of the entire record in the ring (or LOG_RECORD_WRAP) */
+	unsigned int textlen;	/**< Length of the text */
+	long maxsize;		/**< log::maxsize of the file, 0 for unlimited */
+	unsigned short filelen;	/**< Length of the file name (without the nul), 0 for a reopen request */
+};
+
+/** Record size flag: skip the rest of the ring and continue at the start */
+#define LOG_RECORD_WRAP		0x80000000
+/** Records are aligned to this */
+#define LOG_RECORD_ALIGN	8
+#define LOG_RECORD_SIZE(filelen, textlen) \
+	((sizeof(LogRecord) + (filelen) + 1 + (textlen) + LOG_RECORD_ALIGN - 1) & ~(LOG_RECORD_ALIGN - 1))
+
+/** Number of files the writer keeps open */
+#define LOG_WRITER_FILES	16
+/** Files that were not written to for this long (in seconds) are closed */
+#define LOG_WRITER_IDLE		60
+/** Maximum time to wait for the writer when we are crashing (in milliseconds) */
+#define LOG_WRITER_CRASH_WAIT	2000
+
+/** An open file of the writer thread */
+typedef struct LogFile LogFile;
+struct LogFile {
+	char name[512];
+	int fd;
+	time_t last;
+};
+
+static char *log_ring = NULL;
+/** Total bytes ever put in the ring, only written by the main thread */
+static size_t log_head = 0;
+/** Total bytes ever taken from the ring, only written by the writer thread */
+static size_t log_tail = 0;
+static pthread_t log_thread;
+/** Pipe to wake up the writer thread, both ends are non-blocking */
+static int log_wakeup_pipe[2] = { -1, -1 };
+/** Set while the writer thread is waiting for work */
+static int log_waiting = 0;
+static int log_running = 0;
+static int log_stop = 0;
+static unsigned long log_queued = 0;
+static unsigned long log_dropped = 0;
+static unsigned long log_dropped_reported = 0;
+/** Write errors in the writer thread, reported by the main thread */
+static unsigned long log_write_errors = 0;
+static unsigned long log_write_errors_reported = 0;
+
+static LogFile log_files[LOG_WRITER_FILES];
+
+static size_t log_ring_used(void)
+{
+	return log_head - __atomic_load_n(&log_tail, __ATOMIC_ACQUIRE);
+}
+
+/** Wake up the writer thread.
+ * @param force	Always wake it up, not only if it is waiting for work
+ */
+static void log_writer_wakeup(int force)
+{
+	char c = 0;
+
+	/* This pairs with log_writer_wait(): either the writer sees the new
+	 * log_head before it goes to sleep, or we see log_waiting set.
+	 */
+	if (force || __atomic_load_n(&log_waiting, __ATOMIC_SEQ_CST))
+	{
+		if (write(log_wakeup_pipe[1], &c, 1) < 0)
+		{
+			/* Pipe full, so the writer will wake up anyway */
+			;
+		}
+	}
+}
+
+/** Wait until there is something in the ring, a stop request, or until
+ * 'seconds' have passed (writer thread only).
+ */
+static void log_writer_wait(int seconds)
+{
+	struct pollfd pfd;
+	char buf[64];
+
+	__atomic_store_n(&log_waiting, 1, __ATOMIC_SEQ_CST);
+	if ((__atomic_load_n(&log_head, __ATOMIC_SEQ_CST) == log_tail) &&
+	    !__atomic_load_n(&log_stop, __ATOMIC_SEQ_CST))
+	{
+		pfd.fd = log_wakeup_pipe[0];
+		pfd.events = POLLIN;
+		pfd.revents = 0;
+		poll(&pfd, 1, seconds * 1000);
+	}
+	__atomic_store_n(&log_waiting, 0, __ATOMIC_SEQ_CST);
+	while (read(log_wakeup_pipe[0], buf, sizeof(buf)) > 0)
+		;
+}
+
+/** Put a record in the ring (main thread only).
+ * @returns 1 if queued, 0 if the ring is full.
+ */
+static int log_ring_put(const char *file, long maxsize, const char *text, int textlen)
+{
+	size_t filelen = file ? strlen(file) : 0;
+	size_t need = LOG_RECORD_SIZE(filelen, textlen);
+	size_t pos = log_head % LOG_QUEUE_SIZE;
+	size_t contiguous = LOG_QUEUE_SIZE - pos;
+	size_t wrap = (need > contiguous) ? contiguous : 0;
+	LogRecord *r;
+	char *p;
+
+	if (LOG_QUEUE_SIZE - log_ring_used() < need + wrap)
+		return 0;
+
+	if (wrap)
+	{
+		/* Not enough room until the end of the ring, continue at the start */
+		*(unsigned int *)(log_ring + pos) = LOG_RECORD_WRAP | (unsigned int)contiguous;
+		pos = 0;
+	}
+
+	r = (LogRecord *)(log_ring + pos);
+	r->size = need;
+	r->textlen = textlen;
+	r->maxsize = maxsize;
+	r->filelen = filelen;
+	p = (char *)(r + 1);
+	if (filelen)
+		memcpy(p, file, filelen);
+	p[filelen] = '\0';
+	memcpy(p + filelen + 1, text, textlen);
+
+	/* Publish the record to the writer thread */
+	__atomic_store_n(&log_head, log_head + wrap + need, __ATOMIC_SEQ_CST);
+	log_writer_wakeup(0);
+	return 1;
+}
+
+/** Close all files of the writer (writer thread only) */
+static void log_writer_close_files(time_t idle_before)
+{
+	int i;
+
+	for (i = 0; i < LOG_WRITER_FILES; i++)
+	{
+		if ((log_files[i].fd != -1) && (log_files[i].last < idle_before))
+		{
+			close(log_files[i].fd);
+			log_files[i].fd = -1;
+			*log_files[i].name = '\0';
+		}
+	}
+}
+
+/** Find or open a log file (writer thread only) */
+static LogFile *log_writer_file(const char *name)
+{
+	LogFile *f, *oldest = NULL;
+	int i;
+
+	for (i = 0; i < LOG_WRITER_FILES; i++)
+	{
+		f = &log_files[i];
+		if ((f->fd != -1) && !strcmp(f->name, name))
+			return f;
+		if (!oldest || (f->fd == -1) || ((oldest->fd != -1) && (f->last < oldest->last)))
+			oldest = f;
+	}
+
+	if (oldest->fd != -1)
+		close(oldest->fd);
+	oldest->fd = open(name, O_CREAT|O_APPEND|O_WRONLY, S_IRUSR|S_IWUSR);
+	if (oldest->fd == -1)
+		return NULL;
+	strlcpy(oldest->name, name, sizeof(oldest->name));
+	return oldest;
+}
+
+/** Write a batch of text to a log file, rotating it if needed (writer thread only) */
+static void log_writer_write(const char *name, long maxsize, const char *text, size_t len)
+{
+	LogFile *f = log_writer_file(name);
+	struct stat st;
+
+	if (!f)
+	{
+		__atomic_add_fetch(&log_write_errors, 1, __ATOMIC_RELAXED);
+		return;
+	}
+
+	if (maxsize && (fstat(f->fd, &st) == 0) && (st.st_size >= maxsize))
+	{
+		char oldlog[512];
+
+		if (write(f->fd, "Max file size reached, starting new log file\n", 45) < 0)
+		{
+			/* Not much we can do about it, we are going to start a new file anyway */
+			;
+		}
+		close(f->fd);
+		snprintf(oldlog, sizeof(oldlog), "%s.old", name);
+		rename(name, oldlog);
+		f->fd = open(name, O_CREAT|O_WRONLY|O_TRUNC, S_IRUSR|S_IWUSR);
+		if (f->fd == -1)
+		{
+			*f->name = '\0';
+			__atomic_add_fetch(&log_write_errors, 1, __ATOMIC_RELAXED);
+			return;
+		}
+	}
+
+	f->last = time(NULL);
+	if (write(f->fd, text, len) != (ssize_t)len)
+		__atomic_add_fetch(&log_write_errors, 1, __ATOMIC_RELAXED);
+}
+
+/** The writer thread.
+ * Takes everything that is in the ring, concatenates the consecutive lines
+ * for the same file and writes them with one write() call.
+ */
+static void *log_writer_thread(void *unused)
+{
+	static char batch[16384];
+	char batchfile[512];
+	long batchmaxsize = 0;
+	size_t batchlen = 0;
+	time_t last_idle_check = time(NULL);
+
+	*batchfile = '\0';
+	while (1)
+	{
+		size_t head = __atomic_load_n(&log_head, __ATOMIC_ACQUIRE);
+		size_t tail = log_tail;
+
+		while (tail != head)
+		{
+			size_t pos = tail % LOG_QUEUE_SIZE;
+			LogRecord *r = (LogRecord *)(log_ring + pos);
+			char *file, *text;
+
+			if (r->size & LOG_RECORD_WRAP)
+			{
+				tail += r->size & ~LOG_RECORD_WRAP;
+				continue;
+			}
+
+			file = (char *)(r + 1);
+			text = file + r->filelen + 1;
+
+			if (batchlen && (!r->filelen || strcmp(file, batchfile) || (batchlen + r->textlen > sizeof(batch))))
+			{
+				log_writer_write(batchfile, batchmaxsize, batch, batchlen);
+				batchlen = 0;
+			}
+
+			if (!r->filelen)
+			{
+				/* Reopen request (after a rehash) */
+				log_writer_close_files(LONG_MAX);
+			} else
+			if (r->textlen > sizeof(batch))
+			{
+				log_writer_write(file, r->maxsize, text, r->textlen);
+			} else {
+				if (!batchlen)
+				{
+					strlcpy(batchfile, file, sizeof(batchfile));
+					batchmaxsize = r->maxsize;
+				}
+				memcpy(batch + batchlen, text, r->textlen);
+				batchlen += r->textlen;
+			}
+			tail += r->size;
+		}
+		if (batchlen)
+		{
+			log_writer_write(batchfile, batchmaxsize, batch, batchlen);
+			batchlen = 0;
+		}
+		/* Hand the space back to the main thread */
+		__atomic_store_n(&log_tail, tail, __ATOMIC_RELEASE);
+
+		if (time(NULL) - last_idle_check >= LOG_WRITER_IDLE)
+		{
+			last_idle_check = time(NULL);
+			log_writer_close_files(last_idle_check - LOG_WRITER_IDLE);
+		}
+
+		if (tail == __atomic_load_n(&log_head, __ATOMIC_ACQUIRE))
+		{
+			/* Only stop once everything is written */
+			if (__atomic_load_n(&log_stop, __ATOMIC_ACQUIRE))
+				break;
+			log_writer_wait(LOG_WRITER_IDLE);
+		}
+	}
+
+	log_writer_close_files(LONG_MAX);
+	return NULL;
+}
+
+/** After fork() only the calling thread exists, so the child must write directly */
+static void log_writer_atfork_child(void)
+{
+	log_running = 0;
+}
+
+/** Start the log writer thread. Called once we are running in the background. */
+void log_writer_start(void)
+{
+	static int atfork_registered = 0;
+	int i;
+
+	if (log_running)
+		return;
+
+	if (!log_ring)
+		log_ring = safe_alloc(LOG_QUEUE_SIZE);
+	for (i = 0; i < LOG_WRITER_FILES; i++)
+		log_files[i].fd = -1;
+	log_head = log_tail = 0;
+	log_stop = 0;
+
+	if (log_wakeup_pipe[0] == -1)
+	{
+		if (pipe(log_wakeup_pipe) < 0)
+		{
+			ircd_log(LOG_ERROR, "Could not create the pipe for the log writer thread: %s -- writing log files directly",
+				strerror(errno));
+			log_wakeup_pipe[0] = log_wakeup_pipe[1] = -1;
+			return;
+		}
+		for (i = 0; i < 2; i++)
+		{
+			fcntl(log_wakeup_pipe[i], F_SETFL, fcntl(log_wakeup_pipe[i], F_GETFL) | O_NONBLOCK);
+			fcntl(log_wakeup_pipe[i], F_SETFD, FD_CLOEXEC);
+		}
+	}
+
+	if (pthread_create(&log_thread, NULL, log_writer_thread, NULL) != 0)
+	{
+		ircd_log(LOG_ERROR, "Could not start the log writer thread: %s -- writing log files directly",
+			strerror(errno));
+		return;
+	}
+	if (!atfork_registered)
+	{
+		pthread_atfork(NULL, NULL, log_writer_atfork_child);
+		atexit(log_writer_stop);
+		atfork_registered = 1;
+	}
+	log_running = 1;
+}
+
+/** Stop the log writer thread, after it has written everything in the queue.
+ * Called on exit and before a restart.
+ */
+void log_writer_stop(void)
+{
+	if (!log_running)
+		return;
+	__atomic_store_n(&log_stop, 1, __ATOMIC_SEQ_CST);
+	log_writer_wakeup(1);
+	pthread_join(log_thread, NULL);
+	log_running = 0;
+}
+
+/** Give the writer thread a chance to write out the queue before we crash.
+ * Called from the crash signal handler, so unlike log_writer_stop() this
+ * does not join the thread and waits at most LOG_WRITER_CRASH_WAIT milliseconds.
+ */
+void log_writer_crash_flush(void)
+{
+	int i;
+
+	if (!log_running || pthread_equal(pthread_self(), log_thread))
+		return;
+	__atomic_store_n(&log_stop, 1, __ATOMIC_SEQ_CST);
+	log_writer_wakeup(1);
+	for (i = 0; (i < LOG_WRITER_CRASH_WAIT) && log_ring_used(); i++)
+		usleep(1000);
+}
+
+/** Ask the writer thread to close and reopen all log files, eg. after a rehash */
+void log_writer_reopen(void)
+{
+	if (log_running)
+		log_ring_put(NULL, 0, "", 0);
+}
+
+/** Queue a log line for the writer thread.
+ * @param log		The log block
+ * @param text		The complete line, including the newline
+ * @param len		Length of the line
+ * @returns 1 if the line was handled (queued or dropped), 0 if the writer
+ *          is not running and the caller should write the line directly.
+ */
+int log_queue_write(ConfigItem_log *log, const char *text, int len)
+{
+	if (!log_running)
+		return 0;
+	if (log_ring_put(log->file, log->maxsize, text, len))
+		log_queued++;
+	else
+		log_dropped++;
+	return 1;
+}
+
+/** Report dropped log lines and write errors of the writer thread to IRCOps */
+EVENT(log_writer_check)
+{
+	unsigned long errors = __atomic_load_n(&log_write_errors, __ATOMIC_RELAXED);
+
+	if (log_dropped != log_dropped_reported)
+	{
+		sendto_realops("Log queue was full: %lu log line(s) were dropped because the disk can't keep up",
+			log_dropped - log_dropped_reported);
+		log_dropped_reported = log_dropped;
+	}
+	if (errors != log_write_errors_reported)
+	{
+		sendto_realops("WARNING: %lu write(s) to log files failed", errors - log_write_errors_reported);
+		log_write_errors_reported = errors;
+	}
+}
+
+/** Statistics of the log queue, for STATS z.
+ * @returns 1 if the log writer thread is running, 0 if log files are written directly.
+ */
+int log_queue_stats(size_t *size, size_t *used, unsigned long *queued, unsigned long *dropped)
+{
+	*size = LOG_QUEUE_SIZE;
+	*used = log_running ? log_ring_used() : 0;
+	*queued = log_queued;
+	*dropped = log_dropped;
+	return log_running;
+}
+#endif /* LOG_ASYNC */
+
+/** Escape a string for use in a JSON string value */
+static void log_json_escape(char *out, size_t outlen, const char *in, size_t inlen)
+{
+	char *o = out, *end = out + outlen - 7; /* room for \u00xx and nul */
+
+	for (; inlen && (o < end); in++, inlen--)
+	{
+		unsigned char c = *in;
+
+		if ((c == '"') || (c == '\\'))
+		{
+			*o++ = '\\';
+			*o++ = c;
+		} else
+		if (c == '\n')
+		{
+			*o++ = '\\';
+			*o++ = 'n';
+		} else
+		if (c < 32)
+		{
+			o += snprintf(o, 7, "\\u%04x", c);
+		} else
+			*o++ = c;
+	}
+	*o = '\0';
+}
+
+/** Format a log line for a log block, according to log::format.
+ * @param log		The log block
+ * @param flags		The LOG_* flags of the message
+ * @param timebuf	The time prefix of the text format, eg "[Sun Oct 18 ...] - "
+ * @param msg		The message (without newline)
+ * @param msglen	Length of the message
+ * @param out		Buffer for the line (including the newline)
+ * @param outlen	Size of the buffer
+ * @returns Length of the line
+ */
+int log_format_line(ConfigItem_log *log, int flags, const char *timebuf, const char *msg, int msglen, char *out, size_t outlen)
+{
+	int n;
+
+	if (log->format == LOG_FORMAT_JSON)
+	{
+		char escaped[4096], timestr[64];
+		time_t t = TStime();
+
+		strftime(timestr, sizeof(timestr), "%Y-%m-%dT%H:%M:%SZ", gmtime(&t));
+		log_json_escape(escaped, sizeof(escaped), msg, msglen);
+		n = snprintf(out, outlen, "{\"timestamp\":\"%s\",\"server\":\"%s\",\"type\":\"%s\",\"message\":\"%s\"}\n",
+			timestr, me.name, log_type_name(flags & log->flags), escaped);
+	} else {
+		n = snprintf(out, outlen, "%s%.*s\n", timebuf, msglen, msg);
+	}
+	if (n >= (int)outlen)
+	{
+		/* Truncated, but always end with a newline */
+		n = outlen - 1;
+		out[n - 1] = '\n';
+	}
+	return n;
+}
@@ -161,6 +161,225 @@ int match_simple(const char *mask, const char *name)
 	return 0;
 }
 
+/* Compiled glob patterns.
+ * match_simple() and match_esc() interpret the mask again for every
+ * string they are called with. When the same mask is matched against
+ * many strings (a WHO on all users, a spamfilter against every message)
+ * it pays off to split it up once: the mask is cut into segments at
+ * each '*', and each segment is stored lowercased with '?' turned into
+ * GLOB_ANY. Matching is then:
+ * - the first segment must be at the start of the string (unless the
+ *   mask starts with a '*'), the last segment at the end (unless the
+ *   mask ends with a '*'), this rejects most strings immediately,
+ * - the other segments must be found in order, leftmost first,
+ * - strings shorter than the total length of the segments can't match.
+ * The result is the same as match_simple(), including the rule that
+ * '_' in the mask also matches a space.
+ */
+
+#define GLOB_ANY	0x100	/**< Matches any character ('?') */
+
+typedef struct MatchGlobSegment MatchGlobSegment;
+struct MatchGlobSegment {
+	unsigned short *code;	/**< Lowercased characters or GLOB_ANY */
+	int len;
+};
+
+struct MatchGlob {
+	unsigned char anchor_start;	/**< Mask does not start with a '*' */
+	unsigned char anchor_end;	/**< Mask does not end with a '*' */
+	int minlen;			/**< Minimum length of a matching string */
+	int nsegments;
+	MatchGlobSegment *segments;
+	unsigned short *code;		/**< Storage for the segments */
+};
+
+/** Compile a mask for use with match_glob().
+ * @param mask		The mask, with '*' and '?' wildcards
+ * @returns The compiled mask, free it with match_glob_free().
+ */
+MatchGlob *match_glob_compile(const char *mask)
+{
+	MatchGlob *g = safe_alloc(sizeof(MatchGlob));
+	const u_char *m = (const u_char *)mask;
+	MatchGlobSegment *seg = NULL;
+	int len = strlen(mask);
+	int n = 0;
+
+	/* At most one segment per two characters of the mask, plus one */
+	g->segments = safe_alloc(sizeof(MatchGlobSegment) * (len / 2 + 1));
+	g->code = safe_alloc(sizeof(unsigned short) * (len + 1));
+	g->anchor_start = (*m != '*');
+	g->anchor_end = 1;
+
+	for (; *m; m++)
+	{
+		if (*m == '*')
+		{
+			seg = NULL;
+			g->anchor_end = 0;
+			continue;
+		}
+		g->anchor_end = 1;
+		if (!seg)
+		{
+			seg = &g->segments[g->nsegments++];
+			seg->code = &g->code[n];
+		}
+		if (*m == '?')
+			g->code[n++] = GLOB_ANY;
+		else
+			g->code[n++] = lc(*m);
+		seg->len++;
+		g->minlen++;
+	}
+
+	return g;
+}
+
+/** Free a compiled mask from match_glob_compile() */
+void match_glob_free(MatchGlob *g)
+{
+	if (!g)
+		return;
+	safe_free(g->segments);
+	safe_free(g->code);
+	safe_free(g);
+}
+
+/** Check if a character from the mask matches character 'n' */
+#define glob_char_match(c, n)	(((c) == GLOB_ANY) || ((c) == lc(n)) || (((c) == '_') && ((n) == ' ')))
+
+/** Check a segment against the string at 'n' (which has at least seg->len characters) */
+static inline int match_glob_segment(const MatchGlobSegment *seg, const u_char *n)
+{
+	int i;
+
+	for (i = 0; i < seg->len; i++)
+		if (!glob_char_match(seg->code[i], n[i]))
+			return 0;
+	return 1;
+}
+
+/** Match a string against a compiled mask.
+ * @param g		The compiled mask from match_glob_compile()
+ * @param name		The string to match against
+ * @returns 1 on match and 0 for no match (like match_simple())
+ */
+int match_glob(const MatchGlob *g, const char *name)
+{
+	const u_char *p = (const u_char *)name;
+	const u_char *end;
+	const MatchGlobSegment *seg;
+	int len, first, last, i;
+
+	if (g->nsegments == 0)
+		return g->anchor_start ? (*name == '\0') : 1; /* empty mask or only '*' */
+
+	first = 0;
+	last = g->nsegments - 1;
+
+	/* Check the prefix before doing anything else, most strings fail here.
+	 * The \0 is checked explicitly, as GLOB_ANY would match it.
+	 */
+	if (g->anchor_start)
+	{
+		seg = &g->segments[0];
+		for (i = 0; i < seg->len; i++)
+			if (!p[i] || !glob_char_match(seg->code[i], p[i]))
+				return 0;
+		if ((g->nsegments == 1) && g->anchor_end)
+			return p[i] == '\0'; /* no wildcard '*' at all */
+		p += seg->len;
+		first = 1;
+	}
+
+	len = strlen((const char *)p);
+	if (len < g->minlen - (first ? g->segments[0].len : 0))
+		return 0;
+	end = p + len;
+
+	if (g->anchor_end)
+	{
+		seg = &g->segments[last];
+		if ((end - seg->len < p) || !match_glob_segment(seg, end - seg->len))
+			return 0;
+		end -= seg->len;
+		last--;
+	}
+
+	/* Find the remaining segments in order */
+	for (i = first; i <= last; i++)
+	{
+		unsigned short c;
+
+		seg = &g->segments[i];
+		c = seg->code[0];
+		for (; p + seg->len <= end; p++)
+			if (glob_char_match(c, *p) && match_glob_segment(seg, p))
+				break;
+		if (p + seg->len > end)
+			return 0;
+		p += seg->len;
+	}
+
+	return 1;
+}
+
+/* PCRE2 state shared by all regexes (spamfilter and badwords).
+ * Creating and freeing match data around every match is a waste, and
+ * without a match context JIT code runs on a small default stack.
+ * The ircd is single threaded so one of each is enough. The match data
+ * is grown to the highest capture count when a regex is compiled.
+ */
+static pcre2_match_data *regex_match_data = NULL;
+static uint32_t regex_match_data_pairs = 0;
+static pcre2_match_context *regex_match_context = NULL;
+static pcre2_jit_stack *regex_jit_stack = NULL;
+
+#define REGEX_JIT_STACK_START	(32*1024)
+#define REGEX_JIT_STACK_MAX	(512*1024)
+
+/** Prepare a freshly compiled regex for use with unreal_regex_run().
+ * This JIT compiles it and makes sure the shared match data is big enough.
+ * @returns 1 if the regex is JIT compiled, 0 if not.
+ */
+static int unreal_regex_prepare(pcre2_code *re)
+{
+	uint32_t captures = 0;
+
+	pcre2_pattern_info(re, PCRE2_INFO_CAPTURECOUNT, &captures);
+	if (!regex_match_data || (captures + 1 > regex_match_data_pairs))
+	{
+		if (regex_match_data)
+			pcre2_match_data_free(regex_match_data);
+		regex_match_data_pairs = MAX(captures + 1, 10);
+		regex_match_data = pcre2_match_data_create(regex_match_data_pairs, NULL);
+	}
+
+	if (!regex_match_context)
+	{
+		regex_match_context = pcre2_match_context_create(NULL);
+		regex_jit_stack = pcre2_jit_stack_create(REGEX_JIT_STACK_START, REGEX_JIT_STACK_MAX, NULL);
+		if (regex_jit_stack) /* NULL if PCRE2 was built without JIT support */
+			pcre2_jit_stack_assign(regex_match_context, NULL, regex_jit_stack);
+	}
+
+	return (pcre2_jit_compile(re, PCRE2_JIT_COMPLETE) == 0) ? 1 : 0;
+}
+
+/** Run a regex that was prepared with unreal_regex_prepare().
+ * @returns The pcre2_match() return value, so >0 for a match.
+ *          The offsets are in regex_match_data afterwards.
+ */
+static inline int unreal_regex_run(pcre2_code *re, int jit, const char *str)
+{
+	/* Unlike pcre2_match(), pcre2_jit_match() does not support PCRE2_ZERO_TERMINATED */
+	if (jit)
+		return pcre2_jit_match(re, str, strlen(str), 0, 0, regex_match_data, regex_match_context);
+	return pcre2_match(re, str, PCRE2_ZERO_TERMINATED, 0, 0, regex_match_data, regex_match_context);
+}
+
 /*
  * collapse a pattern string into minimal components.
  * This particular version is "in place", so that it changes the pattern
@@ -376,7 +595,11 @@ u_char char_atribs[] = {
 void unreal_delete_match(Match *m)
 {
 	safe_free(m->str);
-	if (m->type == MATCH_PCRE_REGEX)
+	if (m->type == MATCH_SIMPLE)
+	{
+		match_glob_free(m->ext.glob);
+	}
+	else if (m->type == MATCH_PCRE_REGEX)
 	{
 		if (m->ext.pcre2_expr)
 			pcre2_code_free(m->ext.pcre2_expr);
@@ -396,7 +619,7 @@ Match *unreal_create_match(MatchType type, char *str, char **error)
 	
 	if (m->type == MATCH_SIMPLE)
 	{
-		/* Nothing to do */
+		m->ext.glob = match_glob_compile(str);
 	}
 	else if (m->type == MATCH_PCRE_REGEX)
 	{
@@ -423,7 +646,7 @@ Match *unreal_create_match(MatchType type, char *str, char **error)
 			unreal_delete_match(m);
 			return NULL;
 		}
-		pcre2_jit_compile(m->ext.pcre2_expr, PCRE2_JIT_COMPLETE);
+		m->jit = unreal_regex_prepare(m->ext.pcre2_expr);
 		return m;
 	}
 	else {
@@ -440,23 +663,35 @@ Match *unreal_create_match(MatchType type, char *str, char **error)
  */
 int unreal_match(Match *m, char *str)
 {
+	m->checks++;
+
 	if (m->type == MATCH_SIMPLE)
 	{
-		if (match_simple(m->str, str))
+		if (m->ext.glob ? match_glob(m->ext.glob, str) : match_simple(m->str, str))
+		{
+			m->hits++;
 			return 1;
+		}
 		return 0;
 	}
 	
 	if (m->type == MATCH_PCRE_REGEX)
 	{
-		pcre2_match_data *md = pcre2_match_data_create(9, NULL);
+		struct timeval tv_alpha, tv_beta;
 		int ret;
 		
-		ret = pcre2_match(m->ext.pcre2_expr, str, PCRE2_ZERO_TERMINATED, 0, 0, md, NULL); /* run the regex */
-		pcre2_match_data_free(md); /* yeah, we never use it. unfortunately argument must be non-NULL for pcre2_match() */
-		
+		gettimeofday(&tv_alpha, NULL);
+		ret = unreal_regex_run(m->ext.pcre2_expr, m->jit, str);
+		gettimeofday(&tv_beta, NULL);
+
+		m->last_usec = ((tv_beta.tv_sec - tv_alpha.tv_sec) * 1000000) + (tv_beta.tv_usec - tv_alpha.tv_usec);
+		m->usec += m->last_usec;
+
 		if (ret > 0)
-			return 1; /* MATCH */		
+		{
+			m->hits++;
+			return 1; /* MATCH */
+		}
 		return 0; /* NO MATCH */
 	}
 
@@ -612,24 +847,402 @@ int fast_badword_replace(ConfigItem_badword *badword, char *line, char *buf, int
 	return cleaned;
 }
 
+/* Word filters.
+ * A word filter holds a list of plain words (the fast badwords, or the
+ * ~T:censor textbans of a channel) and finds all of them in a single
+ * pass over the text, instead of doing one our_strcasestr() per word.
+ * The words are compiled into an Aho-Corasick automaton on first use.
+ * Words never contain separators (see iswseperator()), so every hit
+ * lies within one word of the text. That word is then replaced as a
+ * whole, or causes the text to be blocked, exactly like
+ * fast_badword_replace() and fast_badword_match() decide it:
+ * - "word" only matches the word itself,
+ * - "*word" (BADW_TYPE_FAST_L) also words ending in it,
+ * - "word*" (BADW_TYPE_FAST_R) also words starting with it,
+ * - "*word*" any word containing it.
+ * If several entries match the same word of the text, the one that
+ * was added first wins.
+ * Entries that do contain separators (only possible in ~T:censor) are
+ * rare, these are applied one by one afterwards, the old way.
+ */
+
+typedef struct WordFilterWord WordFilterWord;
+struct WordFilterWord {
+	char *word;		/**< The word, without asterisks */
+	int len;
+	int type;		/**< BADW_TYPE_FAST_L and/or BADW_TYPE_FAST_R */
+	int action;		/**< BADWORD_REPLACE or BADWORD_BLOCK */
+	char *replace;		/**< Replacement, NULL for REPLACEWORD */
+	int slow;		/**< Contains a separator, so not in the automaton */
+	int next;		/**< Next word ending in the same state, or -1 */
+};
+
+struct WordFilter {
+	WordFilterWord *words;
+	int nwords;
+	int maxwords;
+	/* The automaton, see wordfilter_build() */
+	int built;
+	unsigned char class[256];	/**< Character class, 0 is for characters not in any word */
+	int nclasses;
+	int nstates;
+	int *next;		/**< Transitions, nclasses per state, state 0 is the root */
+	int *first;		/**< First word ending in this state, or -1 */
+	int *dict;		/**< Nearest state on the failure path that has words, or 0 */
+};
+
+/** Create an empty word filter */
+WordFilter *wordfilter_create(void)
+{
+	return safe_alloc(sizeof(WordFilter));
+}
+
+/** Add a word to a word filter.
+ * @param wf		The word filter
+ * @param word		The word, without asterisks
+ * @param type		BADW_TYPE_FAST_L and/or BADW_TYPE_FAST_R, or 0
+ * @param action	BADWORD_REPLACE or BADWORD_BLOCK
+ * @param replace	The replacement text, or NULL for REPLACEWORD
+ */
+void wordfilter_add(WordFilter *wf, const char *word, int type, int action, const char *replace)
+{
+	WordFilterWord *w;
+
+	if (!*word)
+		return; /* would match everything */
+
+	if (wf->nwords == wf->maxwords)
+	{
+		WordFilterWord *words;
+		wf->maxwords = wf->maxwords ? wf->maxwords * 2 : 16;
+		words = safe_alloc(sizeof(WordFilterWord) * wf->maxwords);
+		if (wf->nwords)
+			memcpy(words, wf->words, sizeof(WordFilterWord) * wf->nwords);
+		safe_free(wf->words);
+		wf->words = words;
+	}
+	w = &wf->words[wf->nwords++];
+	safe_strdup(w->word, word);
+	w->len = strlen(word);
+	w->type = type & (BADW_TYPE_FAST_L|BADW_TYPE_FAST_R);
+	w->action = action;
+	safe_strdup(w->replace, replace);
+	w->next = -1;
+	for (; *word; word++)
+		if (iswseperator(*word))
+			w->slow = 1;
+	wf->built = 0;
+}
+
+/** Number of words in a word filter */
+int wordfilter_count(WordFilter *wf)
+{
+	return wf ? wf->nwords : 0;
+}
+
+static void wordfilter_free_automaton(WordFilter *wf)
+{
+	safe_free(wf->next);
+	safe_free(wf->first);
+	safe_free(wf->dict);
+	wf->built = 0;
+}
+
+/** Free a word filter */
+void wordfilter_free(WordFilter *wf)
+{
+	int i;
+
+	if (!wf)
+		return;
+	for (i = 0; i < wf->nwords; i++)
+	{
+		safe_free(wf->words[i].word);
+		safe_free(wf->words[i].replace);
+	}
+	safe_free(wf->words);
+	wordfilter_free_automaton(wf);
+	safe_free(wf);
+}
+
+/** Compile the words into an automaton.
+ * Characters are mapped to a small number of classes first, with
+ * upper and lower case sharing a class, so the transition table
+ * only needs a column for the characters that occur in the words.
+ */
+static void wordfilter_build(WordFilter *wf)
+{
+	int maxstates = 1;
+	int *fail, *queue;
+	int nc, qhead = 0, qtail = 0;
+	int i, c, r, s;
+	const u_char *p;
+
+	wordfilter_free_automaton(wf);
+	memset(wf->class, 0, sizeof(wf->class));
+	wf->nclasses = 1;
+	for (i = 0; i < wf->nwords; i++)
+	{
+		if (wf->words[i].slow)
+			continue;
+		for (p = (u_char *)wf->words[i].word; *p; p++)
+		{
+			c = tolower(*p);
+			if (!wf->class[c])
+			{
+				wf->class[c] = wf->nclasses;
+				wf->class[toupper(c)] = wf->nclasses;
+				wf->nclasses++;
+			}
+		}
+		maxstates += wf->words[i].len;
+	}
+	nc = wf->nclasses;
+
+	/* Zero means 'no transition' while building the trie,
+	 * this is fine since nothing goes back to the root there.
+	 */
+	wf->next = safe_alloc(sizeof(int) * maxstates * nc);
+	wf->first = safe_alloc(sizeof(int) * maxstates);
+	wf->dict = safe_alloc(sizeof(int) * maxstates);
+	fail = safe_alloc(sizeof(int) * maxstates);
+	queue = safe_alloc(sizeof(int) * maxstates);
+	for (s = 0; s < maxstates; s++)
+		wf->first[s] = -1;
+	wf->nstates = 1;
+
+	/* The trie */
+	for (i = 0; i < wf->nwords; i++)
+	{
+		int *w;
+
+		if (wf->words[i].slow)
+			continue;
+		s = 0;
+		for (p = (u_char *)wf->words[i].word; *p; p++)
+		{
+			int *t = &wf->next[s * nc + wf->class[*p]];
+			if (!*t)
+				*t = wf->nstates++;
+			s = *t;
+		}
+		/* Append, so the words of a state stay in the order they were added */
+		for (w = &wf->first[s]; *w != -1; w = &wf->words[*w].next);
+		*w = i;
+	}
+
+	/* Failure links, breadth first, and fill in the missing transitions */
+	for (c = 1; c < nc; c++)
+		if ((s = wf->next[c]))
+			queue[qtail++] = s;
+	while (qhead < qtail)
+	{
+		r = queue[qhead++];
+		wf->dict[r] = (wf->first[fail[r]] != -1) ? fail[r] : wf->dict[fail[r]];
+		for (c = 1; c < nc; c++)
+		{
+			s = wf->next[r * nc + c];
+			if (s)
+			{
+				fail[s] = wf->next[fail[r] * nc + c];
+				queue[qtail++] = s;
+			} else {
+				wf->next[r * nc + c] = wf->next[fail[r] * nc + c];
+			}
+		}
+	}
+
+	safe_free(fail);
+	safe_free(queue);
+	wf->built = 1;
+}
+
+/** Append to the output of wordfilter_run(), cutting off at the end of the buffer */
+static inline char *wordfilter_append(char *o, const char *eob, const char *str, int len)
+{
+	if (len > eob - o)
+		len = eob - o;
+	memcpy(o, str, len);
+	return o + len;
+}
+
+/** Apply a word that contains separators, using fast_badword_match() or fast_badword_replace() */
+static int wordfilter_run_slow(WordFilterWord *e, char *buf, int max, int *blocked)
+{
+	ConfigItem_badword bw;
+	char *tmp;
+	int n;
+
+	memset(&bw, 0, sizeof(bw));
+	bw.word = e->word;
+	bw.replace = e->replace;
+	bw.type = BADW_TYPE_FAST | e->type;
+
+	if (e->action == BADWORD_BLOCK)
+	{
+		if (fast_badword_match(&bw, buf))
+		{
+			*blocked = 1;
+			*buf = '\0';
+			return 1;
+		}
+		return 0;
+	}
+
+	tmp = safe_alloc(max);
+	n = fast_badword_replace(&bw, buf, tmp, max);
+	if (n)
+		strlcpy(buf, tmp, max);
+	safe_free(tmp);
+	return n;
+}
+
+/** Run a word filter on a line of text.
+ * @param wf		The word filter
+ * @param line		The text
+ * @param buf		Buffer for the resulting text
+ * @param max		Size of the buffer
+ * @param blocked	Set to 1 if a BADWORD_BLOCK word matched, 0 otherwise
+ * @returns 1 if any word was replaced, 0 if not.
+ * @note If blocked is set then the contents of 'buf' is undefined.
+ */
+int wordfilter_run(WordFilter *wf, const char *line, char *buf, int max, int *blocked)
+{
+	const u_char *p = (const u_char *)line;
+	const u_char *wordstart = p;
+	char *o = buf;
+	const char *eob = buf + max - 1;
+	int state = 0, best = -1, cleaned = 0;
+	int t, w;
+
+	*blocked = 0;
+
+	if (!wf->built)
+		wordfilter_build(wf);
+
+	for (;; p++)
+	{
+		if (*p && !iswseperator(*p))
+		{
+			state = wf->next[state * wf->nclasses + wf->class[*p]];
+			/* Entries that may be followed by more characters (word* and
+			 * *word*) can be checked right away, the others only at
+			 * the end of the word.
+			 */
+			for (t = (wf->first[state] != -1) ? state : wf->dict[state]; t; t = wf->dict[t])
+			{
+				for (w = wf->first[t]; w != -1; w = wf->words[w].next)
+				{
+					WordFilterWord *e = &wf->words[w];
+					if ((e->type & BADW_TYPE_FAST_R) &&
+					    ((e->type & BADW_TYPE_FAST_L) || (p + 1 - e->len == wordstart)) &&
+					    ((best == -1) || (w < best)))
+					{
+						best = w;
+					}
+				}
+			}
+			continue;
+		}
+
+		/* End of a word of the text, or of the text itself */
+		if (p > wordstart)
+		{
+			for (t = (wf->first[state] != -1) ? state : wf->dict[state]; t; t = wf->dict[t])
+			{
+				for (w = wf->first[t]; w != -1; w = wf->words[w].next)
+				{
+					WordFilterWord *e = &wf->words[w];
+					if (!(e->type & BADW_TYPE_FAST_R) &&
+					    ((e->type & BADW_TYPE_FAST_L) || (p - e->len == wordstart)) &&
+					    ((best == -1) || (w < best)))
+					{
+						best = w;
+					}
+				}
+			}
+
+			if (best == -1)
+			{
+				o = wordfilter_append(o, eob, (const char *)wordstart, p - wordstart);
+			} else
+			if (wf->words[best].action == BADWORD_BLOCK)
+			{
+				*blocked = 1;
+				*buf = '\0';
+				return cleaned;
+			} else
+			{
+				const char *replace = wf->words[best].replace ? wf->words[best].replace : REPLACEWORD;
+				o = wordfilter_append(o, eob, replace, strlen(replace));
+				cleaned = 1;
+			}
+		}
+
+		if (!*p)
+			break;
+
+		o = wordfilter_append(o, eob, (const char *)p, 1);
+		wordstart = p + 1;
+		state = 0;
+		best = -1;
+	}
+
+	*o = '\0';
+
+	for (w = 0; w < wf->nwords; w++)
+	{
+		if (wf->words[w].slow && wordfilter_run_slow(&wf->words[w], buf, max, blocked))
+		{
+			if (*blocked)
+				return cleaned;
+			cleaned = 1;
+		}
+	}
+
+	return cleaned;
+}
+
+/** Compile the fast (non-regex) badwords of a list into a word filter */
+static WordFilter *badword_filter_build(ConfigItem_badword *start_bw)
+{
+	WordFilter *wf = wordfilter_create();
+	ConfigItem_badword *bw;
+
+	for (bw = start_bw; bw; bw = bw->next)
+		if (bw->type & BADW_TYPE_FAST)
+			wordfilter_add(wf, bw->word, bw->type, bw->action, bw->replace);
+	return wf;
+}
+
 /*
  * Returns a string, which has been filtered by the words loaded via
  * the loadbadwords() function.  It's primary use is to filter swearing
  * in both private and public messages
  */
-char *stripbadwords(char *str, ConfigItem_badword *start_bw, int *blocked)
+char *stripbadwords(char *str, ConfigItem_badword *start_bw, WordFilter **filter, int *blocked)
 {
 	static char cleanstr[4096];
 	char buf[4096];
 	char *ptr;
 	int matchlen, m, stringlen, cleaned;
 	ConfigItem_badword *this_word;
+	WordFilter *wf;
 
 	*blocked = 0;
 
 	if (!start_bw)
 		return str;
 
+	/* The compiled fast badwords are cached in 'filter', if we have one */
+	wf = filter ? *filter : NULL;
+	if (!wf)
+	{
+		wf = badword_filter_build(start_bw);
+		if (filter)
+			*filter = wf;
+	}
+
 	/*
 	 * work on a copy
 	 */
@@ -638,39 +1251,28 @@ char *stripbadwords(char *str, ConfigItem_badword *start_bw, int *blocked)
 	buf[0] = '\0';
 	cleaned = 0;
 
+	/* First all the fast badwords at once.. */
+	if (wordfilter_count(wf))
+	{
+		/* 512 is enough here, see the cutoff at the end */
+		cleaned = wordfilter_run(wf, cleanstr, buf, 512, blocked);
+		if (!*blocked)
+			strcpy(cleanstr, buf);
+		memset(buf, 0, sizeof(buf)); /* regexp likes this somehow */
+	}
+	if (!filter)
+		wordfilter_free(wf);
+	if (*blocked)
+		return NULL;
+
+	/* ..then the regexes, one by one */
 	for (this_word = start_bw; this_word; this_word = this_word->next)
 	{
-		if (this_word->type & BADW_TYPE_FAST)
-		{
-			if (this_word->action == BADWORD_BLOCK)
-			{
-				if (fast_badword_match(this_word, cleanstr))
-				{
-					*blocked = 1;
-					return NULL;
-				}
-			}
-			else
-			{
-				int n;
-				/* fast_badword_replace() does size checking so we can use 512 here instead of 4096 */
-				n = fast_badword_replace(this_word, cleanstr, buf, 512);
-				if (!cleaned && n)
-					cleaned = n;
-				strcpy(cleanstr, buf);
-				memset(buf, 0, sizeof(buf)); /* regexp likes this somehow */
-			}
-		} else
 		if (this_word->type & BADW_TYPE_REGEX)
 		{
 			if (this_word->action == BADWORD_BLOCK)
 			{
-				pcre2_match_data *md = pcre2_match_data_create(9, NULL);
-				int ret;
-
-				ret = pcre2_match(this_word->pcre2_expr, cleanstr, PCRE2_ZERO_TERMINATED, 0, 0, md, NULL); /* run the regex */
-				pcre2_match_data_free(md); /* yeah, we never use it. unfortunately argument must be non-NULL for pcre2_match() */
-				if (ret > 0)
+				if (unreal_regex_run(this_word->pcre2_expr, this_word->jit, cleanstr) > 0)
 				{
 					*blocked = 1;
 					return NULL;
@@ -678,22 +1280,16 @@ char *stripbadwords(char *str, ConfigItem_badword *start_bw, int *blocked)
 			}
 			else
 			{
-				pcre2_match_data *md;
 				int ret;
 				PCRE2_SIZE *dd;
 				int start, end;
 
 				ptr = cleanstr; /* set pointer to start of string */
 				while(1) {
-					md = pcre2_match_data_create(9, NULL);
-					/* ^^ we need to free 'md' in ALL circumstances.
-					 * remember this if you break or continue in this loop!
-					 */
-					ret = pcre2_match(this_word->pcre2_expr, ptr, PCRE2_ZERO_TERMINATED, 0, 0, md, NULL); /* run the regex */
+					ret = unreal_regex_run(this_word->pcre2_expr, this_word->jit, ptr);
 					if (ret > 0)
 					{
-						ircd_log(LOG_ERROR, "pcre2_get_ovector_count: %d", pcre2_get_ovector_count(md));
-						dd = pcre2_get_ovector_pointer(md);
+						dd = pcre2_get_ovector_pointer(regex_match_data);
 						start = (int)dd[0];
 						end = (int)dd[1];
 						if ((start < 0) || (end < 0) || (start > strlen(ptr)) || (end > strlen(ptr)+1))
@@ -704,10 +1300,7 @@ char *stripbadwords(char *str, ConfigItem_badword *start_bw, int *blocked)
 						}
 						m = end - start;
 						if (m == 0)
-						{
-							pcre2_match_data_free(md);
 							break; /* anti-loop */
-						}
 						cleaned = 1;
 						matchlen += m;
 						strlncat(buf, ptr, sizeof buf, start);
@@ -716,10 +1309,8 @@ char *stripbadwords(char *str, ConfigItem_badword *start_bw, int *blocked)
 						else
 							strlcat(buf, REPLACEWORD, sizeof buf);
 						ptr += end; /* Set pointer after the match pos */
-						pcre2_match_data_free(md);
 						continue; /* next! */
 					}
-					pcre2_match_data_free(md);
 					break; /* NOMATCH: we are done! */
 				}
 				/* All the better to eat you with! */
@@ -830,7 +1421,7 @@ int badword_config_process(ConfigItem_badword *ca, char *str)
 			config_error("badword_config_process(): failed to compile regex '%s', this is impossible!", str);
 			abort();
 		}
-		pcre2_jit_compile(ca->pcre2_expr, PCRE2_JIT_COMPLETE);
+		ca->jit = unreal_regex_prepare(ca->pcre2_expr);
 	}
 	else
 	{
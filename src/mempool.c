@@ -54,7 +54,7 @@ void mp_pool_init(void)
 {
 }
 
-mp_pool_t *mp_pool_new(size_t sz, size_t ignored)
+mp_pool_t *mp_pool_new(size_t sz, size_t ignored, const char *name)
 {
     mp_pool_t *m = safe_alloc(sizeof(mp_pool_t));
     /* We (mis)use the item_alloc_size. It has a slightly different
@@ -62,6 +62,7 @@ mp_pool_t *mp_pool_new(size_t sz, size_t ignored)
      * That is something we don't want as it would hide small overflows.
      */
     m->item_alloc_size = sz;
+    m->name = name;
     return m;
 }
 
@@ -74,6 +75,12 @@ void mp_pool_release(void *item)
 {
     safe_free(item);
 }
+
+/* No statistics available, since all items are malloc'ed individually */
+int mp_pool_stats(int n, mp_pool_stats_t *st)
+{
+    return 0;
+}
 #else
 
 /** Returns floor(log2(u64)).  If u64 is 0, (incorrectly) returns 0. */
@@ -449,7 +456,7 @@ mp_pool_release(void *item)
 /** Allocate a new memory pool to hold items of size <b>item_size</b>. We'll
  * try to fit about <b>chunk_capacity</b> bytes in each chunk. */
 mp_pool_t *
-mp_pool_new(size_t item_size, size_t chunk_capacity)
+mp_pool_new(size_t item_size, size_t chunk_capacity, const char *name)
 {
   mp_pool_t *pool;
   size_t alloc_size, new_chunk_cap;
@@ -502,6 +509,7 @@ mp_pool_new(size_t item_size, size_t chunk_capacity)
   pool->new_chunk_capacity = (int)new_chunk_cap;
 
   pool->item_alloc_size = alloc_size;
+  pool->name = name;
 
   pool->next = mp_allocated_pools;
   mp_allocated_pools = pool;
@@ -676,6 +684,39 @@ mp_pool_assert_ok(mp_pool_t *pool)
   assert(pool->n_empty_chunks == n_empty);
 }
 
+/** Helper: add the usage of a list of chunks to <b>st</b>. */
+static void
+mp_chunks_stats(mp_chunk_t *chunk, mp_pool_stats_t *st)
+{
+  for (; chunk; chunk = chunk->next) {
+    st->n_chunks++;
+    st->items_used += chunk->n_allocated;
+    st->items_capacity += chunk->capacity;
+    st->bytes_allocated += CHUNK_OVERHEAD + chunk->mem_size;
+  }
+}
+
+/** Fill <b>st</b> with the usage of the <b>n</b>'th memory pool.
+ * Returns 0 if there is no such pool. */
+int
+mp_pool_stats(int n, mp_pool_stats_t *st)
+{
+  mp_pool_t *pool;
+
+  for (pool = mp_allocated_pools; pool && n; pool = pool->next)
+    n--;
+  if (!pool)
+    return 0;
+
+  memset(st, 0, sizeof(mp_pool_stats_t));
+  st->name = pool->name;
+  st->item_size = pool->item_alloc_size;
+  mp_chunks_stats(pool->empty_chunks, st);
+  mp_chunks_stats(pool->used_chunks, st);
+  mp_chunks_stats(pool->full_chunks, st);
+  return 1;
+}
+
 void
 mp_pool_garbage_collect(void *arg)
 {
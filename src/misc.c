@@ -111,10 +111,10 @@ void ircd_log(int flags, FORMAT_STRING(const char *format), ...)
 
 	va_list ap;
 	ConfigItem_log *logs;
-	char buf[2048], timebuf[128];
+	char buf[2048], timebuf[128], line[4096];
 	struct stat fstats;
 	int written = 0;
-	int n;
+	int n, msglen, linelen;
 
 	/* Trap infinite recursions to avoid crash if log file is unavailable,
 	 * this will also avoid calling ircd_log from anything else called
@@ -134,6 +134,7 @@ void ircd_log(int flags, FORMAT_STRING(const char *format), ...)
 	snprintf(timebuf, sizeof(timebuf), "[%s] - ", myctime(TStime()));
 
 	RunHook3(HOOKTYPE_LOG, flags, timebuf, buf);
+	msglen = strlen(buf);
 	strlcat(buf, "\n", sizeof(buf));
 
 	if (!loop.ircd_forked && (flags & LOG_ERROR))
@@ -156,6 +157,15 @@ void ircd_log(int flags, FORMAT_STRING(const char *format), ...)
 #endif
 		if (logs->flags & flags)
 		{
+			linelen = log_format_line(logs, flags, timebuf, buf, msglen, line, sizeof(line));
+#ifdef LOG_ASYNC
+			/* Normally the log writer thread does the rest */
+			if (log_queue_write(logs, line, linelen))
+			{
+				written++;
+				continue;
+			}
+#endif
 			if (stat(logs->file, &fstats) != -1 && logs->maxsize && fstats.st_size >= logs->maxsize)
 			{
 				char oldlog[512];
@@ -212,13 +222,8 @@ void ircd_log(int flags, FORMAT_STRING(const char *format), ...)
 			/* this shouldn't happen, but lets not waste unnecessary syscalls... */
 			if (logs->logfd == -1)
 				continue;
-			if (write(logs->logfd, timebuf, strlen(timebuf)) < 0)
-			{
-				/* Let's ignore any write errors for this one. Next write() will catch it... */
-				;
-			}
-			n = write(logs->logfd, buf, strlen(buf));
-			if (n == strlen(buf))
+			n = write(logs->logfd, line, linelen);
+			if (n == linelen)
 			{
 				written++;
 			}
@@ -1407,6 +1412,106 @@ MessageTag *find_mtag(MessageTag *mtags, const char *token)
 	return NULL;
 }
 
+/* Message tags are created and destroyed for nearly every message.
+ * While parse() processes a command, new_mtag() hands them out from
+ * a simple bump allocator (the tag, name and value in one piece) that
+ * is reset in one go when parse() is done, see mtag_arena_end().
+ */
+#define MTAG_ARENA_BLOCK_SIZE	8192
+
+typedef struct MTagArenaBlock MTagArenaBlock;
+struct MTagArenaBlock {
+	MTagArenaBlock *next;
+	size_t size;
+	size_t used;
+	char data[1];
+};
+
+static MTagArenaBlock *mtag_arena = NULL; /**< Current block, previous blocks follow via ->next */
+static int mtag_arena_active = 0;
+
+/** Start using the message tag arena for new_mtag() */
+void mtag_arena_begin(void)
+{
+	mtag_arena_active++;
+}
+
+/** Stop using the message tag arena and release everything in it.
+ * Only the first block is kept for the next command.
+ */
+void mtag_arena_end(void)
+{
+	MTagArenaBlock *b;
+
+	if (--mtag_arena_active > 0)
+		return;
+
+	mtag_arena_active = 0;
+	if (!mtag_arena)
+		return;
+	while (mtag_arena->next)
+	{
+		b = mtag_arena;
+		mtag_arena = b->next;
+		safe_free(b);
+	}
+	mtag_arena->used = 0;
+}
+
+static void *mtag_arena_alloc(size_t size)
+{
+	MTagArenaBlock *b;
+	void *p;
+
+	size = (size + sizeof(void *) - 1) & ~(sizeof(void *) - 1);
+	if (!mtag_arena || (mtag_arena->used + size > mtag_arena->size))
+	{
+		size_t blocksize = MAX(size, MTAG_ARENA_BLOCK_SIZE);
+		b = safe_alloc(sizeof(MTagArenaBlock) + blocksize);
+		b->size = blocksize;
+		b->next = mtag_arena;
+		mtag_arena = b;
+	}
+	p = mtag_arena->data + mtag_arena->used;
+	mtag_arena->used += size;
+	return p;
+}
+
+/** Create a new message tag.
+ * During command processing the tag is allocated from the per-command
+ * arena, otherwise from the heap. Either way it is released with
+ * free_message_tags(). Don't modify the name or value afterwards.
+ * @param name	Name of the message tag
+ * @param value	Value of the message tag, or NULL
+ */
+MessageTag *new_mtag(const char *name, const char *value)
+{
+	MessageTag *m;
+	size_t namelen, valuelen;
+
+	if (!mtag_arena_active)
+	{
+		m = safe_alloc(sizeof(MessageTag));
+		safe_strdup(m->name, name);
+		safe_strdup(m->value, value);
+		return m;
+	}
+
+	namelen = strlen(name) + 1;
+	valuelen = value ? strlen(value) + 1 : 0;
+	m = mtag_arena_alloc(sizeof(MessageTag) + namelen + valuelen);
+	memset(m, 0, sizeof(MessageTag));
+	m->flags = MTAG_FLAG_ARENA;
+	m->name = (char *)(m + 1);
+	memcpy(m->name, name, namelen);
+	if (value)
+	{
+		m->value = m->name + namelen;
+		memcpy(m->value, value, valuelen);
+	}
+	return m;
+}
+
 /** Free all message tags in the list 'm' */
 void free_message_tags(MessageTag *m)
 {
@@ -1415,6 +1520,8 @@ void free_message_tags(MessageTag *m)
 	for (; m; m = m_next)
 	{
 		m_next = m->next;
+		if (m->flags & MTAG_FLAG_ARENA)
+			continue; /* freed by mtag_arena_end() */
 		safe_free(m->name);
 		safe_free(m->value);
 		safe_free(m);
@@ -1422,6 +1529,8 @@ void free_message_tags(MessageTag *m)
 }
 
 /** Duplicate a MessageTag structure.
+ * The copy is always allocated from the heap, so this can also be
+ * used to keep a tag from new_mtag() after the command is done.
  * @note  This duplicate a single MessageTag.
  *        It does not duplicate an entire linked list.
  */
@@ -1770,6 +1879,78 @@ int read_str(FILE *fd, char **x)
 	return 1;
 }
 
+/** Flush a file to disk, to be called before fclose() and rename().
+ * @param fd   File descriptor
+ * @returns 1 on success, 0 on failure.
+ */
+int sync_file(FILE *fd)
+{
+	if (fflush(fd) != 0)
+		return 0;
+#ifndef _WIN32
+	if (fsync(fileno(fd)) < 0)
+		return 0;
+#else
+	if (_commit(_fileno(fd)) < 0)
+		return 0;
+#endif
+	return 1;
+}
+
+/** Run a function that writes a database in the background.
+ * On *NIX this forks and calls writefunc() in the child process,
+ * which works on a copy-on-write snapshot of our memory, so the
+ * main loop is not blocked by the serialization and the disk I/O.
+ * If forking is not possible (Windows, or fork() failed)
+ * then writefunc() is simply called directly.
+ * @param writefunc  The function, which should return 1 on success and 0 on failure.
+ *                   In the child it should only write the file: no network I/O,
+ *                   no changes to the state of the ircd (they will be lost anyway).
+ * @returns The process id of the child (>0), 0 if writefunc() was called
+ *          directly and succeeded, or -1 if it was called directly and failed.
+ * @note Use background_write_done() later to collect the result.
+ */
+int background_write_start(int (*writefunc)(void))
+{
+#ifndef _WIN32
+	pid_t pid = fork();
+
+	if (pid == 0)
+	{
+		/* Child. _exit() so no atexit handlers or stdio buffers of
+		 * the parent are run or flushed.
+		 */
+		_exit(writefunc() ? 0 : 1);
+	}
+	if (pid > 0)
+		return pid;
+	ircd_log(LOG_ERROR, "fork() failed: %s -- writing database in the foreground", strerror(errno));
+#endif
+	return writefunc() ? 0 : -1;
+}
+
+/** Check if a background writer started by background_write_start() has finished.
+ * @param pid    The process id returned by background_write_start()
+ * @param block  Wait for the writer to finish (1) or not (0)
+ * @returns 0 if the writer is still running, 1 if it finished successfully
+ *          and -1 if it failed.
+ */
+int background_write_done(int pid, int block)
+{
+#ifndef _WIN32
+	int status;
+	pid_t ret = waitpid(pid, &status, block ? 0 : WNOHANG);
+
+	if (ret == 0)
+		return 0;
+	if ((ret == pid) && WIFEXITED(status) && (WEXITSTATUS(status) == 0))
+		return 1;
+	return -1;
+#else
+	return 1;
+#endif
+}
+
 /** Generates an MD5 checksum.
  * @param mdout[out] Buffer to store result in, the result will be 16 bytes in binary
  *                   (not ascii printable!).
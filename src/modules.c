@@ -1015,6 +1015,43 @@ Hook *HookAddMain(Module *module, int hooktype, int priority, int (*func)(), voi
 	return p;
 }
 
+/** Names of the modules that have a bit in LocalClient::packet_hooks */
+static char *packet_hooks_owners[32];
+
+/** Get the bit of a module in LocalClient::packet_hooks.
+ * The bits are handed out by module name, so a module keeps its bit
+ * when it is reloaded and the clients that it opted in stay opted in.
+ * @param module	The module
+ * @returns The bit. In the unlikely case that all bits are taken, all
+ *          bits are returned, so the module shares them with the others.
+ */
+unsigned int PacketHooksBit(Module *module)
+{
+	int i;
+
+	for (i = 0; i < ARRAY_SIZEOF(packet_hooks_owners); i++)
+	{
+		if (!packet_hooks_owners[i])
+		{
+			safe_strdup(packet_hooks_owners[i], module->header->name);
+			return 1U << i;
+		}
+		if (!strcmp(packet_hooks_owners[i], module->header->name))
+			return 1U << i;
+	}
+	return ~0U;
+}
+
+/** Only call this packet hook for clients that the owner of the hook
+ * opted in via SetPacketHooks(), see HOOK_FLAG_OPTIN_CLIENT.
+ * @param hook	The hook (HOOKTYPE_PACKET or HOOKTYPE_RAWPACKET_IN)
+ */
+void HookOptinClient(Hook *hook)
+{
+	hook->flags |= HOOK_FLAG_OPTIN_CLIENT;
+	hook->optin = PacketHooksBit(hook->owner);
+}
+
 Hook *HookDel(Hook *hook)
 {
 	Hook *p, *q;
@@ -89,9 +89,7 @@ void mtag_add_account(Client *client, MessageTag *recv_mtags, MessageTag **mtag_
 
 	if (client && client->user && (*client->user->svid != '*') && !isdigit(*client->user->svid))
 	{
-		m = safe_alloc(sizeof(MessageTag));
-		safe_strdup(m->name, "account");
-		safe_strdup(m->value, client->user->svid);
+		m = new_mtag("account", client->user->svid);
 
 		AddListItem(m, *mtag_list);
 	}
@@ -76,7 +76,6 @@ struct Blacklist {
 typedef struct BLUser BLUser;
 struct BLUser {
 	Client *client;
-	int is_ipv6;
 	int refcnt;
 	/* The following save_* fields are used by softbans: */
 	int save_action;
@@ -85,13 +84,72 @@ struct BLUser {
 	char *save_reason;
 };
 
+/* Maximum number of A record replies we remember per cache entry */
+#define BLACKLIST_CACHE_MAX_REPLIES	8
+
+#define BLACKLIST_CACHE_HASH_SIZE	1024
+
+/* Above this number of entries we still do lookups (and coalesce them)
+ * but we no longer store the results in the cache.
+ */
+#define BLACKLIST_CACHE_MAX_ENTRIES	100000
+
+/* A user waiting for the result of an in-flight DNSBL lookup */
+typedef struct BlacklistCacheWaiter BlacklistCacheWaiter;
+struct BlacklistCacheWaiter {
+	BlacklistCacheWaiter *next;
+	BLUser *blu;
+};
+
+/* DNSBL result cache, keyed by (IP, DNSBL name).
+ * While a lookup is in progress the entry is 'pending' and any other
+ * client with the same IP is added to the waiters list, so we only
+ * send one DNS query. Once the reply is in, the raw A record replies
+ * are stored and (positive or negative) are cached for a while.
+ * We store the raw replies, rather than a hit/no-hit, so a REHASH
+ * which changes blacklist::dns::reply does not require a cache flush.
+ */
+typedef struct BlacklistCache BlacklistCache;
+struct BlacklistCache {
+	BlacklistCache *prev, *next;
+	char *ip;
+	char *dnsname;
+	int pending;
+	time_t expires;
+	int num_replies;
+	int reply[BLACKLIST_CACHE_MAX_REPLIES];
+	BlacklistCacheWaiter *waiters;
+};
+
+typedef struct BlacklistCacheStats BlacklistCacheStats;
+struct BlacklistCacheStats {
+	unsigned long hits;
+	unsigned long misses;
+	unsigned long coalesced;
+	unsigned long expired;
+	unsigned long uncacheable;
+};
+
+struct cfgstruct {
+	long cache_time;
+	long negative_cache_time;
+};
+
 /* Global variables */
 ModDataInfo *blacklist_md = NULL;
 Blacklist *conf_blacklist = NULL;
+static struct cfgstruct cfg;
+static BlacklistCache *blacklist_cache[BLACKLIST_CACHE_HASH_SIZE];
+static int blacklist_cache_entries = 0;
+static BlacklistCacheStats blacklist_cache_stats;
+static char siphashkey_blacklist_cache[SIPHASH_KEY_LENGTH];
 
 /* Forward declarations */
 int blacklist_config_test(ConfigFile *, ConfigEntry *, int, int *);
 int blacklist_config_run(ConfigFile *, ConfigEntry *, int);
+int blacklist_set_config_test(ConfigFile *, ConfigEntry *, int, int *);
+int blacklist_set_config_run(ConfigFile *, ConfigEntry *, int);
+void blacklist_config_setdefaults(void);
 void blacklist_free_conf(void);
 void delete_blacklist_block(Blacklist *e);
 void blacklist_md_free(ModData *md);
@@ -105,6 +163,14 @@ int blacklist_rehash(void);
 int blacklist_rehash_complete(void);
 void blacklist_set_handshake_delay(void);
 void blacklist_free_bluser_if_able(BLUser *bl);
+void blacklist_process_replies(Client *client, Blacklist *bl, int *replies, int num_replies);
+BlacklistCache *blacklist_cache_find(char *ip, char *dnsname);
+BlacklistCache *blacklist_cache_add(char *ip, char *dnsname);
+void blacklist_cache_add_waiter(BlacklistCache *e, BLUser *blu);
+void blacklist_cache_remove(BlacklistCache *e);
+void blacklist_cache_free_all(void);
+int blacklist_stats(Client *client, char *flag);
+EVENT(blacklist_cache_expire);
 
 #define SetBLUser(x, y)	do { moddata_client(x, blacklist_md).ptr = y; } while(0)
 #define BLUSER(x)	((BLUser *)moddata_client(x, blacklist_md).ptr)
@@ -114,6 +180,7 @@ long SNO_BLACKLIST = 0L;
 MOD_TEST()
 {
 	HookAdd(modinfo->handle, HOOKTYPE_CONFIGTEST, 0, blacklist_config_test);
+	HookAdd(modinfo->handle, HOOKTYPE_CONFIGTEST, 0, blacklist_set_config_test);
 
 	CallbackAddEx(modinfo->handle, CALLBACKTYPE_BLACKLIST_CHECK, blacklist_start_check);
 	return MOD_SUCCESS;
@@ -131,6 +198,11 @@ MOD_INIT()
 	 * of those functions will change if we REHASH.
 	 */
 	ModuleSetOptions(modinfo->handle, MOD_OPT_PERM, 1);
+
+	memset(blacklist_cache, 0, sizeof(blacklist_cache));
+	memset(&blacklist_cache_stats, 0, sizeof(blacklist_cache_stats));
+	siphash_generate_key(siphashkey_blacklist_cache);
+	blacklist_config_setdefaults();
 	
 	memset(&mreq, 0, sizeof(mreq));
 	mreq.name = "blacklist";
@@ -144,11 +216,13 @@ MOD_INIT()
 	}
 
 	HookAdd(modinfo->handle, HOOKTYPE_CONFIGRUN, 0, blacklist_config_run);
+	HookAdd(modinfo->handle, HOOKTYPE_CONFIGRUN, 0, blacklist_set_config_run);
 	HookAdd(modinfo->handle, HOOKTYPE_HANDSHAKE, 0, blacklist_handshake);
 	HookAdd(modinfo->handle, HOOKTYPE_PRE_LOCAL_CONNECT, 0, blacklist_preconnect);
 	HookAdd(modinfo->handle, HOOKTYPE_REHASH, 0, blacklist_rehash);
 	HookAdd(modinfo->handle, HOOKTYPE_REHASH_COMPLETE, 0, blacklist_rehash_complete);
 	HookAdd(modinfo->handle, HOOKTYPE_LOCAL_QUIT, 0, blacklist_quit);
+	HookAdd(modinfo->handle, HOOKTYPE_STATS, 0, blacklist_stats);
 
 	SnomaskAdd(modinfo->handle, 'b', umode_allow_opers, &SNO_BLACKLIST);
 
@@ -159,6 +233,7 @@ MOD_INIT()
 MOD_LOAD()
 {
 	blacklist_set_handshake_delay();
+	EventAdd(modinfo->handle, "blacklist_cache_expire", blacklist_cache_expire, NULL, 60000, 0);
 	return MOD_SUCCESS;
 }
 
@@ -166,15 +241,23 @@ MOD_LOAD()
 MOD_UNLOAD()
 {
 	blacklist_free_conf();
+	blacklist_cache_free_all();
 	return MOD_SUCCESS;
 }
 
 int blacklist_rehash(void)
 {
 	blacklist_free_conf();
+	blacklist_config_setdefaults();
 	return 0;
 }
 
+void blacklist_config_setdefaults(void)
+{
+	cfg.cache_time = 300;
+	cfg.negative_cache_time = 60;
+}
+
 int blacklist_rehash_complete(void)
 {
 	blacklist_set_handshake_delay();
@@ -538,6 +621,70 @@ int blacklist_config_run(ConfigFile *cf, ConfigEntry *ce, int type)
 	return 0;
 }
 
+int blacklist_set_config_test(ConfigFile *cf, ConfigEntry *ce, int type, int *errs)
+{
+	int errors = 0;
+	ConfigEntry *cep;
+
+	if (type != CONFIG_SET)
+		return 0;
+
+	/* We are only interrested in set::blacklist.. */
+	if (!ce || strcmp(ce->ce_varname, "blacklist"))
+		return 0;
+
+	for (cep = ce->ce_entries; cep; cep = cep->ce_next)
+	{
+		if (!cep->ce_vardata)
+		{
+			config_error_empty(cep->ce_fileptr->cf_filename, cep->ce_varlinenum,
+				"set::blacklist", cep->ce_varname);
+			errors++;
+			continue;
+		} else
+		if (!strcmp(cep->ce_varname, "cache-time") ||
+		    !strcmp(cep->ce_varname, "negative-cache-time"))
+		{
+			long v = config_checkval(cep->ce_vardata, CFG_TIME);
+			if ((v < 0) || (v > 86400))
+			{
+				config_error("%s:%i: set::blacklist::%s should be in range 0-86400",
+					cep->ce_fileptr->cf_filename, cep->ce_varlinenum, cep->ce_varname);
+				errors++;
+			}
+		} else
+		{
+			config_error_unknown(cep->ce_fileptr->cf_filename, cep->ce_varlinenum,
+				"set::blacklist", cep->ce_varname);
+			errors++;
+		}
+	}
+
+	*errs = errors;
+	return errors ? -1 : 1;
+}
+
+int blacklist_set_config_run(ConfigFile *cf, ConfigEntry *ce, int type)
+{
+	ConfigEntry *cep;
+
+	if (type != CONFIG_SET)
+		return 0;
+
+	/* We are only interrested in set::blacklist.. */
+	if (!ce || strcmp(ce->ce_varname, "blacklist"))
+		return 0;
+
+	for (cep = ce->ce_entries; cep; cep = cep->ce_next)
+	{
+		if (!strcmp(cep->ce_varname, "cache-time"))
+			cfg.cache_time = config_checkval(cep->ce_vardata, CFG_TIME);
+		else if (!strcmp(cep->ce_varname, "negative-cache-time"))
+			cfg.negative_cache_time = config_checkval(cep->ce_vardata, CFG_TIME);
+	}
+	return 1;
+}
+
 void blacklist_md_free(ModData *md)
 {
 	BLUser *bl = md->ptr;
@@ -584,6 +731,12 @@ int blacklist_start_check(Client *client)
 		if (bl->backend_type == BLACKLIST_BACKEND_DNS)
 			blacklist_dns_request(client, bl);
 	}
+
+	/* If all the results came from the cache then we are not waiting
+	 * for anything, so the handshake delay would serve no purpose.
+	 */
+	if (BLUSER(client) && (BLUSER(client)->refcnt == 0))
+		SetNoHandshakeDelay(client);
 	
 	return 0;
 }
@@ -593,10 +746,26 @@ int blacklist_dns_request(Client *client, Blacklist *d)
 	char buf[256], wbuf[128];
 	unsigned int e[8];
 	char *ip = GetIP(client);
+	BlacklistCache *c;
 	
 	if (!ip)
 		return 0;
 
+	c = blacklist_cache_find(ip, d->backend->dns->name);
+	if (c)
+	{
+		if (c->pending)
+		{
+			/* Same lookup is already in-flight, wait for that one */
+			blacklist_cache_stats.coalesced++;
+			blacklist_cache_add_waiter(c, BLUSER(client));
+		} else {
+			blacklist_cache_stats.hits++;
+			blacklist_process_replies(client, d, c->reply, c->num_replies);
+		}
+		return 0;
+	}
+
 	memset(&e, 0, sizeof(e));
 
 	if (strchr(ip, '.'))
@@ -611,7 +780,6 @@ int blacklist_dns_request(Client *client, Blacklist *d)
 	{
 		/* IPv6 */
 		int i;
-		BLUSER(client)->is_ipv6 = 1;
 		if (sscanf(ip, "%x:%x:%x:%x:%x:%x:%x:%x",
 		    &e[0], &e[1], &e[2], &e[3], &e[4], &e[5], &e[6], &e[7]) != 8)
 		{
@@ -632,9 +800,11 @@ int blacklist_dns_request(Client *client, Blacklist *d)
 	else
 		return 0; /* unknown IP format */
 
-	BLUSER(client)->refcnt++; /* one (more) blacklist result remaining */
+	blacklist_cache_stats.misses++;
+	c = blacklist_cache_add(ip, d->backend->dns->name);
+	blacklist_cache_add_waiter(c, BLUSER(client)); /* one (more) blacklist result remaining */
 	
-	unreal_gethostbyname(buf, AF_INET, blacklist_resolver_callback, BLUSER(client));
+	unreal_gethostbyname(buf, AF_INET, blacklist_resolver_callback, c);
 	
 	return 0;
 }
@@ -673,31 +843,112 @@ void blacklist_free_bluser_if_able(BLUser *bl)
 	safe_free(bl);
 }
 
-char *getdnsblname(char *p, Client *client)
+static uint64_t hash_blacklist_cache(char *ip)
 {
-	int dots = 0;
-	int dots_count;
-
-	if (!client)
-		return NULL;
+	return siphash(ip, siphashkey_blacklist_cache) % BLACKLIST_CACHE_HASH_SIZE;
+}
 
-	if (BLUSER(client)->is_ipv6)
-		dots_count = 32;
-	else
-		dots_count = 4;
+/** Find a blacklist cache entry for this IP and DNSBL name.
+ * Expired entries are removed and not returned.
+ */
+BlacklistCache *blacklist_cache_find(char *ip, char *dnsname)
+{
+	BlacklistCache *e;
+	int hashv = hash_blacklist_cache(ip);
 
-	for (; *p; p++)
+	for (e = blacklist_cache[hashv]; e; e = e->next)
 	{
-		if (*p == '.')
+		if (!strcmp(e->ip, ip) && !strcmp(e->dnsname, dnsname))
 		{
-			dots++;
-			if (dots == dots_count)
-				return p+1;
+			if (!e->pending && (e->expires <= TStime()))
+			{
+				blacklist_cache_stats.expired++;
+				blacklist_cache_remove(e);
+				return NULL;
+			}
+			return e;
 		}
 	}
+
 	return NULL;
 }
 
+/** Add a new (pending) entry to the blacklist cache */
+BlacklistCache *blacklist_cache_add(char *ip, char *dnsname)
+{
+	BlacklistCache *e;
+	int hashv = hash_blacklist_cache(ip);
+
+	e = safe_alloc(sizeof(BlacklistCache));
+	safe_strdup(e->ip, ip);
+	safe_strdup(e->dnsname, dnsname);
+	e->pending = 1;
+	AddListItem(e, blacklist_cache[hashv]);
+	blacklist_cache_entries++;
+	return e;
+}
+
+void blacklist_cache_add_waiter(BlacklistCache *e, BLUser *blu)
+{
+	BlacklistCacheWaiter *w = safe_alloc(sizeof(BlacklistCacheWaiter));
+
+	w->blu = blu;
+	w->next = e->waiters;
+	e->waiters = w;
+	blu->refcnt++;
+}
+
+/** Remove an entry from the blacklist cache.
+ * Must not be called for entries that are still pending, since
+ * the c-ares callback holds a pointer to it.
+ */
+void blacklist_cache_remove(BlacklistCache *e)
+{
+	int hashv = hash_blacklist_cache(e->ip);
+
+	DelListItem(e, blacklist_cache[hashv]);
+	safe_free(e->ip);
+	safe_free(e->dnsname);
+	safe_free(e);
+	blacklist_cache_entries--;
+}
+
+/** Free all (non-pending) entries in the blacklist cache */
+void blacklist_cache_free_all(void)
+{
+	BlacklistCache *e, *e_next;
+	int i;
+
+	for (i = 0; i < BLACKLIST_CACHE_HASH_SIZE; i++)
+	{
+		for (e = blacklist_cache[i]; e; e = e_next)
+		{
+			e_next = e->next;
+			if (!e->pending)
+				blacklist_cache_remove(e);
+		}
+	}
+}
+
+EVENT(blacklist_cache_expire)
+{
+	BlacklistCache *e, *e_next;
+	int i;
+
+	for (i = 0; i < BLACKLIST_CACHE_HASH_SIZE; i++)
+	{
+		for (e = blacklist_cache[i]; e; e = e_next)
+		{
+			e_next = e->next;
+			if (!e->pending && (e->expires <= TStime()))
+			{
+				blacklist_cache_stats.expired++;
+				blacklist_cache_remove(e);
+			}
+		}
+	}
+}
+
 /* Parse DNS reply.
  * A reply will be an A record in the format x.x.x.<reply>
  */
@@ -772,28 +1023,17 @@ void blacklist_hit(Client *client, Blacklist *bl, int reply)
 	}
 }
 
-void blacklist_process_result(Client *client, int status, struct hostent *he)
+/** Check the (possibly cached) replies against the blacklist block */
+void blacklist_process_replies(Client *client, Blacklist *bl, int *replies, int num_replies)
 {
-	Blacklist *bl;
-	char *domain;
 	int reply;
 	int i;
 	int replycnt;
-	
-	if ((status != 0) || (he->h_length != 4) || !he->h_name)
-		return; /* invalid reply */
-	
-	domain = getdnsblname(he->h_name, client);
-	if (!domain)
-		return; /* odd */
-	bl = blacklist_find_block_by_dns(domain);
-	if (!bl)
-		return; /* possibly just rehashed and the blacklist block is gone now */
-	
+
 	/* walk through all replies for this record... until we have a hit */
-	for (replycnt=0; he->h_addr_list[replycnt]; replycnt++)
+	for (replycnt=0; replycnt < num_replies; replycnt++)
 	{
-		reply = blacklist_parse_reply(he, replycnt);
+		reply = replies[replycnt];
 
 		for (i = 0; bl->backend->dns->reply[i]; i++)
 		{
@@ -808,26 +1048,82 @@ void blacklist_process_result(Client *client, int status, struct hostent *he)
 	}
 }
 
+/** Store the DNS result in the cache entry.
+ * @returns 1 if the result may be cached, 0 if not (eg: timeout).
+ */
+int blacklist_cache_set_result(BlacklistCache *e, int status, struct hostent *he)
+{
+	e->pending = 0;
+	e->num_replies = 0;
+
+	if (status == ARES_SUCCESS)
+	{
+		if ((he->h_length == 4) && he->h_name)
+		{
+			for (; he->h_addr_list[e->num_replies] && (e->num_replies < BLACKLIST_CACHE_MAX_REPLIES); e->num_replies++)
+				e->reply[e->num_replies] = blacklist_parse_reply(he, e->num_replies);
+		}
+		e->expires = TStime() + (e->num_replies ? cfg.cache_time : cfg.negative_cache_time);
+	} else
+	if ((status == ARES_ENOTFOUND) || (status == ARES_ENODATA))
+	{
+		/* Not listed */
+		e->expires = TStime() + cfg.negative_cache_time;
+	} else {
+		/* Temporary failure (timeout, SERVFAIL, ..): don't cache this */
+		return 0;
+	}
+
+	if (blacklist_cache_entries > BLACKLIST_CACHE_MAX_ENTRIES)
+		return 0;
+
+	return (e->expires > TStime()) ? 1 : 0;
+}
+
 void blacklist_resolver_callback(void *arg, int status, int timeouts, struct hostent *he)
 {
-	BLUser *blu = (BLUser *)arg;
-	Client *client = blu->client;
+	BlacklistCache *e = (BlacklistCache *)arg;
+	BlacklistCacheWaiter *w, *w_next;
+	Blacklist *bl;
+	int cacheable;
 
-	blu->refcnt--; /* one less outstanding DNS request remaining */
+	cacheable = blacklist_cache_set_result(e, status, he);
 
-	/* If we are the last to resolve something and the client is gone
-	 * already then free the struct.
-	 */
-	if ((blu->refcnt == 0) && !client)
-		blacklist_free_bluser_if_able(blu);
+	/* This may be NULL if we just rehashed and the blacklist block is gone now */
+	bl = blacklist_find_block_by_dns(e->dnsname);
+
+	w = e->waiters;
+	e->waiters = NULL;
+	for (; w; w = w_next)
+	{
+		BLUser *blu = w->blu;
+		Client *client = blu->client;
 
-	blu = NULL;
+		w_next = w->next;
+		safe_free(w);
 
-	if (!client)
-		return; /* Client left already */
-	/* ^^ note: do not merge this with the other 'if' a few lines up (refcnt!) */
+		blu->refcnt--; /* one less outstanding DNS request remaining */
 
-	blacklist_process_result(client, status, he);
+		/* If we are the last to resolve something and the client is gone
+		 * already then free the struct.
+		 */
+		if ((blu->refcnt == 0) && !client)
+			blacklist_free_bluser_if_able(blu);
+
+		blu = NULL;
+
+		if (!client || !bl)
+			continue; /* Client left already */
+		/* ^^ note: do not merge this with the other 'if' a few lines up (refcnt!) */
+
+		blacklist_process_replies(client, bl, e->reply, e->num_replies);
+	}
+
+	if (!cacheable)
+	{
+		blacklist_cache_stats.uncacheable++;
+		blacklist_cache_remove(e);
+	}
 }
 
 int blacklist_preconnect(Client *client)
@@ -845,3 +1141,33 @@ int blacklist_preconnect(Client *client)
 		return HOOK_DENY;
 	return HOOK_CONTINUE; /* exempt */
 }
+
+int blacklist_stats(Client *client, char *flag)
+{
+	BlacklistCache *e;
+	int i, pending = 0, listed = 0;
+
+	if (strcmp(flag, "blacklist"))
+		return 0;
+
+	for (i = 0; i < BLACKLIST_CACHE_HASH_SIZE; i++)
+	{
+		for (e = blacklist_cache[i]; e; e = e->next)
+		{
+			if (e->pending)
+				pending++;
+			else if (e->num_replies)
+				listed++;
+		}
+	}
+
+	sendtxtnumeric(client, "Blacklist cache entries: %d (%d pending, %d listed, %d not listed)",
+		blacklist_cache_entries, pending, listed, blacklist_cache_entries - pending - listed);
+	sendtxtnumeric(client, "Blacklist cache hits: %lu, misses: %lu, coalesced: %lu",
+		blacklist_cache_stats.hits, blacklist_cache_stats.misses, blacklist_cache_stats.coalesced);
+	sendtxtnumeric(client, "Blacklist cache expired: %lu, not cached: %lu",
+		blacklist_cache_stats.expired, blacklist_cache_stats.uncacheable);
+	sendtxtnumeric(client, "Blacklist cache-time: %ld, negative-cache-time: %ld",
+		cfg.cache_time, cfg.negative_cache_time);
+	return 1;
+}
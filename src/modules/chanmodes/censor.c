@@ -30,6 +30,7 @@ int censor_config_run(ConfigFile *, ConfigEntry *, int);
 ModuleInfo *ModInfo = NULL;
 
 ConfigItem_badword *conf_badword_channel = NULL;
+WordFilter *conf_badword_channel_filter = NULL; /**< Compiled version of conf_badword_channel, built by stripbadwords() */
 
 
 MOD_TEST()
@@ -76,6 +77,8 @@ MOD_UNLOAD()
 		DelListItem(badword, conf_badword_channel);
 		badword_config_free(badword);
 	}
+	wordfilter_free(conf_badword_channel_filter);
+	conf_badword_channel_filter = NULL;
 	return MOD_SUCCESS;
 }
 
@@ -237,6 +240,10 @@ int censor_config_run(ConfigFile *cf, ConfigEntry *ce, int type)
 
 	badword_config_process(ca, word->ce_vardata);
 
+	/* The list changes, so the compiled version needs to be rebuilt */
+	wordfilter_free(conf_badword_channel_filter);
+	conf_badword_channel_filter = NULL;
+
 	if (!strcmp(ce->ce_vardata, "channel"))
 		AddListItem(ca, conf_badword_channel);
 	else if (!strcmp(ce->ce_vardata, "all"))
@@ -250,7 +257,7 @@ int censor_config_run(ConfigFile *cf, ConfigEntry *ce, int type)
 
 char *stripbadwords_channel(char *str, int *blocked)
 {
-	return stripbadwords(str, conf_badword_channel, blocked);
+	return stripbadwords(str, conf_badword_channel, &conf_badword_channel_filter, blocked);
 }
 
 int censor_can_send_to_channel(Client *client, Channel *channel, Membership *lp, char **msg, char **errmsg, SendType sendtype)
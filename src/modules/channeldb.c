@@ -68,6 +68,7 @@ struct cfgstruct {
 static struct cfgstruct cfg;
 
 static long channeldb_next_event = 0;
+static int channeldb_writer = 0; /**< Process id of the background writer, if any */
 
 MOD_TEST()
 {
@@ -115,6 +116,8 @@ MOD_LOAD()
 
 MOD_UNLOAD()
 {
+	if (channeldb_writer)
+		background_write_done(channeldb_writer, 1);
 	freecfg();
 	SavePersistentLong(modinfo, channeldb_next_event);
 	return MOD_SUCCESS;
@@ -190,10 +193,22 @@ int channeldb_configrun(ConfigFile *cf, ConfigEntry *ce, int type)
 
 EVENT(write_channeldb_evt)
 {
+	if (channeldb_writer)
+	{
+		int ret = background_write_done(channeldb_writer, 0);
+		if (ret == 0)
+			return; /* still writing */
+		if (ret < 0)
+			sendto_realops_and_log("[channeldb] Writing the database in the background failed (DATABASE NOT SAVED)");
+		channeldb_writer = 0;
+	}
 	if (channeldb_next_event > TStime())
 		return;
 	channeldb_next_event = TStime() + CHANNELDB_SAVE_EVERY;
-	write_channeldb();
+	/* Serialize and write the database in a child process */
+	channeldb_writer = background_write_start(write_channeldb);
+	if (channeldb_writer < 0)
+		channeldb_writer = 0; /* failed in the foreground, already reported */
 }
 
 int write_channeldb(void)
@@ -236,6 +251,7 @@ int write_channeldb(void)
 	}
 
 	// Everything seems to have gone well, attempt to close and rename the tempfile
+	W_SAFE(sync_file(fd));
 	if (fclose(fd) != 0)
 	{
 		WARN_WRITE_ERROR(tmpfname);
@@ -315,7 +331,7 @@ int write_channel_entry(FILE *fd, const char *tmpfname, Channel *channel)
 			{ \
 				safe_free(e->banstr); \
 				safe_free(e->who); \
-				safe_free(e); \
+				free_ban(e); \
 			} \
 			return 0; \
 		} \
@@ -332,7 +348,7 @@ int read_listmode(FILE *fd, Ban **lst)
 
 	for (i = 0; i < total; i++)
 	{
-		e = safe_alloc(sizeof(Ban));
+		e = make_ban();
 		R_SAFE(read_str(fd, &e->banstr));
 		R_SAFE(read_str(fd, &e->who));
 		R_SAFE(read_data(fd, &when, sizeof(when)));
@@ -44,9 +44,6 @@
  */
 #define MAX_LENGTH               150 /* Max length of a ban */
 
-/** Allow user@host in the textban? This changes the syntax! */
-#undef UHOSTFEATURE
-
 /** Enable 'censor' support. What this type will do is replace the
  * matched word with "<censored>" (or another word, see later)
  * Like:
@@ -79,17 +76,38 @@ ModuleHeader MOD_HEADER
 	"unrealircd-5",
     };
 
+/** The ~T bans of a channel, compiled.
+ * Instead of going through the ban list and doing a case insensitive
+ * strstr() per ~T ban for every message, all ~T:censor words are put
+ * in one WordFilter that is run in a single pass, and the ~T:block
+ * patterns are precompiled. This is only rebuilt when the ban list of
+ * the channel changed (see channel->listmode_version).
+ */
+typedef struct TextbanCache TextbanCache;
+struct TextbanCache {
+	int built;
+	unsigned int listmode_version;	/**< The channel->listmode_version this was built for */
+	WordFilter *censor;		/**< All ~T:censor words */
+	MatchGlob **block;		/**< All ~T:block patterns */
+	int nblock;
+};
+
 /* Forward declarations */
 char *extban_modeT_conv_param(char *para_in);
-int textban_check_ban(Client *client, Channel *channel, char *ban, char **msg, char **errmsg);
+int textban_check(Client *client, Channel *channel, TextbanCache *c, char **msg, char **errmsg);
+void textban_md_free(ModData *m);
 int textban_can_send_to_channel(Client *client, Channel *channel, Membership *lp, char **msg, char **errmsg, SendType sendtype);
 int extban_modeT_is_banned(Client *client, Channel *channel, char *ban, int type, char **msg, char **errmsg);
 int extban_modeT_is_ok(Client *client, Channel *channel, char *para, int checkt, int what, int what2);
 void parse_word(const char *s, char **word, int *type);
 
+/* Global variables */
+ModDataInfo *textban_md = NULL;
+
 MOD_INIT()
 {
 	ExtbanInfo req;
+	ModDataInfo mreq;
 
 	MARK_AS_OFFICIAL_MODULE(modinfo);
 
@@ -108,6 +126,18 @@ MOD_INIT()
 
 	HookAdd(modinfo->handle, HOOKTYPE_CAN_SEND_TO_CHANNEL, 0, textban_can_send_to_channel);
 
+	memset(&mreq, 0, sizeof(mreq));
+	mreq.name = "textban";
+	mreq.free = textban_md_free;
+	mreq.sync = 0;
+	mreq.type = MODDATATYPE_CHANNEL;
+	textban_md = ModDataAdd(modinfo->handle, mreq);
+	if (!textban_md)
+	{
+		config_error("textban module: adding moddata failed! module NOT loaded");
+		return MOD_FAILED;
+	}
+
 	return MOD_SUCCESS;
 }
 
@@ -121,132 +151,6 @@ MOD_UNLOAD()
 	return MOD_SUCCESS;
 }
 
-#if defined(CENSORFEATURE) || defined(STRIPFEATURE)
-static char *my_strcasestr(char *haystack, char *needle)
-{
-	int i;
-	int nlength = strlen (needle);
-	int hlength = strlen (haystack);
-
-	if (nlength > hlength)
-		return NULL;
-	if (hlength <= 0)
-		return NULL;
-	if (nlength <= 0)
-		return haystack;
-	for (i = 0; i <= (hlength - nlength); i++)
-	{
-		if (strncasecmp (haystack + i, needle, nlength) == 0)
-			return haystack + i;
-	}
-	return NULL; /* not found */
-}
-
-#define TEXTBAN_WORD_LEFT	0x1
-#define TEXTBAN_WORD_RIGHT	0x2
-
-/* textban_replace:
- * a fast replace routine written by Syzop used for replacing.
- * searches in line for huntw and replaces it with replacew,
- * buf is used for the result and max is sizeof(buf).
- * (Internal assumptions: size of 'buf' is 512 characters or more)
- */
-int textban_replace(int type, char *badword, char *line, char *buf)
-{
-	char *replacew;
-	char *pold = line, *pnew = buf; /* Pointers to old string and new string */
-	char *poldx = line;
-	int replacen;
-	int searchn = -1;
-	char *startw, *endw;
-	char *c_eol = buf + 510 - 1; /* Cached end of (new) line */
-	int cleaned = 0;
-
-	replacew = CENSORWORD;
-	replacen = sizeof(CENSORWORD)-1;
-
-	while (1)
-	{
-		pold = my_strcasestr(pold, badword);
-		if (!pold)
-			break;
-		if (searchn == -1)
-			searchn = strlen(badword);
-		/* Hunt for start of word */
- 		if (pold > line)
- 		{
-			for (startw = pold; (!iswseperator(*startw) && (startw != line)); startw--);
-			if (iswseperator(*startw))
-				startw++; /* Don't point at the space/seperator but at the word! */
-		} else {
-			startw = pold;
-		}
-
-		if (!(type & TEXTBAN_WORD_LEFT) && (pold != startw))
-		{
-			/* not matched */
-			pold++;
-			continue;
-		}
-
-		/* Hunt for end of word
-		 * Fix for bug #4909: word will be at least 'searchn' long so we can skip
-		 * 'searchn' bytes and avoid stopping half-way the badword.
-		 */
-		for (endw = pold+searchn; ((*endw != '\0') && (!iswseperator(*endw))); endw++);
-
-		if (!(type & TEXTBAN_WORD_RIGHT) && (pold+searchn != endw))
-		{
-			/* not matched */
-			pold++;
-			continue;
-		}
-
-		cleaned = 1; /* still too soon? Syzop/20050227 */
-
-		/* Do we have any not-copied-yet data? */
-		if (poldx != startw)
-		{
-			int tmp_n = startw - poldx;
-			if (pnew + tmp_n >= c_eol)
-			{
-				/* Partial copy and return... */
-				memcpy(pnew, poldx, c_eol - pnew);
-				*c_eol = '\0';
-				return 1;
-			}
-
-			memcpy(pnew, poldx, tmp_n);
-			pnew += tmp_n;
-		}
-		/* Now update the word in buf (pnew is now something like startw-in-new-buffer */
-
-		if (replacen)
-		{
-			if ((pnew + replacen) >= c_eol)
-			{
-				/* Partial copy and return... */
-				memcpy(pnew, replacew, c_eol - pnew);
-				*c_eol = '\0';
-				return 1;
-			}
-			memcpy(pnew, replacew, replacen);
-			pnew += replacen;
-		}
-		poldx = pold = endw;
-	}
-	/* Copy the last part */
-	if (*poldx)
-	{
-		strncpy(pnew, poldx, c_eol - pnew);
-		*(c_eol) = '\0';
-	} else {
-		*pnew = '\0';
-	}
-	return cleaned;
-}
-#endif
-
 unsigned int counttextbans(Channel *channel)
 {
 	Ban *ban;
@@ -302,40 +206,10 @@ char *extban_modeT_conv_param(char *para_in)
 {
 	static char retbuf[MAX_LENGTH+1];
 	char para[MAX_LENGTH+1], *action, *text, *p;
-#ifdef UHOSTFEATURE
-	char *uhost;
-	int ap = 0;
-#endif
 
 	strlcpy(para, para_in+3, sizeof(para)); /* work on a copy (and truncate it) */
 
-	/* ~T:<action>:<text>
-	 * ~T:user@host:<action>:<text> if UHOSTFEATURE is enabled
-	 */
-
-#ifdef UHOSTFEATURE
-	action = strchr(para, ':');
-	if (!action)
-		return NULL;
-	*action++ = '\0';
-	if (!*action)
-		return NULL;
-	text = strchr(action, ':');
-	if (!text || !text[1])
-		return NULL;
-	*text++ = '\0';
-	uhost = para;
-
-	for (p = uhost; *p; p++)
-	{
-		if (*p == '@')
-			ap++;
-		else if ((*p <= ' ') || (*p > 128))
-			return NULL; /* cannot be in a username/host */
-	}
-	if (ap != 1)
-		return NULL; /* no @ */
-#else
+	/* ~T:<action>:<text> */
 	text = strchr(para, ':');
 	if (!text)
 		return NULL;
@@ -344,7 +218,6 @@ char *extban_modeT_conv_param(char *para_in)
 	if (!*text)
 		return NULL; /* empty text */
 	action = para;
-#endif
 
 	/* ~T:<action>:<text> */
 	if (!strcasecmp(action, "block"))
@@ -379,11 +252,7 @@ char *extban_modeT_conv_param(char *para_in)
 	}
 
 	/* Rebuild the string.. can be cut off if too long. */
-#ifdef UHOSTFEATURE
-	snprintf(retbuf, sizeof(retbuf), "~T:%s:%s:%s", uhost, action, text);
-#else
 	snprintf(retbuf, sizeof(retbuf), "~T:%s:%s", action, text);
-#endif
 	return retbuf;
 }
 
@@ -393,108 +262,121 @@ int extban_modeT_is_banned(Client *client, Channel *channel, char *ban, int chec
 	return 0;
 }
 
-/** Check for text bans (censor and block) */
-int textban_can_send_to_channel(Client *client, Channel *channel, Membership *lp, char **msg, char **errmsg, SendType sendtype)
+/** Free the compiled ~T bans, but not the TextbanCache itself */
+static void textban_cache_clear(TextbanCache *c)
+{
+	int i;
+
+	wordfilter_free(c->censor);
+	c->censor = NULL;
+	for (i = 0; i < c->nblock; i++)
+		match_glob_free(c->block[i]);
+	safe_free(c->block);
+	c->nblock = 0;
+	c->built = 0;
+}
+
+void textban_md_free(ModData *m)
 {
+	if (m->ptr)
+	{
+		textban_cache_clear(m->ptr);
+		safe_free(m->ptr);
+	}
+}
+
+/** Returns the "~T:..." of a ban, also for stacked ~t:xx:~T bans (timed text bans), or NULL */
+static char *textban_str(Ban *ban)
+{
+	if (!strncmp(ban->banstr, "~T:", 3))
+		return ban->banstr;
+	if (!strncmp(ban->banstr, "~t:", 3))
+	{
+		char *p = strchr(ban->banstr+3, ':');
+		if (p && !strncmp(p+1, "~T:", 3))
+			return p+1;
+	}
+	return NULL;
+}
+
+/** Get the compiled ~T bans of a channel, (re)building them if needed */
+static TextbanCache *textban_get_cache(Channel *channel)
+{
+	TextbanCache *c = moddata_channel(channel, textban_md).ptr;
 	Ban *ban;
+	char *str;
+	int n = 0;
 
-	/* +h/+o/+a/+q users bypass textbans */
-	if (is_skochanop(client, channel))
-		return HOOK_CONTINUE;
+	if (!c)
+	{
+		c = safe_alloc(sizeof(TextbanCache));
+		moddata_channel(channel, textban_md).ptr = c;
+	} else
+	if (c->built && (c->listmode_version == channel->listmode_version))
+	{
+		return c;
+	}
 
-	/* IRCOps with these privileges bypass textbans too */
-	if (op_can_override("channel:override:message:ban", client, channel, NULL))
-		return HOOK_CONTINUE;
+	textban_cache_clear(c);
 
-	/* Now we have to manually walk the banlist and check if things match */
-	for (ban = channel->banlist; ban; ban=ban->next)
+	for (ban = channel->banlist; ban; ban = ban->next)
+		if ((str = textban_str(ban)) && !strncasecmp(str+3, "block:", 6))
+			n++;
+	if (n)
+		c->block = safe_alloc(sizeof(MatchGlob *) * n);
+
+	for (ban = channel->banlist; ban; ban = ban->next)
 	{
-		if (!strncmp(ban->banstr, "~T:", 3))
+		if (!(str = textban_str(ban)))
+			continue;
+		str += 3;
+		if (!strncasecmp(str, "block:", 6))
 		{
-			/* ~T ban */
-			if (textban_check_ban(client, channel, ban->banstr, msg, errmsg))
-				return HOOK_DENY;
-		} else
-		if (!strncmp(ban->banstr, "~t:", 3))
+			c->block[c->nblock++] = match_glob_compile(str+6);
+		}
+#ifdef CENSORFEATURE
+		else if (!strncasecmp(str, "censor:", 7))
 		{
-			/* Stacked ~t:xx:~T ban (timed text ban) */
-			char *p = strchr(ban->banstr+3, ':');
-			if (p && !strncmp(p+1, "~T:", 3))
-			{
-				if (textban_check_ban(client, channel, p+1, msg, errmsg))
-					return HOOK_DENY;
-			}
+			char *word;
+			int type;
+
+			parse_word(str+7, &word, &type);
+			if (!c->censor)
+				c->censor = wordfilter_create();
+			wordfilter_add(c->censor, word, type, BADWORD_REPLACE, CENSORWORD);
 		}
+#endif
 	}
 
-	return HOOK_CONTINUE;
+	c->listmode_version = channel->listmode_version;
+	c->built = 1;
+	return c;
 }
 
-
-int textban_check_ban(Client *client, Channel *channel, char *ban, char **msg, char **errmsg)
+/** Check for text bans (censor and block) */
+int textban_can_send_to_channel(Client *client, Channel *channel, Membership *lp, char **msg, char **errmsg, SendType sendtype)
 {
-	static char retbuf[512];
-	char filtered[512]; /* temp input buffer */
-	long fl;
-	int cleaned=0;
-	char *p;
-#ifdef UHOSTFEATURE
-	char buf[512], uhost[USERLEN + HOSTLEN + 16];
-#endif
-	char tmp[1024], *word;
-	int type;
+	TextbanCache *c;
+	int ret;
 #ifdef BENCHMARK
 	struct timeval tv_alpha, tv_beta;
 
 	gettimeofday(&tv_alpha, NULL);
 #endif
 
-	/* We can only filter on non-NULL text of course */
-	if ((msg == NULL) || (*msg == NULL))
-		return 0;
+	/* +h/+o/+a/+q users bypass textbans */
+	if (is_skochanop(client, channel))
+		return HOOK_CONTINUE;
 
-	filtered[0] = '\0'; /* NOT needed, but... :P */
+	/* IRCOps with these privileges bypass textbans too */
+	if (op_can_override("channel:override:message:ban", client, channel, NULL))
+		return HOOK_CONTINUE;
 
-#ifdef UHOSTFEATURE
-	ircsprintf(uhost, "%s@%s", client->user->username, GetHost(client));
-#endif
-	strlcpy(filtered, StripControlCodes(*msg), sizeof(filtered));
+	c = textban_get_cache(channel);
+	if (!c->nblock && !wordfilter_count(c->censor))
+		return HOOK_CONTINUE; /* no textbans */
 
-	p = ban + 3;
-#ifdef UHOSTFEATURE
-	/* First.. deal with userhost... */
-	strcpy(buf, p);
-	p = strchr(buf, ':');
-	if (!p)
-		return 0; /* invalid format */
-	*p++ = '\0';
-
-	if (match_simple(buf, uhost))
-#else
-	if (1)
-#endif
-	{
-		if (!strncasecmp(p, "block:", 6))
-		{
-			if (match_simple(p+6, filtered))
-			{
-				if (errmsg)
-					*errmsg = "Message blocked due to a text ban";
-				return 1; /* BLOCK */
-			}
-		}
-#ifdef CENSORFEATURE
-		else if (!strncasecmp(p, "censor:", 7))
-		{
-			parse_word(p+7, &word, &type);
-			if (textban_replace(type, word, filtered, tmp))
-			{
-				strlcpy(filtered, tmp, sizeof(filtered));
-				cleaned = 1;
-			}
-		}
-#endif
-	}
+	ret = textban_check(client, channel, c, msg, errmsg);
 
 #ifdef BENCHMARK
 	gettimeofday(&tv_beta, NULL);
@@ -503,21 +385,57 @@ int textban_check_ban(Client *client, Channel *channel, char *ban, char **msg, c
 		client->name, channel->chname, strlen(*msg));
 #endif
 
-	if (cleaned)
+	return ret ? HOOK_DENY : HOOK_CONTINUE;
+}
+
+/** Run the text through the compiled ~T bans of the channel.
+ * The ~T:block patterns are checked against the original text,
+ * and after that all ~T:censor words are replaced in one go.
+ */
+int textban_check(Client *client, Channel *channel, TextbanCache *c, char **msg, char **errmsg)
+{
+	char filtered[512]; /* temp input buffer */
+	int i;
+
+	/* We can only filter on non-NULL text of course */
+	if ((msg == NULL) || (*msg == NULL))
+		return 0;
+
+	strlcpy(filtered, StripControlCodes(*msg), sizeof(filtered));
+
+	for (i = 0; i < c->nblock; i++)
 	{
-		/* check for null string */
+		if (match_glob(c->block[i], filtered))
+		{
+			if (errmsg)
+				*errmsg = "Message blocked due to a text ban";
+			return 1; /* BLOCK */
+		}
+	}
+
+#ifdef CENSORFEATURE
+	if (wordfilter_count(c->censor))
+	{
+		static char retbuf[512];
+		int blocked;
 		char *p;
-		for (p = filtered; *p; p++)
+
+		if (wordfilter_run(c->censor, filtered, retbuf, 510, &blocked))
 		{
-			if (*p != ' ')
+			/* check for null string */
+			for (p = retbuf; *p; p++)
 			{
-				strlcpy(retbuf, filtered, sizeof(retbuf));
-				*msg = retbuf;
-				return 0; /* allow through, but filtered */
+				if (*p != ' ')
+				{
+					*msg = retbuf;
+					return 0; /* allow through, but filtered */
+				}
 			}
+			return 1; /* nothing but spaces found.. */
 		}
-		return 1; /* nothing but spaces found.. */
 	}
+#endif
+
 	return 0; /* nothing blocked */
 }
 
@@ -537,9 +455,9 @@ void parse_word(const char *s, char **word, int *type)
 		else
 		{
 			if (s == tmp)
-				tpe |= TEXTBAN_WORD_LEFT;
+				tpe |= BADW_TYPE_FAST_L;
 			if (*(tmp + 1) == '\0')
-				tpe |= TEXTBAN_WORD_RIGHT;
+				tpe |= BADW_TYPE_FAST_R;
 		}
 	}
 	*o = '\0';
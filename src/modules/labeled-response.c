@@ -181,9 +181,7 @@ int lr_post_command(Client *from, MessageTag *mtags, char *buf)
 
 		if (currentcmd.responses == 0)
 		{
-			MessageTag *m = safe_alloc(sizeof(MessageTag));
-			safe_strdup(m->name, "label");
-			safe_strdup(m->value, currentcmd.label);
+			MessageTag *m = new_mtag("label", currentcmd.label);
 			memset(&currentcmd, 0, sizeof(currentcmd));
 			sendto_one(from, m, ":%s ACK", me.name);
 			free_message_tags(m);
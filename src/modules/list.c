@@ -40,7 +40,9 @@ typedef struct ChannelListOptions ChannelListOptions;
 struct ChannelListOptions {
 	NameList *yeslist;
 	NameList *nolist;
-	unsigned int starthash;
+	int bucketsdone;	/**< Number of channel size buckets done (from the biggest) */
+	int bucketpos;		/**< Number of channels done in the current bucket */
+	char resume[CHANNELLEN+1];	/**< Channel to continue with in the current bucket (if it is still there) */
 	short int showall;
 	unsigned short usermin;
 	int  usermax;
@@ -316,8 +318,9 @@ CMD_FUNC(cmd_list)
 }
 /*
  * The function which sends the actual channel list back to the user.
- * Operates by stepping through the hashtable, sending the entries back if
- * they match the criteria.
+ * Operates by stepping through the channel size index, biggest channels
+ * first, sending the entries back if they match the criteria. Buckets
+ * outside of the requested user count range are skipped entirely.
  * client = Local client to send the output back to.
  * Taken from bahamut, modified for Unreal by codemastr.
  */
@@ -325,20 +328,20 @@ int send_list(Client *client)
 {
 	Channel *channel;
 	ChannelListOptions *lopt = CHANNELLISTOPTIONS(client);
-	unsigned int  hashnum;
+	int bucket, pos, min, max, see_secret;
 	int numsend = (get_sendq(client) / 768) + 1; /* (was previously hard-coded) */
 	/* ^
 	 * numsend = Number (roughly) of lines to send back. Once this number has
-	 * been exceeded, send_list will finish with the current hash bucket,
-	 * and record that number as the number to start next time send_list
-	 * is called for this user. So, this function will almost always send
-	 * back more lines than specified by numsend (though not by much,
-	 * assuming the hashing algorithm works well). Be conservative in your
-	 * choice of numsend. -Rak
-	 */	
+	 * been exceeded, send_list will stop and record the bucket and the
+	 * position in that bucket as the place to continue next time send_list
+	 * is called for this user. Channels that moved around in the meantime
+	 * may be skipped or shown twice, which is fine for /LIST.
+	 * The name of the next channel is remembered too, so normally we can
+	 * continue right there instead of walking the bucket from the start.
+	 */
 
 	/* Begin of /list? then send official channels. */
-	if ((lopt->starthash == 0) && conf_offchans)
+	if ((lopt->bucketsdone == 0) && (lopt->bucketpos == 0) && conf_offchans)
 	{
 		ConfigItem_offchans *x;
 		for (x = conf_offchans; x; x = x->next)
@@ -354,88 +357,128 @@ int send_list(Client *client)
 		}
 	}
 
-	for (hashnum = lopt->starthash; hashnum < CHAN_HASH_TABLE_SIZE; hashnum++)
+	for (; lopt->bucketsdone < CHAN_SIZE_BUCKETS; lopt->bucketsdone++, lopt->bucketpos = 0)
 	{
-		if (numsend > 0)
-			for (channel = hash_get_chan_bucket(hashnum);
-			    channel; channel = channel->hnextch)
+		bucket = CHAN_SIZE_BUCKETS - 1 - lopt->bucketsdone;
+		if (!lopt->showall)
+		{
+			channel_size_bucket_range(bucket, &min, &max);
+			if ((lopt->usermax >= 0) && (min > lopt->usermax))
+				continue; /* all too big, try the next (smaller) bucket */
+			if (max < lopt->usermin)
+			{
+				/* This and all the remaining buckets are too small */
+				lopt->bucketsdone = CHAN_SIZE_BUCKETS;
+				break;
+			}
+		}
+
+		/* Skip what we sent last time */
+		channel = NULL;
+		if (*lopt->resume)
+		{
+			channel = find_channel(lopt->resume, NULL);
+			if (channel && (channel->sizebucket != bucket))
+				channel = NULL; /* moved to another bucket in the meantime */
+			*lopt->resume = '\0';
+		}
+		if (!channel)
+		{
+			channel = hash_get_chan_size_bucket(bucket);
+			for (pos = 0; channel && (pos < lopt->bucketpos); pos++)
+				channel = channel->snextch;
+		}
+
+		for (; channel; channel = channel->snextch)
+		{
+			if (numsend <= 0)
+				break;
+			lopt->bucketpos++;
+
+			/* set::hide-list { deny-channel } */
+			if (!IsOper(client) && iConf.hide_list && find_channel_allowed(client, channel->chname))
+				continue;
+
+			/* Similarly, hide unjoinable channels for non-ircops since it would be confusing */
+			if (!IsOper(client) && !valid_channelname(channel->chname))
+				continue;
+
+			/* Much more readable like this -- codemastr */
+			if ((!lopt->showall))
 			{
-				if (SecretChannel(channel)
-				    && !IsMember(client, channel)
-				    && !ValidatePermissionsForPath("channel:see:list:secret",client,NULL,channel,NULL))
+				/* User count must be in range */
+				if ((channel->users < lopt->usermin) || 
+				    ((lopt->usermax >= 0) && (channel->users > 
+				    lopt->usermax)))
+					continue;
+
+				/* Creation time must be in range */
+				if ((channel->creationtime && (channel->creationtime <
+				    lopt->chantimemin)) || (channel->creationtime >
+				    lopt->chantimemax))
 					continue;
 
-				/* set::hide-list { deny-channel } */
-				if (!IsOper(client) && iConf.hide_list && find_channel_allowed(client, channel->chname))
+				/* Topic time must be in range */
+				if ((channel->topic_time < lopt->topictimemin) ||
+				    (channel->topic_time > lopt->topictimemax))
 					continue;
 
-				/* Similarly, hide unjoinable channels for non-ircops since it would be confusing */
-				if (!IsOper(client) && !valid_channelname(channel->chname))
+				/* Must not be on nolist (if it exists) */
+				if (lopt->nolist && find_name_list_match(lopt->nolist, channel->chname))
 					continue;
 
-				/* Much more readable like this -- codemastr */
-				if ((!lopt->showall))
-				{
-					/* User count must be in range */
-					if ((channel->users < lopt->usermin) || 
-					    ((lopt->usermax >= 0) && (channel->users > 
-					    lopt->usermax)))
-						continue;
-
-					/* Creation time must be in range */
-					if ((channel->creationtime && (channel->creationtime <
-					    lopt->chantimemin)) || (channel->creationtime >
-					    lopt->chantimemax))
-						continue;
-
-					/* Topic time must be in range */
-					if ((channel->topic_time < lopt->topictimemin) ||
-					    (channel->topic_time > lopt->topictimemax))
-						continue;
-
-					/* Must not be on nolist (if it exists) */
-					if (lopt->nolist && find_name_list_match(lopt->nolist, channel->chname))
-						continue;
-
-					/* Must be on yeslist (if it exists) */
-					if (lopt->yeslist && !find_name_list_match(lopt->yeslist, channel->chname))
-						continue;
-				}
+				/* Must be on yeslist (if it exists) */
+				if (lopt->yeslist && !find_name_list_match(lopt->yeslist, channel->chname))
+					continue;
+			}
+
+			/* Checked last since this is the most expensive one */
+			see_secret = ValidatePermissionsForPath("channel:see:list:secret",client,NULL,channel,NULL);
+
+			if (SecretChannel(channel)
+			    && !IsMember(client, channel)
+			    && !see_secret)
+				continue;
 #ifdef LIST_SHOW_MODES
-				modebuf[0] = '[';
-				channel_modes(client, modebuf+1, parabuf, sizeof(modebuf)-1, sizeof(parabuf), channel);
-				if (modebuf[2] == '\0')
-					modebuf[0] = '\0';
-				else
-					strlcat(modebuf, "]", sizeof modebuf);
+			modebuf[0] = '[';
+			channel_modes(client, modebuf+1, parabuf, sizeof(modebuf)-1, sizeof(parabuf), channel);
+			if (modebuf[2] == '\0')
+				modebuf[0] = '\0';
+			else
+				strlcat(modebuf, "]", sizeof modebuf);
 #endif
-				if (!ValidatePermissionsForPath("channel:see:list:secret",client,NULL,channel,NULL))
-					sendnumeric(client, RPL_LIST,
-					    ShowChannel(client,
-					    channel) ? channel->chname :
-					    "*", channel->users,
+			if (!see_secret)
+				sendnumeric(client, RPL_LIST,
+				    ShowChannel(client,
+				    channel) ? channel->chname :
+				    "*", channel->users,
 #ifdef LIST_SHOW_MODES
-					    ShowChannel(client, channel) ?
-					    modebuf : "",
+				    ShowChannel(client, channel) ?
+				    modebuf : "",
 #endif
-					    ShowChannel(client,
-					    channel) ? (channel->topic ?
-					    channel->topic : "") : "");
-				else
-					sendnumeric(client, RPL_LIST, channel->chname,
-					    channel->users,
+				    ShowChannel(client,
+				    channel) ? (channel->topic ?
+				    channel->topic : "") : "");
+			else
+				sendnumeric(client, RPL_LIST, channel->chname,
+				    channel->users,
 #ifdef LIST_SHOW_MODES
-					    modebuf,
+				    modebuf,
 #endif					    
-					    (channel->topic ? channel->topic : ""));
-				numsend--;
-			}
-		else
+				    (channel->topic ? channel->topic : ""));
+			numsend--;
+		}
+
+		if (channel)
+		{
+			/* more to send in this bucket, but not now */
+			strlcpy(lopt->resume, channel->chname, sizeof(lopt->resume));
 			break;
+		}
 	}
 
 	/* All done */
-	if (hashnum == CHAN_HASH_TABLE_SIZE)
+	if (lopt->bucketsdone >= CHAN_SIZE_BUCKETS)
 	{
 		sendnumeric(client, RPL_LISTEND);
 		free_list_options(client);
@@ -446,7 +489,6 @@ int send_list(Client *client)
 	 * We've exceeded the limit on the number of channels to send back
 	 * at once.
 	 */
-	lopt->starthash = hashnum;
 	return 1;
 }
 
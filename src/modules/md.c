@@ -386,8 +386,8 @@ void _send_moddata_members(Client *srv)
 		for (m = channel->members; m; m = m->next)
 		{
 			client = m->client;
-			if (client->direction == srv)
-				continue; /* from srv's direction */
+			if (!burst_introduced(srv, client))
+				continue; /* from srv's direction, or not sent yet */
 			for (mdi = MDInfo; mdi; mdi = mdi->next)
 			{
 				if ((mdi->type == MODDATATYPE_MEMBER) && mdi->sync && mdi->serialize)
@@ -407,8 +407,8 @@ void _send_moddata_members(Client *srv)
 		if (!IsUser(client) || !client->user)
 			continue;
 
-		if (client->direction == srv)
-			continue; /* from srv's direction */
+		if (!burst_introduced(srv, client))
+			continue; /* from srv's direction, or not sent yet */
 
 		for (m = client->user->channel; m; m = m->next)
 		{
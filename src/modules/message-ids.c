@@ -103,11 +103,10 @@ int msgid_mtag_is_ok(Client *client, char *name, char *value)
  */
 MessageTag *mtag_generate_msgid(void)
 {
-	MessageTag *m = safe_alloc(sizeof(MessageTag));
-	safe_strdup(m->name, "msgid");
-	m->value = safe_alloc(MSGIDLEN+1);
-	gen_random_alnum(m->value, MSGIDLEN);
-	return m;
+	char buf[MSGIDLEN+1];
+
+	gen_random_alnum(buf, MSGIDLEN);
+	return new_mtag("msgid", buf);
 }
 
 
@@ -115,7 +114,7 @@ void mtag_add_or_inherit_msgid(Client *sender, MessageTag *recv_mtags, MessageTa
 {
 	MessageTag *m = find_mtag(recv_mtags, "msgid");
 	if (m)
-		m = duplicate_mtag(m);
+		m = new_mtag(m->name, m->value);
 	else
 		m = mtag_generate_msgid();
 
@@ -160,7 +159,9 @@ void mtag_add_or_inherit_msgid(Client *sender, MessageTag *recv_mtags, MessageTa
 		b64_encode(binaryhash, sizeof(binaryhash)/2, b64hash, sizeof(b64hash));
 		b64hash[22] = '\0'; /* cut off at '=' */
 		snprintf(newbuf, sizeof(newbuf), "%s-%s", prefix, b64hash);
-		safe_strdup(m->value, newbuf);
+		/* Tags from new_mtag() can't be changed, so replace it */
+		free_message_tags(m);
+		m = new_mtag("msgid", newbuf);
 	}
 	AddListItem(m, *mtag_list);
 }
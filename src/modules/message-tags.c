@@ -195,13 +195,8 @@ void _parse_message_tags(Client *client, char **str, MessageTag **mtag_list)
 		 */
 		if (message_tag_ok(client, name, value))
 		{
-			m = safe_alloc(sizeof(MessageTag));
-			safe_strdup(m->name, name);
 			/* Both NULL and empty become NULL: */
-			if (BadPtr(value))
-				m->value = NULL;
-			else /* a real value... */
-				safe_strdup(m->value, value);
+			m = new_mtag(name, BadPtr(value) ? NULL : value);
 			AddListItem(m, *mtag_list);
 		}
 	}
@@ -0,0 +1,415 @@
+/*
+ * metrics UnrealIRCd module
+ * (C) Copyright 2020-present the UnrealIRCd team
+ *
+ * Serves statistics of the main loop in the Prometheus text format,
+ * so they can be graphed and alerted on.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+#include "unrealircd.h"
+
+ModuleHeader MOD_HEADER
+  = {
+	"metrics",
+	"1.0",
+	"Export main loop statistics in the Prometheus text format",
+	"UnrealIRCd Team",
+	"unrealircd-5",
+    };
+
+/* The metrics are served on listen blocks with options { metrics; }
+ * This is a normal listener, so the connection goes through the usual
+ * accept and ban checks. Instead of parsing IRC, we answer the first
+ * HTTP request with the metrics and close the connection. There is no
+ * authentication, so this should only listen on 127.0.0.1 or similar.
+ */
+
+/** Maximum size of the response */
+#define METRICS_BUFSIZE		65536
+
+/* Histogram boundaries for times: powers of two nanoseconds,
+ * from 2^10 (about 1us) to 2^33 (about 8.6 seconds).
+ */
+#define METRICS_TIME_FIRST	10
+#define METRICS_TIME_LAST	33
+
+/* Histogram boundaries for counts: 2^n-1 from 0 to 4095 */
+#define METRICS_COUNT_LAST	12
+
+#define IsMetricsClient(x)	((x)->local && (x)->local->listener && ((x)->local->listener->options & LISTENER_METRICS))
+
+/** Buffer for building the response */
+typedef struct MetricsBuffer MetricsBuffer;
+struct MetricsBuffer {
+	char *buf;
+	int len;
+};
+
+/* Global variables */
+static unsigned int metrics_packet_hooks; /**< Our bit for SetPacketHooks() */
+
+/* Forward declarations */
+int metrics_config_test(ConfigFile *cf, ConfigEntry *ce, int type, int *errs);
+int metrics_config_run_ex(ConfigFile *cf, ConfigEntry *ce, int type, void *ptr);
+int metrics_handshake(Client *client);
+int metrics_packet_in(Client *client, char *readbuf, int *length);
+int metrics_packet_out(Client *from, Client *to, Client *intended_to, char **msg, int *length);
+
+MOD_TEST()
+{
+	HookAdd(modinfo->handle, HOOKTYPE_CONFIGTEST, 0, metrics_config_test);
+	return MOD_SUCCESS;
+}
+
+MOD_INIT()
+{
+	Hook *h;
+
+	MARK_AS_OFFICIAL_MODULE(modinfo);
+
+	HookAdd(modinfo->handle, HOOKTYPE_CONFIGRUN_EX, 0, metrics_config_run_ex);
+	HookAdd(modinfo->handle, HOOKTYPE_HANDSHAKE, 0, metrics_handshake);
+	/* The packet hooks are only called for clients on metrics ports */
+	metrics_packet_hooks = PacketHooksBit(modinfo->handle);
+	h = HookAdd(modinfo->handle, HOOKTYPE_RAWPACKET_IN, INT_MIN, metrics_packet_in);
+	HookOptinClient(h);
+	h = HookAdd(modinfo->handle, HOOKTYPE_PACKET, INT_MAX, metrics_packet_out);
+	HookOptinClient(h);
+
+	return MOD_SUCCESS;
+}
+
+MOD_LOAD()
+{
+	Client *client;
+
+	/* Clients that connected before we were (re)loaded */
+	list_for_each_entry(client, &unknown_list, lclient_node)
+		if (IsMetricsClient(client))
+			SetPacketHooks(client, metrics_packet_hooks);
+
+	return MOD_SUCCESS;
+}
+
+MOD_UNLOAD()
+{
+	return MOD_SUCCESS;
+}
+
+int metrics_config_test(ConfigFile *cf, ConfigEntry *ce, int type, int *errs)
+{
+	ConfigEntry *listen, *cep;
+	int errors = 0;
+
+	if (type != CONFIG_LISTEN_OPTIONS)
+		return 0;
+
+	/* We are only interrested in listen::options::metrics.. */
+	if (!ce || !ce->ce_varname || strcmp(ce->ce_varname, "metrics"))
+		return 0;
+
+	/* The metrics are public to anyone who can connect, and connections
+	 * to a metrics listener are not throttled. So never on all addresses.
+	 */
+	listen = (ce->ce_prevlevel && ce->ce_prevlevel->ce_prevlevel) ? ce->ce_prevlevel->ce_prevlevel : NULL;
+	if (listen)
+	{
+		for (cep = listen->ce_entries; cep; cep = cep->ce_next)
+		{
+			if (!strcmp(cep->ce_varname, "ip") && cep->ce_vardata &&
+			    (!strcmp(cep->ce_vardata, "*") || !strcmp(cep->ce_vardata, "::") ||
+			     !strcmp(cep->ce_vardata, "0.0.0.0")))
+			{
+				config_error("%s:%i: listen block with options { metrics; } may not listen on all IP addresses. "
+				             "The metrics can be read by anyone who can connect, use ip 127.0.0.1; or another local address",
+				             ce->ce_fileptr->cf_filename, ce->ce_varlinenum);
+				errors++;
+			}
+		}
+	}
+
+	*errs = errors;
+	return errors ? -1 : 1;
+}
+
+int metrics_config_run_ex(ConfigFile *cf, ConfigEntry *ce, int type, void *ptr)
+{
+	ConfigItem_listen *l;
+
+	if (type != CONFIG_LISTEN_OPTIONS)
+		return 0;
+
+	/* We are only interrested in listen::options::metrics.. */
+	if (!ce || !ce->ce_varname || strcmp(ce->ce_varname, "metrics"))
+		return 0;
+
+	l = (ConfigItem_listen *)ptr;
+	l->options |= LISTENER_METRICS;
+	return 1;
+}
+
+int metrics_handshake(Client *client)
+{
+	if (IsMetricsClient(client))
+		SetPacketHooks(client, metrics_packet_hooks);
+	return 0;
+}
+
+/** Drop any IRC traffic to metrics clients, such as the
+ * "Looking up your hostname" notices.
+ */
+int metrics_packet_out(Client *from, Client *to, Client *intended_to, char **msg, int *length)
+{
+	if (MyConnect(to) && IsMetricsClient(to))
+		*msg = NULL;
+	return 0;
+}
+
+/** Append to the response buffer. Anything that doesn't fit is cut off. */
+static void metrics_add(MetricsBuffer *m, FORMAT_STRING(const char *pattern), ...) __attribute__((format(printf,2,3)));
+static void metrics_add(MetricsBuffer *m, const char *pattern, ...)
+{
+	va_list vl;
+	int n;
+
+	if (m->len >= METRICS_BUFSIZE - 1)
+		return;
+
+	va_start(vl, pattern);
+	n = vsnprintf(m->buf + m->len, METRICS_BUFSIZE - m->len, pattern, vl);
+	va_end(vl);
+
+	if (n > 0)
+		m->len = MIN(m->len + n, METRICS_BUFSIZE - 1);
+}
+
+/** Add the header of a metric */
+static void metrics_header(MetricsBuffer *m, const char *name, const char *type, const char *help)
+{
+	metrics_add(m, "# HELP unrealircd_%s %s\n", name, help);
+	metrics_add(m, "# TYPE unrealircd_%s %s\n", name, type);
+}
+
+/** Add a histogram of times (in nanoseconds), which is exported in seconds */
+static void metrics_time_histogram(MetricsBuffer *m, const char *name, const char *help, LatencyHistogram *h)
+{
+	int i;
+
+	metrics_header(m, name, "histogram", help);
+	for (i = METRICS_TIME_FIRST; i <= METRICS_TIME_LAST; i++)
+	{
+		metrics_add(m, "unrealircd_%s_bucket{le=\"%.9g\"} %llu\n",
+			name, (double)(1ULL << i) / 1000000000.0,
+			latency_count_below(h, 1ULL << i));
+	}
+	metrics_add(m, "unrealircd_%s_bucket{le=\"+Inf\"} %llu\n", name, h->count);
+	metrics_add(m, "unrealircd_%s_sum %.9f\n", name, (double)h->total / 1000000000.0);
+	metrics_add(m, "unrealircd_%s_count %llu\n", name, h->count);
+}
+
+/** Add a histogram of counts */
+static void metrics_count_histogram(MetricsBuffer *m, const char *name, const char *help, LatencyHistogram *h)
+{
+	int i;
+
+	metrics_header(m, name, "histogram", help);
+	for (i = 0; i <= METRICS_COUNT_LAST; i++)
+	{
+		/* Values up to and including 2^i-1 are the values below 2^i */
+		metrics_add(m, "unrealircd_%s_bucket{le=\"%llu\"} %llu\n",
+			name, (1ULL << i) - 1, latency_count_below(h, 1ULL << i));
+	}
+	metrics_add(m, "unrealircd_%s_bucket{le=\"+Inf\"} %llu\n", name, h->count);
+	metrics_add(m, "unrealircd_%s_sum %llu\n", name, h->total);
+	metrics_add(m, "unrealircd_%s_count %llu\n", name, h->count);
+}
+
+/** Count local connections and their queues */
+static void metrics_connections(MetricsBuffer *m)
+{
+	Client *client;
+	int users = 0, servers = 0, unknown = 0, sendq_clients = 0;
+	unsigned long long sendq = 0, recvq = 0;
+
+	list_for_each_entry(client, &lclient_list, lclient_node)
+	{
+		/* Local servers are in lclient_list too, they are counted below */
+		if (!IsUser(client))
+			continue;
+		users++;
+		if (DBufLength(&client->local->sendQ))
+			sendq_clients++;
+		sendq += DBufLength(&client->local->sendQ);
+		recvq += DBufLength(&client->local->recvQ);
+	}
+	list_for_each_entry(client, &server_list, special_node)
+	{
+		servers++;
+		if (DBufLength(&client->local->sendQ))
+			sendq_clients++;
+		sendq += DBufLength(&client->local->sendQ);
+		recvq += DBufLength(&client->local->recvQ);
+	}
+	list_for_each_entry(client, &unknown_list, lclient_node)
+		unknown++;
+
+	metrics_header(m, "connections", "gauge", "Number of local connections.");
+	metrics_add(m, "unrealircd_connections{type=\"user\"} %d\n", users);
+	metrics_add(m, "unrealircd_connections{type=\"server\"} %d\n", servers);
+	metrics_add(m, "unrealircd_connections{type=\"unknown\"} %d\n", unknown);
+	metrics_header(m, "sendq_connections", "gauge", "Number of users and servers with a non-empty send queue.");
+	metrics_add(m, "unrealircd_sendq_connections %d\n", sendq_clients);
+	metrics_header(m, "sendq_bytes", "gauge", "Bytes in the send queues of users and servers.");
+	metrics_add(m, "unrealircd_sendq_bytes %llu\n", sendq);
+	metrics_header(m, "recvq_bytes", "gauge", "Bytes in the receive queues of users and servers.");
+	metrics_add(m, "unrealircd_recvq_bytes %llu\n", recvq);
+}
+
+/** Build the complete metrics response body */
+static void metrics_build(MetricsBuffer *m)
+{
+	mp_pool_stats_t st;
+	int i;
+
+	metrics_header(m, "uptime_seconds", "gauge", "Seconds since the server was started.");
+	metrics_add(m, "unrealircd_uptime_seconds %lld\n", (long long)(TStime() - me.local->since));
+
+	metrics_header(m, "loop_iterations_total", "counter", "Number of main loop iterations.");
+	metrics_add(m, "unrealircd_loop_iterations_total %llu\n", loopstats.iterations);
+	metrics_time_histogram(m, "loop_iteration_seconds",
+		"Time of one main loop iteration, excluding the time waiting for I/O.",
+		&loopstats.iteration_time);
+	metrics_time_histogram(m, "loop_io_wait_seconds",
+		"Time spent waiting for I/O per main loop iteration.",
+		&loopstats.io_wait_time);
+	metrics_time_histogram(m, "loop_io_seconds",
+		"Time spent in read and write callbacks per main loop iteration.",
+		&loopstats.io_time);
+	metrics_time_histogram(m, "loop_events_seconds",
+		"Time spent in timed events (DoEvents).",
+		&loopstats.events_time);
+	metrics_time_histogram(m, "loop_process_clients_seconds",
+		"Time spent processing queued client data (process_clients).",
+		&loopstats.process_clients_time);
+	metrics_count_histogram(m, "loop_fd_events",
+		"Number of file descriptors with events per wakeup.",
+		&loopstats.fd_events);
+
+	metrics_header(m, "io_callbacks_total", "counter", "Number of I/O callbacks called.");
+	metrics_add(m, "unrealircd_io_callbacks_total{type=\"read\"} %llu\n", loopstats.read_callbacks);
+	metrics_add(m, "unrealircd_io_callbacks_total{type=\"write\"} %llu\n", loopstats.write_callbacks);
+
+	metrics_header(m, "received_bytes_total", "counter", "Bytes received from all connections.");
+	metrics_add(m, "unrealircd_received_bytes_total %llu\n",
+		(unsigned long long)me.local->receiveK * 1024 + me.local->receiveB);
+	metrics_header(m, "sent_bytes_total", "counter", "Bytes sent to all connections.");
+	metrics_add(m, "unrealircd_sent_bytes_total %llu\n",
+		(unsigned long long)me.local->sendK * 1024 + me.local->sendB);
+	metrics_header(m, "received_messages_total", "counter", "Messages received from all connections.");
+	metrics_add(m, "unrealircd_received_messages_total %llu\n", (unsigned long long)me.local->receiveM);
+	metrics_header(m, "sent_messages_total", "counter", "Messages sent to all connections.");
+	metrics_add(m, "unrealircd_sent_messages_total %llu\n", (unsigned long long)me.local->sendM);
+
+	metrics_connections(m);
+
+	if (!mp_pool_stats(0, &st))
+		return; /* Memory pools are disabled in this build */
+
+	metrics_header(m, "pool_items_used", "gauge", "Items in use in a memory pool.");
+	for (i = 0; mp_pool_stats(i, &st); i++)
+		metrics_add(m, "unrealircd_pool_items_used{pool=\"%s\"} %llu\n",
+			st.name ? st.name : "-", (unsigned long long)st.items_used);
+	metrics_header(m, "pool_items_capacity", "gauge", "Items that fit in the chunks of a memory pool.");
+	for (i = 0; mp_pool_stats(i, &st); i++)
+		metrics_add(m, "unrealircd_pool_items_capacity{pool=\"%s\"} %llu\n",
+			st.name ? st.name : "-", (unsigned long long)st.items_capacity);
+	metrics_header(m, "pool_bytes", "gauge", "Bytes allocated for a memory pool.");
+	for (i = 0; mp_pool_stats(i, &st); i++)
+		metrics_add(m, "unrealircd_pool_bytes{pool=\"%s\"} %llu\n",
+			st.name ? st.name : "-", (unsigned long long)st.bytes_allocated);
+}
+
+/** Send a HTTP response and close the connection */
+static void metrics_respond(Client *client, const char *status, char *body, int bodylen)
+{
+	char hdr[256];
+
+	snprintf(hdr, sizeof(hdr),
+		"HTTP/1.0 %s\r\n"
+		"Content-Type: text/plain; version=0.0.4; charset=utf-8\r\n"
+		"Content-Length: %d\r\n"
+		"Connection: close\r\n"
+		"\r\n",
+		status, bodylen);
+	dbuf_put(&client->local->sendQ, hdr, strlen(hdr));
+	dbuf_put(&client->local->sendQ, body, bodylen);
+	send_queued(client);
+
+	/* If everything was sent we can close the connection now.
+	 * Otherwise the remainder is sent as usual, and the HTTP client
+	 * closes the connection once it has read Content-Length bytes.
+	 */
+	if (!DBufLength(&client->local->sendQ))
+		dead_socket(client, "Metrics sent");
+}
+
+int metrics_packet_in(Client *client, char *readbuf, int *length)
+{
+	static char buf[METRICS_BUFSIZE];
+	MetricsBuffer m;
+	char request[128], *p;
+	int n;
+
+	if (!IsMetricsClient(client))
+		return 1;
+
+	/* Never parse anything as IRC. Ignore anything that is sent
+	 * while the previous response is still being sent.
+	 */
+	if (IsDeadSocket(client) || DBufLength(&client->local->sendQ))
+		return -1;
+
+	/* Only the request line matters, the rest of the request is ignored */
+	n = MIN(*length, sizeof(request) - 1);
+	memcpy(request, readbuf, n);
+	request[n] = '\0';
+	p = strpbrk(request, "\r\n");
+	if (p)
+		*p = '\0';
+
+	if (strncmp(request, "GET ", 4))
+	{
+		char *msg = "Only GET requests are supported\n";
+		metrics_respond(client, "405 Method Not Allowed", msg, strlen(msg));
+		return -1;
+	}
+
+	p = strchr(request, ' ') + 1;
+	if (strncmp(p, "/ ", 2) && strncmp(p, "/metrics ", 9) && strncmp(p, "/metrics?", 9))
+	{
+		char *msg = "Not found, use /metrics\n";
+		metrics_respond(client, "404 Not Found", msg, strlen(msg));
+		return -1;
+	}
+
+	m.buf = buf;
+	m.len = 0;
+	*buf = '\0';
+	metrics_build(&m);
+	metrics_respond(client, "200 OK", m.buf, m.len);
+	return -1;
+}
@@ -1842,7 +1842,7 @@ CMD_FUNC(_cmd_umode)
 				client->name, client->user->virthost);
 
 		/* Set the vhost */
-		safe_strdup(client->user->virthost, client->user->cloakedhost);
+		scache_set(&client->user->virthost, client->user->cloakedhost);
 
 		/* Notify */
 		userhost_changed(client);
@@ -1857,7 +1857,7 @@ CMD_FUNC(_cmd_umode)
 		 * for ban-checking... free+recreate here because it could have
 		 * been a vhost for example. -- Syzop
 		 */
-		safe_strdup(client->user->virthost, client->user->cloakedhost);
+		scache_set(&client->user->virthost, client->user->cloakedhost);
 
 		/* Notify */
 		userhost_changed(client);
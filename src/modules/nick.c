@@ -918,12 +918,13 @@ int _register_user(Client *client, char *nick, char *username, char *umode, char
 		strlcpy(user->username, username, USERLEN+1);
 	}
 	SetUser(client);
+	burst_register_user(client);
 	irccounts.clients++;
 	if (client->srvptr && client->srvptr->serv)
 		client->srvptr->serv->users++;
 
 	make_cloakedhost(client, user->realhost, user->cloakedhost, sizeof(user->cloakedhost));
-	safe_strdup(user->virthost, user->cloakedhost);
+	scache_set(&user->virthost, user->cloakedhost);
 
 	if (MyConnect(client))
 	{
@@ -1065,14 +1066,14 @@ int _register_user(Client *client, char *nick, char *username, char *umode, char
 				exit_client(client, NULL, "USER with invalid IP");
 				return 0;
 			}
-			safe_strdup(client->ip, ipstring);
+			scache_set(&client->ip, ipstring);
 		}
 
 		/* For remote clients we recalculate the cloakedhost here because
 		 * it may depend on the IP address (bug #5064).
 		 */
 		make_cloakedhost(client, user->realhost, user->cloakedhost, sizeof(user->cloakedhost));
-		safe_strdup(user->virthost, user->cloakedhost);
+		scache_set(&user->virthost, user->cloakedhost);
 
 		/* Set the umodes */
 		tkllayer[0] = nick;
@@ -1085,7 +1086,7 @@ int _register_user(Client *client, char *nick, char *username, char *umode, char
 
 		/* Set the vhost */
 		if (virthost && *virthost != '*')
-			safe_strdup(client->user->virthost, virthost);
+			scache_set(&client->user->virthost, virthost);
 	}
 
 	hash_check_watch(client, RPL_LOGON);	/* Uglier hack */
@@ -1285,7 +1286,7 @@ int exceeds_maxperip(Client *client, ConfigItem_allow *aconf)
 
 	list_for_each_entry(acptr, &lclient_list, lclient_node)
 	{
-		if (IsUser(acptr) && !strcmp(GetIP(acptr), GetIP(client)))
+		if (IsUser(acptr) && (acptr->ip == client->ip)) /* interned, see scache_add() */
 		{
 			cnt++;
 			if (cnt > aconf->maxperip)
@@ -225,6 +225,7 @@ CMD_FUNC(cmd_oper)
 
 	/* Store which oper block was used to become IRCOp (for maxlogins and whois) */
 	safe_strdup(client->user->operlogin, operblock->name);
+	OperClassPermissionsReset(client);
 
 	/* Put in the right class */
 	if (client->local->class)
@@ -255,7 +256,7 @@ CMD_FUNC(cmd_oper)
 	if (IsHidden(client) && !client->user->virthost)
 	{
 		/* +x has just been set by modes-on-oper and no vhost. cloak the oper! */
-		safe_strdup(client->user->virthost, client->user->cloakedhost);
+		scache_set(&client->user->virthost, client->user->cloakedhost);
 	}
 
 	sendto_snomask_global(SNO_OPER,
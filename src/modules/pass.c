@@ -79,8 +79,9 @@ int _check_banned(Client *client, int exitflags)
 		banned_client(client, "Z-Lined", tk->ptr.serverban->reason, (tk->type & TKL_GLOBAL)?1:0, exitflags);
 		return 1;
 	}
-	else
+	else if (!IsMetricsListener(client->local->listener))
 	{
+		/* Not for metrics listeners, a scraper reconnects every few seconds */
 		int val;
 		char zlinebuf[512];
 
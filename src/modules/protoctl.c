@@ -114,6 +114,30 @@ CMD_FUNC(cmd_protoctl)
 		{
 			SetMTAGS(client);
 		}
+		else if (!strcmp(name, "ZIP"))
+		{
+			/* Only for server links, otherwise anyone could make us
+			 * decompress their input (think: decompression bombs).
+			 */
+			if (!IsServer(client) && !IsEAuth(client) && !IsHandshake(client))
+				continue;
+			if (!value)
+			{
+				/* Other side can decompress */
+				SetZIP(client);
+			}
+			else if (!strcmp(value, "START"))
+			{
+				/* Everything after this line is compressed */
+#ifdef HAVE_ZLIB
+				if (!zip_start_in(client))
+					return;
+#else
+				exit_client(client, NULL, "Got PROTOCTL ZIP=START but this server does not support compressed links");
+				return;
+#endif
+			}
+		}
 		else if (!strcmp(name, "NICKCHARS") && value)
 		{
 			if (!IsServer(client) && !IsEAuth(client) && !IsHandshake(client))
@@ -17,37 +17,32 @@
 
 #include "unrealircd.h"
 
-#define REPUTATION_VERSION "1.2"
+#define REPUTATION_VERSION "1.3"
 
 #undef TEST
 
 #undef BENCHMARK
-/* Benchmark results (2GHz Xeon Skylake, compiled with -O2, Linux):
- * 10k random IP's with various expire times:
- * - load db:  23 ms
- * - expiry:    1 ms
- * - save db:   7 ms
- * 100k random IP's with various expire times:
- * - load db: 103 ms
- * - expiry:   10 ms
- * - save db:  32 ms
- * So, even for 100,000 unique IP's, the initial load of the database
- * would delay the UnrealIRCd boot process only for 0.1 second.
- * The writing of the db, which happens every 5 minutes, for such
- * amount of IP's takes 32ms (0.03 second).
- * Of course, exact figures will depend on the storage and cache.
- * That being said, the file for 100k random IP's is slightly under
- * 3MB, so not big, which likely means the timing will be similar
- * for a broad number of (storage) systems.
+/* With BENCHMARK defined the time it takes to load the db, expire
+ * entries and save the db is logged. Some notes on the design:
+ * The entries are fixed-size records in an open addressing hash
+ * table, with the IP address stored in binary form. The database
+ * consists of the same fixed-size records. When saving, only
+ * the entries that changed since the last save are appended to the
+ * database file. Only when the file has grown to more than twice
+ * the number of entries the file is rewritten entirely.
+ * Expired entries are removed when they are looked up and by a
+ * sweep that walks a small part of the hash table each time.
  */
  
 #ifndef TEST
  #define BUMP_SCORE_EVERY	300
  #define DELETE_OLD_EVERY	605
+ #define DELETE_OLD_STEP_EVERY	11
  #define SAVE_DB_EVERY		902
 #else
  #define BUMP_SCORE_EVERY 	3
  #define DELETE_OLD_EVERY	3
+ #define DELETE_OLD_STEP_EVERY	1
  #define SAVE_DB_EVERY		3
 #endif
 
@@ -72,8 +67,11 @@ ModuleHeader MOD_HEADER
 
 #define UPDATE_SCORE_MARGIN 1
 
+/** Initial number of slots in the hash table (must be a power of 2) */
 #define REPUTATION_HASH_TABLE_SIZE 2048
 
+#define REPUTATION_DB_MAGIC "REPDB2\n"
+
 #define Reputation(client)	moddata_client(client, reputation_md).l
 
 /* Definitions (structs, etc.) */
@@ -86,12 +84,38 @@ struct cfgstruct {
 
 typedef struct ReputationEntry ReputationEntry;
 
+/** A slot in the reputation hash table (open addressing, linear probing) */
 struct ReputationEntry {
-	ReputationEntry *prev, *next;
-	unsigned short score; /**< score for the user */
+	unsigned char ip[16]; /**< ip address in binary form (IPv4 is stored as an IPv4-mapped IPv6 address) */
 	long last_seen; /**< user last seen (unix timestamp) */
+	unsigned short score; /**< score for the user */
+	unsigned char used; /**< slot is in use */
+	unsigned char dirty; /**< changed since the last db write */
 	int marker; /**< internal marker, not written to db */
-	char ip[1]; /*< ip address */
+};
+
+typedef struct ReputationDBHeader ReputationDBHeader;
+
+/** Database header. It is followed by ReputationRecord's up to the end of the file. */
+struct ReputationDBHeader {
+	char magic[8]; /**< REPUTATION_DB_MAGIC */
+	int64_t starttime; /**< when recording of reputation started */
+	int64_t writtentime; /**< when the database was last written */
+	int64_t reserved;
+};
+
+typedef struct ReputationRecord ReputationRecord;
+
+/** A record in the database.
+ * Changed entries are appended to the database, so the same IP may
+ * be present multiple times. In that case the last record is the
+ * current one.
+ */
+struct ReputationRecord {
+	unsigned char ip[16];
+	int64_t last_seen;
+	uint16_t score;
+	uint16_t reserved[3];
 };
 
 /* Global variables */
@@ -100,7 +124,11 @@ static struct cfgstruct cfg; /**< Current configuration */
 long reputation_starttime = 0;
 long reputation_writtentime = 0;
 
-static ReputationEntry *ReputationHashTable[REPUTATION_HASH_TABLE_SIZE];
+static ReputationEntry *ReputationHashTable = NULL;
+static unsigned int reputation_table_size = 0; /**< number of slots (a power of 2) */
+static unsigned int reputation_count = 0; /**< number of slots in use */
+static unsigned int reputation_sweep_pos = 0; /**< where delete_old_records() continues */
+static long reputation_db_records = -1; /**< records in the db file, -1 if it needs to be rewritten entirely */
 static char siphashkey_reputation[SIPHASH_KEY_LENGTH];
 
 static ModuleInfo ModInf;
@@ -120,8 +148,10 @@ int reputation_pre_lconnect(Client *client);
 int reputation_config_test(ConfigFile *cf, ConfigEntry *ce, int type, int *errs);
 int reputation_config_run(ConfigFile *cf, ConfigEntry *ce, int type);
 int reputation_config_posttest(int *errs);
-static uint64_t hash_reputation_entry(char *ip);
-void add_reputation_entry(ReputationEntry *e);
+static uint64_t hash_reputation_entry(const unsigned char *ip);
+static void reputation_table_resize(unsigned int newsize);
+ReputationEntry *add_reputation_entry(const unsigned char *ip);
+ReputationEntry *find_reputation_entry_raw(const unsigned char *ip);
 EVENT(delete_old_records);
 EVENT(add_scores);
 EVENT(save_db_evt);
@@ -145,7 +175,7 @@ MOD_INIT()
 
 	MARK_AS_OFFICIAL_MODULE(modinfo);
 	ModuleSetOptions(modinfo->handle, MOD_OPT_PERM, 1);
-	memset(&ReputationHashTable, 0, sizeof(ReputationHashTable));
+	reputation_table_resize(REPUTATION_HASH_TABLE_SIZE);
 	siphash_generate_key(siphashkey_reputation);
 
 	memset(&mreq, 0, sizeof(mreq));
@@ -175,7 +205,7 @@ MOD_LOAD()
 	load_db();
 	if (reputation_starttime == 0)
 		reputation_starttime = TStime();
-	EventAdd(ModInf.handle, "delete_old_records", delete_old_records, NULL, DELETE_OLD_EVERY*1000, 0);
+	EventAdd(ModInf.handle, "delete_old_records", delete_old_records, NULL, DELETE_OLD_STEP_EVERY*1000, 0);
 	EventAdd(ModInf.handle, "add_scores", add_scores, NULL, BUMP_SCORE_EVERY*1000, 0);
 	EventAdd(ModInf.handle, "save_db", save_db_evt, NULL, SAVE_DB_EVERY*1000, 0);
 	return MOD_SUCCESS;
@@ -184,6 +214,8 @@ MOD_LOAD()
 MOD_UNLOAD()
 {
 	save_db();
+	safe_free(ReputationHashTable);
+	reputation_table_size = reputation_count = 0;
 	return MOD_SUCCESS;
 }
 
@@ -262,6 +294,7 @@ int reputation_config_run(ConfigFile *cf, ConfigEntry *ce, int type)
 		if (!strcmp(cep->ce_varname, "database"))
 		{
 			safe_strdup(cfg.database, cep->ce_vardata);
+			reputation_db_records = -1; /* (possibly) another file, write it entirely */
 		}
 	}
 	return 1;
@@ -275,7 +308,40 @@ int reputation_config_posttest(int *errs)
 	return errors ? -1 : 1;
 }
 
-/** Parse database header and set variables appropriately */
+/** Convert an IP address to the binary form that is used in the hash table
+ * and the database. IPv4 addresses are stored as IPv4-mapped IPv6 addresses.
+ * @returns 1 on success, 0 if the IP address is invalid.
+ */
+static int reputation_ip_to_binary(const char *ip, unsigned char *out)
+{
+	memset(out, 0, 16);
+	if (inet_pton(AF_INET6, ip, out) == 1)
+		return 1;
+	memset(out, 0, 16);
+	if (inet_pton(AF_INET, ip, out + 12) == 1)
+	{
+		out[10] = out[11] = 0xff;
+		return 1;
+	}
+	return 0;
+}
+
+#ifdef DEBUGMODE
+/** Convert a binary IP address back to a string (for logging) */
+static char *reputation_ip_to_string(const unsigned char *ip)
+{
+	static char buf[64];
+	static const unsigned char v4mapped[12] = { 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0xff, 0xff };
+
+	if (!memcmp(ip, v4mapped, sizeof(v4mapped)))
+		inet_ntop(AF_INET, (void *)(ip + 12), buf, sizeof(buf));
+	else
+		inet_ntop(AF_INET6, (void *)ip, buf, sizeof(buf));
+	return buf;
+}
+#endif
+
+/** Parse database header and set variables appropriately (old text format) */
 int parse_db_header(char *buf)
 {
 	char *header=NULL, *version=NULL, *starttime=NULL, *writtentime=NULL;
@@ -306,28 +372,17 @@ int parse_db_header(char *buf)
 	return 1;
 }
 
-void load_db(void)
+/** Load a database in the old text format (version 1).
+ * It will be converted to the binary format on the next write.
+ */
+static void load_db_text(FILE *fd)
 {
-	FILE *fd;
 	char buf[512], *p;
-#ifdef BENCHMARK
-	struct timeval tv_alpha, tv_beta;
 
-	gettimeofday(&tv_alpha, NULL);
-#endif
-
-	fd = fopen(cfg.database, "r");
-	if (!fd)
-	{
-		config_warn("WARNING: Could not open/read database '%s': %s", cfg.database, strerror(ERRNO));
-		return;
-	}
-	
 	memset(buf, 0, sizeof(buf));
 	if (fgets(buf, 512, fd) == NULL)
 	{
 		config_error("WARNING: Database file corrupt ('%s')", cfg.database);
-		fclose(fd);
 		return;
 	}
 	
@@ -345,13 +400,13 @@ void load_db(void)
 		             "Database corrupt? Or are you downgrading from a newer "
 		             "UnrealIRCd version perhaps? This is not supported.",
 		             cfg.database);
-		fclose(fd);
 		return;
 	}
 
 	while(fgets(buf, 512, fd) != NULL)
 	{
 		char *ip = NULL, *score = NULL, *last_seen = NULL;
+		unsigned char binip[16];
 		ReputationEntry *e;
 		
 		stripcrlf(buf);
@@ -365,13 +420,66 @@ void load_db(void)
 		last_seen = strtoken(&p, NULL, " ");
 		if (!last_seen)
 			continue;
+		if (!reputation_ip_to_binary(ip, binip))
+			continue;
 		
-		e = safe_alloc(sizeof(ReputationEntry)+strlen(ip));
-		strcpy(e->ip, ip); /* safe, see alloc above */
+		e = find_reputation_entry_raw(binip);
+		if (!e)
+			e = add_reputation_entry(binip);
 		e->score = atoi(score);
 		e->last_seen = atol(last_seen);
-		
-		add_reputation_entry(e);
+	}
+	reputation_db_records = -1;
+}
+
+/** Load a database in the binary format */
+static void load_db_binary(FILE *fd, ReputationDBHeader *hdr)
+{
+	ReputationRecord rec;
+	ReputationEntry *e;
+
+	reputation_starttime = hdr->starttime;
+	reputation_writtentime = hdr->writtentime;
+	reputation_db_records = 0;
+
+	/* A partial record at the end (crash during write) is ignored,
+	 * it will be overwritten by the next write.
+	 */
+	while (fread(&rec, sizeof(rec), 1, fd) == 1)
+	{
+		reputation_db_records++;
+		e = find_reputation_entry_raw(rec.ip);
+		if (!e)
+			e = add_reputation_entry(rec.ip);
+		e->score = rec.score;
+		e->last_seen = rec.last_seen;
+		e->dirty = 0;
+	}
+}
+
+void load_db(void)
+{
+	FILE *fd;
+	ReputationDBHeader hdr;
+#ifdef BENCHMARK
+	struct timeval tv_alpha, tv_beta;
+
+	gettimeofday(&tv_alpha, NULL);
+#endif
+
+	fd = fopen(cfg.database, "rb");
+	if (!fd)
+	{
+		config_warn("WARNING: Could not open/read database '%s': %s", cfg.database, strerror(ERRNO));
+		return;
+	}
+
+	if ((fread(&hdr, sizeof(hdr), 1, fd) == 1) && !memcmp(hdr.magic, REPUTATION_DB_MAGIC, sizeof(hdr.magic)))
+	{
+		load_db_binary(fd, &hdr);
+	} else {
+		rewind(fd);
+		load_db_text(fd);
 	}
 	fclose(fd);
 
@@ -382,47 +490,80 @@ void load_db(void)
 #endif
 }
 
-void save_db(void)
+/** Is this entry expired? */
+static inline int is_reputation_expired(ReputationEntry *e)
+{
+	int i;
+	for (i = 0; i < MAXEXPIRES; i++)
+	{
+		if (cfg.expire_time[i] == 0)
+			break; /* end of all entries */
+		if ((e->score <= cfg.expire_score[i]) && (TStime() - e->last_seen > cfg.expire_time[i]))
+			return 1;
+	}
+	return 0;
+}
+
+static int write_db_header(FILE *fd)
+{
+	ReputationDBHeader hdr;
+
+	memset(&hdr, 0, sizeof(hdr));
+	memcpy(hdr.magic, REPUTATION_DB_MAGIC, sizeof(hdr.magic));
+	hdr.starttime = reputation_starttime;
+	hdr.writtentime = TStime();
+	return fwrite(&hdr, sizeof(hdr), 1, fd) == 1;
+}
+
+static int write_db_record(FILE *fd, ReputationEntry *e)
+{
+	ReputationRecord rec;
+
+	memset(&rec, 0, sizeof(rec));
+	memcpy(rec.ip, e->ip, sizeof(rec.ip));
+	rec.last_seen = e->last_seen;
+	rec.score = e->score;
+	e->dirty = 0;
+	return fwrite(&rec, sizeof(rec), 1, fd) == 1;
+}
+
+/** Write the entire database to a new file (skipping expired entries) */
+static void save_db_full(void)
 {
 	FILE *fd;
 	char tmpfname[512];
-	int i;
+	unsigned int i;
+	long records = 0;
 	ReputationEntry *e;
-#ifdef BENCHMARK
-	struct timeval tv_alpha, tv_beta;
 
-	gettimeofday(&tv_alpha, NULL);
-#endif
-	
-#ifdef TEST
-	sendto_realops("REPUTATION IS RUNNING IN TEST MODE. SAVING DB'S...");
-#endif
+	reputation_db_records = -1;
 
 	/* We write to a temporary file. Only to rename it later if everything was ok */
 	snprintf(tmpfname, sizeof(tmpfname), "%s.tmp", cfg.database);
 	
-	fd = fopen(tmpfname, "w");
+	fd = fopen(tmpfname, "wb");
 	if (!fd)
 	{
 		config_error("ERROR: Could not open/write database '%s': %s -- DATABASE *NOT* SAVED!!!", tmpfname, strerror(ERRNO));
 		return;
 	}
 
-	if (fprintf(fd, "REPDB 1 %lld %lld\n", (long long)reputation_starttime, (long long)TStime()) < 0)
+	if (!write_db_header(fd))
 		goto write_fail;
 
-	for (i = 0; i < REPUTATION_HASH_TABLE_SIZE; i++)
+	for (i = 0; i < reputation_table_size; i++)
 	{
-		for (e = ReputationHashTable[i]; e; e = e->next)
+		e = &ReputationHashTable[i];
+		if (!e->used || is_reputation_expired(e))
+			continue;
+		if (!write_db_record(fd, e))
 		{
-			if (fprintf(fd, "%s %d %lld\n", e->ip, (int)e->score, (long long)e->last_seen) < 0)
-			{
 write_fail:
-				config_error("ERROR writing to '%s': %s -- DATABASE *NOT* SAVED!!!", tmpfname, strerror(ERRNO));
-				fclose(fd);
-				return;
-			}
+			config_error("ERROR writing to '%s': %s -- DATABASE *NOT* SAVED!!!", tmpfname, strerror(ERRNO));
+			fclose(fd);
+			return;
 		}
+		records++;
 	}
 
 	if (fclose(fd) < 0)
@@ -445,39 +586,187 @@ write_fail:
 		return;
 	}
 
+	reputation_db_records = records;
 	reputation_writtentime = TStime();
+}
+
+/** Append the entries that changed since the last write to the database */
+static void save_db_incremental(void)
+{
+	FILE *fd;
+	unsigned int i;
+	long records = 0;
+	ReputationEntry *e;
+
+	fd = fopen(cfg.database, "r+b");
+	if (!fd)
+	{
+		save_db_full();
+		return;
+	}
+
+	/* Update the header, then continue after the last complete record */
+	if (!write_db_header(fd) ||
+	    fseek(fd, sizeof(ReputationDBHeader) + reputation_db_records * sizeof(ReputationRecord), SEEK_SET) < 0)
+	{
+		goto write_fail;
+	}
+
+	for (i = 0; i < reputation_table_size; i++)
+	{
+		e = &ReputationHashTable[i];
+		if (!e->used || !e->dirty)
+			continue;
+		if (!write_db_record(fd, e))
+		{
+write_fail:
+			config_error("ERROR writing to '%s': %s -- will try to write the entire database next time",
+				cfg.database, strerror(ERRNO));
+			fclose(fd);
+			reputation_db_records = -1;
+			return;
+		}
+		records++;
+	}
+
+	if (fclose(fd) < 0)
+	{
+		config_error("ERROR writing to '%s': %s -- will try to write the entire database next time",
+			cfg.database, strerror(ERRNO));
+		reputation_db_records = -1;
+		return;
+	}
+
+	reputation_db_records += records;
+	reputation_writtentime = TStime();
+}
+
+void save_db(void)
+{
+#ifdef BENCHMARK
+	struct timeval tv_alpha, tv_beta;
+
+	gettimeofday(&tv_alpha, NULL);
+#endif
+	
+#ifdef TEST
+	sendto_realops("REPUTATION IS RUNNING IN TEST MODE. SAVING DB'S...");
+#endif
+
+	/* Rewrite the file if it contains too many outdated records */
+	if ((reputation_db_records < 0) || (reputation_db_records > (long)reputation_count * 2 + 1024))
+		save_db_full();
+	else
+		save_db_incremental();
 
 #ifdef BENCHMARK
 	gettimeofday(&tv_beta, NULL);
 	ircd_log(LOG_ERROR, "Reputation benchmark: SAVE DB: %lld microseconds",
 		(long long)(((tv_beta.tv_sec - tv_alpha.tv_sec) * 1000000) + (tv_beta.tv_usec - tv_alpha.tv_usec)));
 #endif
+}
 
-	return;
+static uint64_t hash_reputation_entry(const unsigned char *ip)
+{
+	return siphash_raw((const char *)ip, 16, siphashkey_reputation);
 }
 
-static uint64_t hash_reputation_entry(char *ip)
+/** Find the slot for this IP: either the slot that has it or the free slot where it would go */
+static ReputationEntry *reputation_slot(const unsigned char *ip)
 {
-	return siphash(ip, siphashkey_reputation) % REPUTATION_HASH_TABLE_SIZE;
+	unsigned int mask = reputation_table_size - 1;
+	unsigned int i = hash_reputation_entry(ip) & mask;
+
+	while (ReputationHashTable[i].used && memcmp(ReputationHashTable[i].ip, ip, 16))
+		i = (i + 1) & mask;
+
+	return &ReputationHashTable[i];
 }
 
-void add_reputation_entry(ReputationEntry *e)
+static void reputation_table_resize(unsigned int newsize)
 {
-	int hashv = hash_reputation_entry(e->ip);
+	ReputationEntry *old = ReputationHashTable;
+	unsigned int oldsize = reputation_table_size;
+	unsigned int i;
+
+	ReputationHashTable = safe_alloc(sizeof(ReputationEntry) * newsize);
+	reputation_table_size = newsize;
+	for (i = 0; i < oldsize; i++)
+		if (old[i].used)
+			*reputation_slot(old[i].ip) = old[i];
+	safe_free(old);
+	reputation_sweep_pos = 0;
+}
+
+/** Add a new entry for this IP (which must not exist yet).
+ * Note that pointers to other entries are invalidated by this.
+ */
+ReputationEntry *add_reputation_entry(const unsigned char *ip)
+{
+	ReputationEntry *e;
+
+	/* Keep the load factor below 70% */
+	if ((reputation_count + 1) * 10 > reputation_table_size * 7)
+		reputation_table_resize(reputation_table_size * 2);
 
-	AddListItem(e, ReputationHashTable[hashv]);
+	e = reputation_slot(ip);
+	memcpy(e->ip, ip, sizeof(e->ip));
+	e->used = 1;
+	e->dirty = 1;
+	reputation_count++;
+	return e;
+}
+
+/** Delete the entry. Entries that follow it in the same probe
+ * sequence are moved back, so no tombstones are needed.
+ */
+static void delete_reputation_entry(ReputationEntry *e)
+{
+	unsigned int mask = reputation_table_size - 1;
+	unsigned int i = e - ReputationHashTable;
+	unsigned int j = i, k;
+
+	while (1)
+	{
+		j = (j + 1) & mask;
+		if (!ReputationHashTable[j].used)
+			break;
+		k = hash_reputation_entry(ReputationHashTable[j].ip) & mask;
+		/* Leave it if its home slot 'k' is (cyclically) in (i, j] */
+		if ((i <= j) ? ((i < k) && (k <= j)) : ((i < k) || (k <= j)))
+			continue;
+		ReputationHashTable[i] = ReputationHashTable[j];
+		i = j;
+	}
+	memset(&ReputationHashTable[i], 0, sizeof(ReputationEntry));
+	reputation_count--;
+}
+
+/** Find the entry for this binary IP address, deleting it if it is expired */
+ReputationEntry *find_reputation_entry_raw(const unsigned char *ip)
+{
+	ReputationEntry *e = reputation_slot(ip);
+
+	if (!e->used)
+		return NULL;
+
+	if (is_reputation_expired(e))
+	{
+		delete_reputation_entry(e);
+		return NULL;
+	}
+
+	return e;
 }
 
 ReputationEntry *find_reputation_entry(char *ip)
 {
-	ReputationEntry *e;
-	int hashv = hash_reputation_entry(ip);
+	unsigned char binip[16];
 
-	for (e = ReputationHashTable[hashv]; e; e = e->next)
-		if (!strcmp(e->ip, ip))
-			return e;
+	if (!reputation_ip_to_binary(ip, binip))
+		return NULL;
 
-	return NULL;
+	return find_reputation_entry_raw(binip);
 }
 
 int reputation_lookup_score_and_set(Client *client)
@@ -531,7 +820,7 @@ int reputation_pre_lconnect(Client *client)
 EVENT(add_scores)
 {
 	static int marker = 0;
-	char *ip;
+	unsigned char binip[16];
 	Client *client;
 	ReputationEntry *e;
 
@@ -552,17 +841,14 @@ EVENT(add_scores)
 		if (!IsUser(client))
 			continue; /* skip servers, unknowns, etc.. */
 
-		ip = client->ip;
-		if (!ip)
+		if (!client->ip || !reputation_ip_to_binary(client->ip, binip))
 			continue;
 
-		e = find_reputation_entry(ip);
+		e = find_reputation_entry_raw(binip);
 		if (!e)
 		{
 			/* Create */
-			e = safe_alloc(sizeof(ReputationEntry)+strlen(ip));
-			strcpy(e->ip, ip); /* safe, allocated above */
-			add_reputation_entry(e);
+			e = add_reputation_entry(binip);
 		}
 
 		/* If this is not a duplicate entry, then bump the score.. */
@@ -596,50 +882,40 @@ EVENT(add_scores)
 		}
 
 		e->last_seen = TStime();
+		e->dirty = 1;
 		Reputation(client) = e->score; /* update moddata */
 	}
 }
 
-/** Is this entry expired? */
-static inline int is_reputation_expired(ReputationEntry *e)
-{
-	int i;
-	for (i = 0; i < MAXEXPIRES; i++)
-	{
-		if (cfg.expire_time[i] == 0)
-			break; /* end of all entries */
-		if ((e->score <= cfg.expire_score[i]) && (TStime() - e->last_seen > cfg.expire_time[i]))
-			return 1;
-	}
-	return 0;
-}
-
+/** Delete expired entries.
+ * Each run only looks at a part of the hash table, so that the
+ * entire table is walked roughly once every DELETE_OLD_EVERY seconds.
+ */
 EVENT(delete_old_records)
 {
-	int i;
-	ReputationEntry *e, *e_next;
+	unsigned int todo = reputation_table_size / (DELETE_OLD_EVERY / DELETE_OLD_STEP_EVERY) + 1;
+	ReputationEntry *e;
 #ifdef BENCHMARK
 	struct timeval tv_alpha, tv_beta;
 
 	gettimeofday(&tv_alpha, NULL);
 #endif
 	
-	for (i = 0; i < REPUTATION_HASH_TABLE_SIZE; i++)
+	for (; todo > 0; todo--)
 	{
-		for (e = ReputationHashTable[i]; e; e = e_next)
+		if (reputation_sweep_pos >= reputation_table_size)
+			reputation_sweep_pos = 0;
+		e = &ReputationHashTable[reputation_sweep_pos];
+		if (e->used && is_reputation_expired(e))
 		{
-			e_next = e->next;
-			
-			if (is_reputation_expired(e))
-			{
 #ifdef DEBUGMODE
-				ircd_log(LOG_ERROR, "Deleting expired entry for '%s' (score %hd, last seen %lld seconds ago)",
-				         e->ip, e->score, (long long)(TStime() - e->last_seen));
+			ircd_log(LOG_ERROR, "Deleting expired entry for '%s' (score %hd, last seen %lld seconds ago)",
+			         reputation_ip_to_string(e->ip), e->score, (long long)(TStime() - e->last_seen));
 #endif
-				DelListItem(e, ReputationHashTable[i]);
-				safe_free(e);
-			}
+			delete_reputation_entry(e);
+			continue; /* another entry may have moved into this slot */
 		}
+		reputation_sweep_pos++;
 	}
 
 #ifdef BENCHMARK
@@ -671,15 +947,7 @@ CMD_FUNC(reputationunperm)
 
 int count_reputation_records(void)
 {
-	int i;
-	ReputationEntry *e;
-	int total = 0;
-
-	for (i = 0; i < REPUTATION_HASH_TABLE_SIZE; i++)
-		for (e = ReputationHashTable[i]; e; e = e->next)
-			total++;
-
-	return total;
+	return reputation_count;
 }
 
 void reputation_channel_query(Client *client, Channel *channel)
@@ -809,6 +1077,8 @@ CMD_FUNC(reputation_user_cmd)
 			sendnotice(client, "Last successful db write: never");
 		}
 		sendnotice(client, "Current number of records (IP's): %d", count_reputation_records());
+		if (reputation_db_records >= 0)
+			sendnotice(client, "Number of records in the database file: %ld", reputation_db_records);
 		sendnotice(client, "-");
 		sendnotice(client, "Available commands:");
 		sendnotice(client, "/REPUTATION [nick]     Show reputation info about nick name");
@@ -910,6 +1180,7 @@ CMD_FUNC(reputation_server_cmd)
 {
 	ReputationEntry *e;
 	char *ip;
+	unsigned char binip[16];
 	int score;
 	int allow_reply;
 
@@ -956,20 +1227,19 @@ CMD_FUNC(reputation_server_cmd)
 			ip, client->name, score, e->score, score);
 #endif
 		e->score = score;
+		e->dirty = 1;
 	}
 
 	/* If we don't have any entry for this IP, add it now. */
-	if (!e && (score > 0))
+	if (!e && (score > 0) && reputation_ip_to_binary(ip, binip))
 	{
 #ifdef DEBUGMODE
 		ircd_log(LOG_ERROR, "[reputation] Score for '%s' from %s is %d, we had no entry, adding it",
 			ip, client->name, score);
 #endif
-		e = safe_alloc(sizeof(ReputationEntry)+strlen(ip));
-		strcpy(e->ip, ip); /* safe, see alloc above */
+		e = add_reputation_entry(binip);
 		e->score = score;
 		e->last_seen = TStime();
-		add_reputation_entry(e);
 	}
 
 	/* Propagate to the non-client direction (score may be updated) */
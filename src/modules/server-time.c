@@ -88,7 +88,7 @@ void mtag_add_or_inherit_time(Client *sender, MessageTag *recv_mtags, MessageTag
 	MessageTag *m = find_mtag(recv_mtags, "time");
 	if (m)
 	{
-		m = duplicate_mtag(m);
+		m = new_mtag(m->name, m->value);
 	} else
 	{
 		struct timeval t;
@@ -108,9 +108,7 @@ void mtag_add_or_inherit_time(Client *sender, MessageTag *recv_mtags, MessageTag
 			tm->tm_sec,
 			(int)(t.tv_usec / 1000));
 
-		m = safe_alloc(sizeof(MessageTag));
-		safe_strdup(m->name, "time");
-		safe_strdup(m->value, buf);
+		m = new_mtag("time", buf);
 	}
 	AddListItem(m, *mtag_list);
 }
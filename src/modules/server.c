@@ -32,6 +32,7 @@ void _send_server_message(Client *client);
 void _introduce_user(Client *to, Client *acptr);
 int _check_deny_version(Client *cptr, char *software, int protocol, char *flags);
 void _broadcast_sinfo(Client *acptr, Client *to, Client *except);
+void _burst_continue(Client *cptr);
 
 /* Global variables */
 static char buf[BUFSIZE];
@@ -56,6 +57,7 @@ MOD_TEST()
 	EfunctionAddVoid(modinfo->handle, EFUNC_INTRODUCE_USER, _introduce_user);
 	EfunctionAdd(modinfo->handle, EFUNC_CHECK_DENY_VERSION, _check_deny_version);
 	EfunctionAddVoid(modinfo->handle, EFUNC_BROADCAST_SINFO, _broadcast_sinfo);
+	EfunctionAddVoid(modinfo->handle, EFUNC_BURST_CONTINUE, _burst_continue);
 	return MOD_SUCCESS;
 }
 
@@ -993,6 +995,13 @@ int	server_sync(Client *cptr, ConfigItem_link *aconf)
 	}
 	cptr->serv->conf->class->clients++;
 	cptr->local->class = cptr->serv->conf->class;
+
+#ifdef HAVE_ZLIB
+	/* Compress everything we send from here on, that is: the whole burst */
+	if ((cptr->serv->conf->options & CONNECT_ZIP) && SupportZIP(cptr))
+		zip_start_out(cptr);
+#endif
+
 	RunHook(HOOKTYPE_SERVER_CONNECT, cptr);
 
 	/* Broadcast new server to the rest of the network */
@@ -1041,31 +1050,17 @@ int	server_sync(Client *cptr, ConfigItem_link *aconf)
 		}
 	}
 
-	/* Synching nick information */
-	list_for_each_entry_reverse(acptr, &client_list, client_node)
-	{
-		/* acptr->direction == acptr for acptr == cptr */
-		if (acptr->direction == cptr)
-			continue;
-		if (IsUser(acptr))
-			introduce_user(cptr, acptr);
-	}
-	/*
-	   ** Last, pass all channels plus statuses
+	/* Users and channels are sent by burst_continue(), in chunks,
+	 * as fast as the other side can receive them.
 	 */
-	{
-		Channel *channel;
-		for (channel = channels; channel; channel = channel->nextch)
-		{
-			send_channel_modes_sjoin3(cptr, channel);
-			if (channel->topic_time)
-				sendto_one(cptr, NULL, "TOPIC %s %s %lld :%s",
-				    channel->chname, channel->topic_nick,
-				    (long long)channel->topic_time, channel->topic);
-			send_moddata_channel(cptr, channel);
-		}
-	}
-	
+	burst_start(cptr);
+	burst_continue(cptr);
+	return 0;
+}
+
+/** Finish the burst: send the remaining (small) items and EOS. */
+static void burst_complete(Client *cptr)
+{
 	/* Send ModData for all member(ship) structs */
 	send_moddata_members(cptr);
 	
@@ -1085,8 +1080,60 @@ int	server_sync(Client *cptr, ConfigItem_link *aconf)
 	ircd_log(LOG_ERROR, "[EOSDBG] server_sync: sending to justlinked '%s' with src ME...",
 			cptr->name);
 #endif
+	/* Now send everything that was held back during the burst */
+	burst_finish(cptr);
+
 	RunHook(HOOKTYPE_POST_SERVER_CONNECT, cptr);
-	return 0;
+}
+
+/** Send the next part of the burst to a server.
+ * This is called from server_sync() and then from send_queued()
+ * each time the sendQ of the server has (nearly) drained.
+ * It generates about BURST_CHUNK_SIZE bytes of users and channels,
+ * see src/burst.c for how the burst is kept consistent.
+ */
+void _burst_continue(Client *cptr)
+{
+	Burst *burst = cptr->local->burst;
+	long long limit;
+	Client *acptr;
+	Channel *channel;
+
+	if (!burst || burst->generating)
+		return;
+
+	burst->generating = 1;
+	limit = burst->bytes + BURST_CHUNK_SIZE;
+	while ((burst->bytes < limit) && !IsDeadSocket(cptr))
+	{
+		if (burst->phase == BURST_PHASE_USERS)
+		{
+			/* Synching nick information */
+			acptr = burst_next_user(cptr);
+			if (!acptr)
+			{
+				burst->phase = BURST_PHASE_CHANNELS;
+				continue;
+			}
+			introduce_user(cptr, acptr);
+		} else
+		{
+			/* Pass all channels plus statuses */
+			channel = burst_next_channel(cptr);
+			if (!channel)
+			{
+				burst_complete(cptr);
+				return; /* 'burst' is freed now */
+			}
+			send_channel_modes_sjoin3(cptr, channel);
+			if (channel->topic_time)
+				sendto_one(cptr, NULL, "TOPIC %s %s %lld :%s",
+				    channel->chname, channel->topic_nick,
+				    (long long)channel->topic_time, channel->topic);
+			send_moddata_channel(cptr, channel);
+		}
+	}
+	burst->generating = 0;
 }
 
 /** This will send "to" a full list of the modes for channel channel,
@@ -1180,6 +1227,10 @@ void send_channel_modes_sjoin3(Client *to, Channel *channel)
 
 	for (lp = members; lp; lp = lp->next)
 	{
+		/* During the burst, skip users the other side does not know (yet) */
+		if (to->local->burst && !burst_introduced(to, lp->client))
+			continue;
+
 		p = tbuf;
 		if (lp->flags & MODE_CHANOP)
 			*p++ = '@';
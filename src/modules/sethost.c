@@ -134,7 +134,7 @@ CMD_FUNC(cmd_sethost)
 	client->umodes |= UMODE_HIDE;
 	client->umodes |= UMODE_SETHOST;
 	/* get it in */
-	safe_strdup(client->user->virthost, vhost);
+	scache_set(&client->user->virthost, vhost);
 	/* spread it out */
 	sendto_server(client, 0, 0, NULL, ":%s SETHOST %s", client->id, parv[1]);
 
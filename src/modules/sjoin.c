@@ -245,6 +245,7 @@ CMD_FUNC(cmd_sjoin)
 		modebuf[1] = '\0';
 		parabuf[0] = '\0';
 		b = 1;
+		channel->listmode_version++;
 		while(channel->banlist)
 		{
 			Ban *ban = channel->banlist;
@@ -86,6 +86,8 @@ int stats_class(Client *, char *);
 int stats_officialchannels(Client *, char *);
 int stats_spamfilter(Client *, char *);
 int stats_fdtable(Client *, char *);
+int stats_mem(Client *, char *);
+int stats_profile(Client *, char *);
 
 #define SERVER_AS_PARA 0x1
 #define FLAGS_AS_PARA 0x2
@@ -112,6 +114,7 @@ struct statstab StatsTable[] = {
 	{ 'O', "oper",		stats_oper,		0 		},
 	{ 'P', "port",		stats_port,		0 		},
 	{ 'Q', "sqline",	stats_sqline,		FLAGS_AS_PARA 	},
+	{ 'R', "profile",	stats_profile,		0		},
 	{ 'S', "set",		stats_set,		0		},
 	{ 'T', "traffic",	stats_traffic,		0 		},
 	{ 'U', "uline",		stats_uline,		0 		},
@@ -139,6 +142,7 @@ struct statstab StatsTable[] = {
 	{ 'v', "denyver",	stats_denyver,		0 		},
 	{ 'x', "notlink",	stats_notlink,		0 		},
 	{ 'y', "class",		stats_class,		0 		},
+	{ 'z', "mem",		stats_mem,		0 		},
 	{ 0, 	NULL, 		NULL, 			0		}
 };
 
@@ -214,6 +218,7 @@ static inline void stats_help(Client *client)
 	sendnumeric(client, RPL_STATSHELP, "q - bannick - Send the ban nick block list");
 	sendnumeric(client, RPL_STATSHELP, "Q - sqline - Send the global qline list");
 	sendnumeric(client, RPL_STATSHELP, "r - chanrestrict - Send the channel deny/allow block list");
+	sendnumeric(client, RPL_STATSHELP, "R - profile - Send the time spent in commands, hooks and events");
 	sendnumeric(client, RPL_STATSHELP, "S - set - Send the set block list");
 	sendnumeric(client, RPL_STATSHELP, "s - shun - Send the shun list");
 	sendnumeric(client, RPL_STATSHELP, "  Extended flags: [+/-mrs] [mask] [reason] [setby]");
@@ -229,6 +234,7 @@ static inline void stats_help(Client *client)
 	sendnumeric(client, RPL_STATSHELP, "W - fdtable - Send the FD table listing");
 	sendnumeric(client, RPL_STATSHELP, "X - notlink - Send the list of servers that are not current linked");
 	sendnumeric(client, RPL_STATSHELP, "Y - class - Send the class block list");
+	sendnumeric(client, RPL_STATSHELP, "z - mem - Send memory usage information");
 }
 
 static inline int allow_user_stats_short(char c)
@@ -665,6 +671,134 @@ int stats_fdtable(Client *client, char *para)
 	return 0;
 }
 
+int stats_mem(Client *client, char *para)
+{
+	Client *acptr;
+	Channel *channel;
+	int users = 0, servers = 0, local = 0, other = 0;
+	long members = 0, bans = 0, away = 0;
+	unsigned long long sendq = 0, recvq = 0;
+	int whowas_count, scache_entries;
+	u_long whowas_bytes;
+	long scache_refs, scache_bytes;
+	int channel_count = 0;
+	Ban *ban;
+	mp_pool_stats_t st;
+	int i;
+
+	list_for_each_entry(acptr, &client_list, client_node)
+	{
+		if (!IsUser(acptr))
+			continue; /* unknown connections are counted below */
+		users++;
+		if (acptr->user && acptr->user->away)
+			away += strlen(acptr->user->away) + 1;
+		if (acptr->local)
+		{
+			local++;
+			sendq += DBufLength(&acptr->local->sendQ);
+			recvq += DBufLength(&acptr->local->recvQ);
+		}
+	}
+	list_for_each_entry(acptr, &global_server_list, client_node)
+	{
+		servers++;
+		if (acptr->local)
+		{
+			local++;
+			sendq += DBufLength(&acptr->local->sendQ);
+			recvq += DBufLength(&acptr->local->recvQ);
+		}
+	}
+	list_for_each_entry(acptr, &unknown_list, lclient_node)
+	{
+		other++;
+		local++;
+		recvq += DBufLength(&acptr->local->recvQ);
+	}
+
+	for (channel = channels; channel; channel = channel->nextch)
+	{
+		channel_count++;
+		members += channel->users;
+		for (ban = channel->banlist; ban; ban = ban->next)
+			bans++;
+		for (ban = channel->exlist; ban; ban = ban->next)
+			bans++;
+		for (ban = channel->invexlist; ban; ban = ban->next)
+			bans++;
+	}
+
+	count_whowas_memory(&whowas_count, &whowas_bytes);
+	scache_stats(&scache_entries, &scache_refs, &scache_bytes);
+
+	sendnumericfmt(client, RPL_STATSDEBUG,
+		"Client: %d users, %d servers, %d other, %d local. "
+		"Struct sizes: Client %d (hot part %d), LocalClient %d, ClientUser %d, Server %d",
+		users, servers, other, local,
+		(int)sizeof(Client), (int)offsetof(Client, id), (int)sizeof(LocalClient),
+		(int)sizeof(ClientUser), (int)sizeof(Server));
+	sendnumericfmt(client, RPL_STATSDEBUG,
+		"Client memory: %llu bytes (Client %llu, LocalClient %llu, ClientUser %llu, away %ld)",
+		(unsigned long long)(users + servers + other) * sizeof(Client) +
+			(unsigned long long)local * sizeof(LocalClient) +
+			(unsigned long long)users * sizeof(ClientUser) +
+			(unsigned long long)servers * sizeof(Server) + away,
+		(unsigned long long)(users + servers + other) * sizeof(Client),
+		(unsigned long long)local * sizeof(LocalClient),
+		(unsigned long long)users * sizeof(ClientUser),
+		away);
+	sendnumericfmt(client, RPL_STATSDEBUG,
+		"Channels: %d channels, %ld members, %ld bans/exempts/invex. "
+		"Approximately %llu bytes (Channel %d, Member %d, Membership %d)",
+		channel_count, members, bans,
+		(unsigned long long)channel_count * sizeof(Channel) +
+			(unsigned long long)members * (sizeof(Member) + sizeof(Membership)) +
+			(unsigned long long)bans * sizeof(Ban),
+		(int)sizeof(Channel), (int)sizeof(Member), (int)sizeof(Membership));
+	sendnumericfmt(client, RPL_STATSDEBUG,
+		"Queues: %llu bytes in sendq, %llu bytes in recvq",
+		sendq, recvq);
+	sendnumericfmt(client, RPL_STATSDEBUG,
+		"Whowas: %d entries, %lu bytes", whowas_count, whowas_bytes);
+	sendnumericfmt(client, RPL_STATSDEBUG,
+		"String cache: %d unique strings, %ld references, %ld bytes",
+		scache_entries, scache_refs, scache_bytes);
+#ifdef LOG_ASYNC
+	{
+		size_t log_size, log_used;
+		unsigned long log_queued, log_dropped;
+
+		if (log_queue_stats(&log_size, &log_used, &log_queued, &log_dropped))
+		{
+			sendnumericfmt(client, RPL_STATSDEBUG,
+				"Log queue: %lu/%lu bytes in use, %lu lines queued, %lu lines dropped",
+				(unsigned long)log_used, (unsigned long)log_size, log_queued, log_dropped);
+		} else {
+			sendnumericfmt(client, RPL_STATSDEBUG, "Log queue: not running, log files are written directly");
+		}
+	}
+#endif
+	for (i = 0; mp_pool_stats(i, &st); i++)
+	{
+		sendnumericfmt(client, RPL_STATSDEBUG,
+			"Pool %s: %llu/%llu items in use, item size %d, %d chunks, %llu bytes, %d%% unused",
+			st.name ? st.name : "-",
+			(unsigned long long)st.items_used, (unsigned long long)st.items_capacity,
+			(int)st.item_size, st.n_chunks, (unsigned long long)st.bytes_allocated,
+			st.items_capacity ? (int)(100 - (st.items_used * 100 / st.items_capacity)) : 0);
+	}
+	if (i == 0)
+		sendnumericfmt(client, RPL_STATSDEBUG, "Pools: no statistics available (memory pools are disabled in this build)");
+	return 0;
+}
+
+int stats_profile(Client *client, char *para)
+{
+	profile_report(client);
+	return 0;
+}
+
 int stats_uline(Client *client, char *para)
 {
 	ConfigItem_ulines *ulines;
@@ -1051,6 +1185,12 @@ int stats_linkinfoint(Client *client, char *para, int all)
 #else
 				pbuf);
 #endif
+#ifdef HAVE_ZLIB
+			if (acptr->local->zip)
+				sendnotice(client, "Compression for link %s: %s", acptr->name, zip_stats(acptr));
+#endif
+			if (acptr->local->burst)
+				sendnotice(client, "Burst to %s in progress: %s", acptr->name, burst_stats(acptr));
 		}
 		else if (!strchr(acptr->name, '.'))
 			sendnumericfmt(client, RPL_STATSLINKINFO, Lformat,
@@ -422,7 +422,7 @@ void do_svsmode(Client *client, MessageTag *recv_mtags, int parc, char *parv[],
 					if (target->user->virthost)
 					{
 						/* Removing mode +x and virthost set... recalculate host then (but don't activate it!) */
-						safe_strdup(target->user->virthost, target->user->cloakedhost);
+						scache_set(&target->user->virthost, target->user->cloakedhost);
 					}
 				} else
 				{
@@ -432,7 +432,7 @@ void do_svsmode(Client *client, MessageTag *recv_mtags, int parc, char *parv[],
 						/* Hmm... +x but no virthost set, that's bad... use cloakedhost.
 						 * Not sure if this could ever happen, but just in case... -- Syzop
 						 */
-						safe_strdup(target->user->virthost, target->user->cloakedhost);
+						scache_set(&target->user->virthost, target->user->cloakedhost);
 					}
 					/* Announce the new host to VHP servers if we're setting the virthost to the cloakedhost.
 					 * In other cases, we can assume that the host has been broadcasted already (after all,
@@ -461,7 +461,7 @@ void do_svsmode(Client *client, MessageTag *recv_mtags, int parc, char *parv[],
 					if (target->user->virthost && *target->user->cloakedhost && strcasecmp(target->user->cloakedhost, GetHost(target)))
 					{
 						/* Make the change effective: */
-						safe_strdup(target->user->virthost, target->user->cloakedhost);
+						scache_set(&target->user->virthost, target->user->cloakedhost);
 						/* And broadcast the change to VHP servers */
 						if (MyUser(target))
 							sendto_server(NULL, PROTO_VHP, 0, NULL, ":%s SETHOST :%s", target->id,
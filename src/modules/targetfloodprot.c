@@ -43,6 +43,7 @@ ModDataInfo *targetfloodprot_client_md = NULL;
 ModDataInfo *targetfloodprot_channel_md = NULL;
 TargetFloodConfig *channelcfg = NULL;
 TargetFloodConfig *privatecfg = NULL;
+int perm_immune_target_flood = 0;
 
 MOD_TEST()
 {
@@ -83,6 +84,8 @@ MOD_INIT()
 
 	MARK_AS_OFFICIAL_MODULE(modinfo);
 
+	perm_immune_target_flood = OperClassGetPermissionID("immune:target-flood");
+
 	HookAdd(modinfo->handle, HOOKTYPE_CONFIGRUN, 0, targetfloodprot_config_run);
 	HookAdd(modinfo->handle, HOOKTYPE_CAN_SEND_TO_CHANNEL, 0, targetfloodprot_can_send_to_channel);
 	HookAdd(modinfo->handle, HOOKTYPE_CAN_SEND_TO_USER, 0, targetfloodprot_can_send_to_user);
@@ -235,7 +238,7 @@ int targetfloodprot_can_send_to_channel(Client *client, Channel *channel, Member
 		return HOOK_CONTINUE;
 
 	/* IRCOps and U-Lines override */
-	if (IsULine(client) || (IsOper(client) && ValidatePermissionsForPath("immune:target-flood",client,NULL,channel,NULL)))
+	if (IsULine(client) || (IsOper(client) && ValidatePermissionsForID(perm_immune_target_flood,client,NULL,channel,NULL)))
 		return HOOK_CONTINUE;
 
 	what = sendtypetowhat(sendtype);
@@ -281,7 +284,7 @@ int targetfloodprot_can_send_to_user(Client *client, Client *target, char **text
 		return HOOK_CONTINUE;
 
 	/* IRCOps and U-Lines override */
-	if (IsULine(client) || (IsOper(client) && ValidatePermissionsForPath("immune:target-flood",client,target,NULL,NULL)))
+	if (IsULine(client) || (IsOper(client) && ValidatePermissionsForID(perm_immune_target_flood,client,target,NULL,NULL)))
 		return HOOK_CONTINUE;
 
 	what = sendtypetowhat(sendtype);
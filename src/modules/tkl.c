@@ -147,6 +147,10 @@ TKLTypeTable tkl_types[] = {
 
 int max_stats_matches = 1000;
 
+/* Permission IDs of the immune:* checks that are done for every message */
+static int perm_immune_shun = 0;
+static int perm_immune_spamfilter = 0;
+
 MOD_TEST()
 {
 	MARK_AS_OFFICIAL_MODULE(modinfo);
@@ -193,6 +197,8 @@ MOD_TEST()
 MOD_INIT()
 {
 	MARK_AS_OFFICIAL_MODULE(modinfo);
+	perm_immune_shun = OperClassGetPermissionID("immune:server-ban:shun");
+	perm_immune_spamfilter = OperClassGetPermissionID("immune:server-ban:spamfilter");
 	HookAdd(modinfo->handle, HOOKTYPE_CONFIGRUN, 0, tkl_config_match_spamfilter);
 	HookAdd(modinfo->handle, HOOKTYPE_CONFIGRUN, 0, tkl_config_run_ban);
 	HookAdd(modinfo->handle, HOOKTYPE_CONFIGRUN, 0, tkl_config_run_except);
@@ -1820,6 +1826,7 @@ void spamfilter_usage(Client *client)
 	sendnotice(client, "Use: /spamfilter [add|del|remove|+|-] [-simple|-regex] [type] [action] [tkltime] [tklreason] [regex]");
 	sendnotice(client, "See '/helpop ?spamfilter' for more information.");
 	sendnotice(client, "For an easy way to remove an existing spamfilter, use '/spamfilter del' without additional parameters");
+	sendnotice(client, "To see how often each spamfilter matched and how much time it took, use '/spamfilter stats'");
 }
 
 /** Helper function for cmd_spamfilter, explaining usage has changed. */
@@ -1947,6 +1954,19 @@ CMD_FUNC(cmd_spamfilter)
 		return;
 	}
 
+	if ((parc == 2) && !strcasecmp(parv[1], "stats"))
+	{
+		/* Show STATS with the hit and timing counters */
+		char *parv[5];
+		parv[0] = NULL;
+		parv[1] = "spamfilter";
+		parv[2] = me.name;
+		parv[3] = "stats";
+		parv[4] = NULL;
+		do_cmd(client, recv_mtags, "STATS", 4, parv);
+		return;
+	}
+
 	if ((parc <= 3) && !strcmp(parv[1], "del"))
 	{
 		if (!parv[2])
@@ -3042,7 +3062,7 @@ int _find_shun(Client *client)
 	if (IsShunned(client))
 		return 1;
 
-	if (ValidatePermissionsForPath("immune:server-ban:shun",client,NULL,NULL,NULL))
+	if (ValidatePermissionsForID(perm_immune_shun,client,NULL,NULL,NULL))
 		return 0;
 
 	for (tkl = tklines[tkl_hash('s')]; tkl; tkl = tkl->next)
@@ -3110,7 +3130,7 @@ int _find_spamfilter_user(Client *client, int flags)
 {
 	char spamfilter_user[NICKLEN + USERLEN + HOSTLEN + REALLEN + 64]; /* n!u@h:r */
 
-	if (ValidatePermissionsForPath("immune:server-ban:spamfilter",client,NULL,NULL,NULL))
+	if (ValidatePermissionsForID(perm_immune_spamfilter,client,NULL,NULL,NULL))
 		return 0;
 
 	spamfilter_build_user_string(spamfilter_user, client->name, client);
@@ -3486,6 +3506,19 @@ int tkl_stats_matcher(Client *client, int type, char *para, TKLFlag *tklflags, T
 				sendtxtnumeric(client, "This spamfilter is stored in the configuration file and cannot be removed with /SPAMFILTER del");
 				sendtxtnumeric(client, "-");
 			}
+		} else
+		if (para && !strcasecmp(para, "stats"))
+		{
+			Match *m = tkl->ptr.spamfilter->match;
+			if (m->type == MATCH_PCRE_REGEX)
+			{
+				sendtxtnumeric(client, "Matched %lu out of %lu times, took %lld usec in total (%lld usec on average)%s",
+					m->hits, m->checks, m->usec, m->checks ? m->usec / (long long)m->checks : 0LL,
+					m->jit ? "" : ", not JIT compiled");
+			} else {
+				sendtxtnumeric(client, "Matched %lu out of %lu times", m->hits, m->checks);
+			}
+			sendtxtnumeric(client, "-");
 		}
 	} else
 	if (TKLIsNameBan(tkl))
@@ -3567,7 +3600,7 @@ void _tkl_stats(Client *client, int type, char *para, int *cnt)
 		}
 	}
 
-	if ((type == (TKL_SPAMF|TKL_GLOBAL)) && (!para || strcasecmp(para, "del")))
+	if ((type == (TKL_SPAMF|TKL_GLOBAL)) && (!para || (strcasecmp(para, "del") && strcasecmp(para, "stats"))))
 	{
 		/* If requesting spamfilter stats and not spamfilter del, then suggest it. */
 		sendnotice(client, "Tip: if you are looking for an easy way to remove a spamfilter, run '/SPAMFILTER del'.");
@@ -4669,7 +4702,6 @@ int _match_spamfilter(Client *client, char *str_in, int target, char *destinatio
 	int ret = -1;
 	char *reason = NULL;
 #ifdef SPAMFILTER_DETECTSLOW
-	struct rusage rnow, rprev;
 	long ms_past;
 #endif
 
@@ -4684,7 +4716,7 @@ int _match_spamfilter(Client *client, char *str_in, int target, char *destinatio
 	/* (note: using client->user check here instead of IsUser()
 	 * due to SPAMF_USER where user isn't marked as client/person yet.
 	 */
-	if (!client->user || ValidatePermissionsForPath("immune:server-ban:spamfilter",client,NULL,NULL,NULL) || IsULine(client))
+	if (!client->user || ValidatePermissionsForID(perm_immune_spamfilter,client,NULL,NULL,NULL) || IsULine(client))
 		return 0;
 
 	for (tkl = tklines[tkl_hash('F')]; tkl; tkl = tkl->next)
@@ -4701,20 +4733,11 @@ int _match_spamfilter(Client *client, char *str_in, int target, char *destinatio
 		if (IsSoftBanAction(tkl->ptr.spamfilter->action) && IsLoggedIn(client))
 			continue;
 
-#ifdef SPAMFILTER_DETECTSLOW
-		memset(&rnow, 0, sizeof(rnow));
-		memset(&rprev, 0, sizeof(rnow));
-
-		getrusage(RUSAGE_SELF, &rprev);
-#endif
-
 		ret = unreal_match(tkl->ptr.spamfilter->match, str);
 
 #ifdef SPAMFILTER_DETECTSLOW
-		getrusage(RUSAGE_SELF, &rnow);
-
-		ms_past = ((rnow.ru_utime.tv_sec - rprev.ru_utime.tv_sec) * 1000) +
-		          ((rnow.ru_utime.tv_usec - rprev.ru_utime.tv_usec) / 1000);
+		/* unreal_match() times regexes for us, simple ones are never slow */
+		ms_past = (tkl->ptr.spamfilter->match->type == MATCH_PCRE_REGEX) ? tkl->ptr.spamfilter->match->last_usec / 1000 : 0;
 
 		if ((SPAMFILTER_DETECTSLOW_FATAL > 0) && (ms_past > SPAMFILTER_DETECTSLOW_FATAL))
 		{
@@ -103,6 +103,7 @@ struct cfgstruct {
 static struct cfgstruct cfg;
 
 static int tkls_loaded = 0;
+static int tkldb_writer = 0; /**< Process id of the background writer, if any */
 
 MOD_TEST()
 {
@@ -152,6 +153,8 @@ MOD_LOAD()
 
 MOD_UNLOAD()
 {
+	if (tkldb_writer)
+		background_write_done(tkldb_writer, 1);
 	write_tkldb();
 	freecfg();
 	SavePersistentInt(modinfo, tkls_loaded);
@@ -228,7 +231,19 @@ int tkldb_configrun(ConfigFile *cf, ConfigEntry *ce, int type)
 
 EVENT(write_tkldb_evt)
 {
-	write_tkldb();
+	if (tkldb_writer)
+	{
+		int ret = background_write_done(tkldb_writer, 0);
+		if (ret == 0)
+			return; /* previous write still running, try again next time */
+		if (ret < 0)
+			sendto_realops_and_log("[tkldb] Writing the database in the background failed (DATABASE NOT SAVED)");
+		tkldb_writer = 0;
+	}
+	/* Serialize and write the database in a child process */
+	tkldb_writer = background_write_start(write_tkldb);
+	if (tkldb_writer < 0)
+		tkldb_writer = 0; /* failed in the foreground, already reported */
 }
 
 int write_tkldb(void)
@@ -311,6 +326,7 @@ int write_tkldb(void)
 	}
 
 	// Everything seems to have gone well, attempt to close and rename the tempfile
+	W_SAFE(sync_file(fd));
 	if (fclose(fd) != 0)
 	{
 		WARN_WRITE_ERROR(tmpfname);
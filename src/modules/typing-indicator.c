@@ -92,13 +92,13 @@ void mtag_add_ti(Client *client, MessageTag *recv_mtags, MessageTag **mtag_list,
 		m = find_mtag(recv_mtags, "+typing");
 		if (m)
 		{
-			m = duplicate_mtag(m);
+			m = new_mtag(m->name, m->value);
 			AddListItem(m, *mtag_list);
 		}
 		m = find_mtag(recv_mtags, "+draft/typing");
 		if (m)
 		{
-			m = duplicate_mtag(m);
+			m = new_mtag(m->name, m->value);
 			AddListItem(m, *mtag_list);
 		}
 	}
@@ -88,15 +88,13 @@ void mtag_add_userhost(Client *client, MessageTag *recv_mtags, MessageTag **mtag
 		MessageTag *m = find_mtag(recv_mtags, "unrealircd.org/userhost");
 		if (m)
 		{
-			m = duplicate_mtag(m);
+			m = new_mtag(m->name, m->value);
 		} else {
 			char nuh[USERLEN+HOSTLEN+1];
 
 			snprintf(nuh, sizeof(nuh), "%s@%s", client->user->username, client->user->realhost);
 
-			m = safe_alloc(sizeof(MessageTag));
-			safe_strdup(m->name, "unrealircd.org/userhost");
-			safe_strdup(m->value, nuh);
+			m = new_mtag("unrealircd.org/userhost", nuh);
 		}
 		AddListItem(m, *mtag_list);
 	}
@@ -88,15 +88,13 @@ void mtag_add_userip(Client *client, MessageTag *recv_mtags, MessageTag **mtag_l
 		MessageTag *m = find_mtag(recv_mtags, "unrealircd.org/userip");
 		if (m)
 		{
-			m = duplicate_mtag(m);
+			m = new_mtag(m->name, m->value);
 		} else {
 			char nuh[USERLEN+HOSTLEN+1];
 
 			snprintf(nuh, sizeof(nuh), "%s@%s", client->user->username, GetIP(client));
 
-			m = safe_alloc(sizeof(MessageTag));
-			safe_strdup(m->name, "unrealircd.org/userip");
-			safe_strdup(m->value, nuh);
+			m = new_mtag("unrealircd.org/userip", nuh);
 		}
 		AddListItem(m, *mtag_list);
 	}
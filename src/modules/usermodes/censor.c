@@ -28,6 +28,7 @@ int censor_config_run(ConfigFile *, ConfigEntry *, int);
 ModuleInfo *ModInfo = NULL;
 
 ConfigItem_badword *conf_badword_message = NULL;
+WordFilter *conf_badword_message_filter = NULL; /**< Compiled version of conf_badword_message, built by stripbadwords() */
 
 static ConfigItem_badword *copy_badword_struct(ConfigItem_badword *ca, int regex, int regflags);
 
@@ -67,6 +68,8 @@ ConfigItem_badword *badword, *next;
 		DelListItem(badword, conf_badword_message);
 		badword_config_free(badword);
 	}
+	wordfilter_free(conf_badword_message_filter);
+	conf_badword_message_filter = NULL;
 	return MOD_SUCCESS;
 }
 
@@ -218,6 +221,10 @@ int censor_config_run(ConfigFile *cf, ConfigEntry *ce, int type)
 
 	badword_config_process(ca, word->ce_vardata);
 
+	/* The list changes, so the compiled version needs to be rebuilt */
+	wordfilter_free(conf_badword_message_filter);
+	conf_badword_message_filter = NULL;
+
 	if (!strcmp(ce->ce_vardata, "message"))
 	{
 		AddListItem(ca, conf_badword_message);
@@ -233,7 +240,7 @@ int censor_config_run(ConfigFile *cf, ConfigEntry *ce, int type)
 
 char *stripbadwords_message(char *str, int *blocked)
 {
-	return stripbadwords(str, conf_badword_message, blocked);
+	return stripbadwords(str, conf_badword_message, &conf_badword_message_filter, blocked);
 }
 
 int censor_can_send_to_user(Client *client, Client *target, char **text, char **errmsg, SendType sendtype)
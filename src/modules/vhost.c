@@ -138,7 +138,7 @@ CMD_FUNC(cmd_vhost)
 
 	userhost_save_current(client);
 
-	safe_strdup(client->user->virthost, vhost->virthost);
+	scache_set(&client->user->virthost, vhost->virthost);
 	if (vhost->virtuser)
 	{
 		strcpy(olduser, client->user->username);
@@ -361,7 +361,7 @@ void dowebirc(Client *client, char *ip, char *host, char *options)
 	}
 
 	/* STEP 2: Update GetIP() */
-	safe_strdup(client->ip, ip);
+	scache_set(&client->ip, ip);
 		
 	/* STEP 3: Update client->local->hostp */
 	/* (free old) */
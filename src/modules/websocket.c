@@ -7,6 +7,9 @@
    
 #include "unrealircd.h"
 #include <limits.h>
+#ifdef HAVE_ZLIB
+ #include <zlib.h>
+#endif
 
 #define WEBSOCKET_VERSION "1.1.0"
 
@@ -27,6 +30,26 @@ ModuleHeader MOD_HEADER
  #define WEBSOCKET_SEND_BUFFER_SIZE 16384
 #endif
 
+#ifdef HAVE_ZLIB
+/** Per-connection state for permessage-deflate (RFC7692) */
+typedef struct WebSocketCompression WebSocketCompression;
+struct WebSocketCompression {
+	z_stream deflate; /**< Outgoing: server to client */
+	z_stream inflate; /**< Incoming: client to server */
+	char initialized; /**< deflate and inflate have been initialized */
+	char server_no_context_takeover; /**< Reset the deflate context after each message */
+	char client_max_window_bits_offered; /**< Client sent client_max_window_bits */
+	int window_bits; /**< Window bits for deflate (server_max_window_bits) */
+	int client_window_bits; /**< Window bits for inflate (client_max_window_bits) */
+	int memory_level; /**< zlib memLevel for deflate */
+	long long bytes_in; /**< Compressed bytes received */
+	long long bytes_in_raw; /**< Bytes received, after decompression */
+	long long bytes_out_raw; /**< Bytes sent, before compression */
+	long long bytes_out; /**< Compressed bytes sent */
+	long long cpu_usec; /**< Time spent in zlib, in microseconds */
+};
+#endif
+
 typedef struct WebSocketUser WebSocketUser;
 struct WebSocketUser {
 	char get; /**< GET initiated */
@@ -34,8 +57,15 @@ struct WebSocketUser {
 	char *handshake_key; /**< Handshake key (used during handshake) */
 	char *lefttoparse; /**< Leftover buffer to parse */
 	int lefttoparselen; /**< Length of lefttoparse buffer */
+	char compressed_message; /**< The current incoming (fragmented) message is compressed */
+#ifdef HAVE_ZLIB
+	WebSocketCompression *compression; /**< permessage-deflate, NULL if not in use */
+#endif
 };
 
+/* Maximum size of a (partial) frame that we are willing to buffer */
+#define WEBSOCKET_MAX_FRAME_SIZE 4096
+
 #define WEBSOCKET_TYPE_BINARY	0x1
 #define WEBSOCKET_TYPE_TEXT	0x2
 
@@ -57,33 +87,63 @@ int websocket_config_test(ConfigFile *cf, ConfigEntry *ce, int type, int *errs);
 int websocket_config_run_ex(ConfigFile *cf, ConfigEntry *ce, int type, void *ptr);
 int websocket_packet_out(Client *from, Client *to, Client *intended_to, char **msg, int *length);
 int websocket_packet_in(Client *client, char *readbuf, int *length);
+int websocket_handshake(Client *client);
 void websocket_mdata_free(ModData *m);
 int websocket_handle_packet(Client *client, char *readbuf, int length);
 int websocket_handle_handshake(Client *client, char *readbuf, int *length);
 int websocket_complete_handshake(Client *client);
 int websocket_handle_packet_ping(Client *client, char *buf, int len);
 int websocket_handle_packet_pong(Client *client, char *buf, int len);
-int websocket_create_packet(int opcode, char **buf, int *len);
+int websocket_create_packet(Client *client, int opcode, char **buf, int *len);
 int websocket_send_pong(Client *client, char *buf, int len);
+void websocket_unmask(char *dst, char *src, int len, char *maskkey);
+int websocket_set_config_test(ConfigFile *cf, ConfigEntry *ce, int type, int *errs);
+int websocket_set_config_run(ConfigFile *cf, ConfigEntry *ce, int type);
+int websocket_stats(Client *client, char *flag);
+#ifdef HAVE_ZLIB
+void websocket_negotiate_compression(Client *client, char *value);
+int websocket_compression_init(WebSocketCompression *c);
+void websocket_compression_free(WebSocketCompression *c);
+int websocket_compress(WebSocketCompression *c, char *in, int inlen, char *out, int outlen);
+int websocket_handle_compressed(Client *client, char *payload, int len, int fin);
+long websocket_compression_memory(WebSocketCompression *c);
+#endif
 
 /* Global variables */
 ModDataInfo *websocket_md;
+unsigned int websocket_packet_hooks; /**< Our bit for SetPacketHooks() */
+
+static struct {
+	int permessage_deflate; /**< Offer permessage-deflate (RFC7692) to clients */
+	int window_bits; /**< Maximum deflate window bits (9-15) */
+	int memory_level; /**< zlib memLevel (1-9) */
+	int compression_level; /**< zlib compression level (1-9) */
+} cfg;
 
 MOD_TEST()
 {
 	HookAdd(modinfo->handle, HOOKTYPE_CONFIGTEST, 0, websocket_config_test);
+	HookAdd(modinfo->handle, HOOKTYPE_CONFIGTEST, 0, websocket_set_config_test);
 	return MOD_SUCCESS;
 }
 
 MOD_INIT()
 {
 	ModDataInfo mreq;
+	Hook *h;
 
 	MARK_AS_OFFICIAL_MODULE(modinfo);
 
 	HookAdd(modinfo->handle, HOOKTYPE_CONFIGRUN_EX, 0, websocket_config_run_ex);
-	HookAdd(modinfo->handle, HOOKTYPE_PACKET, INT_MAX, websocket_packet_out);
-	HookAdd(modinfo->handle, HOOKTYPE_RAWPACKET_IN, INT_MIN, websocket_packet_in);
+	HookAdd(modinfo->handle, HOOKTYPE_CONFIGRUN, 0, websocket_set_config_run);
+	HookAdd(modinfo->handle, HOOKTYPE_STATS, 0, websocket_stats);
+	HookAdd(modinfo->handle, HOOKTYPE_HANDSHAKE, 0, websocket_handshake);
+	/* The packet hooks are only called for clients on websocket ports */
+	websocket_packet_hooks = PacketHooksBit(modinfo->handle);
+	h = HookAdd(modinfo->handle, HOOKTYPE_PACKET, INT_MAX, websocket_packet_out);
+	HookOptinClient(h);
+	h = HookAdd(modinfo->handle, HOOKTYPE_RAWPACKET_IN, INT_MIN, websocket_packet_in);
+	HookOptinClient(h);
 
 	memset(&mreq, 0, sizeof(mreq));
 	mreq.name = "websocket";
@@ -94,11 +154,31 @@ MOD_INIT()
 	mreq.type = MODDATATYPE_CLIENT;
 	websocket_md = ModDataAdd(modinfo->handle, mreq);
 
+	/* Defaults. The window bits and memory level are deliberately lower
+	 * than the zlib defaults: IRC lines are short, so a small window
+	 * compresses nearly as well and costs a lot less memory per client.
+	 */
+	memset(&cfg, 0, sizeof(cfg));
+	cfg.permessage_deflate = 0;
+	cfg.window_bits = 11;
+	cfg.memory_level = 4;
+	cfg.compression_level = 6;
+
 	return MOD_SUCCESS;
 }
 
 MOD_LOAD()
 {
+	Client *client;
+
+	/* Clients that connected before we were (re)loaded */
+	list_for_each_entry(client, &lclient_list, lclient_node)
+		if (WEBSOCKET_TYPE(client))
+			SetPacketHooks(client, websocket_packet_hooks);
+	list_for_each_entry(client, &unknown_list, lclient_node)
+		if (WEBSOCKET_TYPE(client))
+			SetPacketHooks(client, websocket_packet_hooks);
+
 	return MOD_SUCCESS;
 }
 
@@ -215,6 +295,122 @@ int websocket_config_run_ex(ConfigFile *cf, ConfigEntry *ce, int type, void *ptr
 	return 1;
 }
 
+int websocket_set_config_test(ConfigFile *cf, ConfigEntry *ce, int type, int *errs)
+{
+	int errors = 0;
+	ConfigEntry *cep, *cepp;
+
+	if (type != CONFIG_SET)
+		return 0;
+
+	/* We are only interrested in set::websocket.. */
+	if (!ce || strcmp(ce->ce_varname, "websocket"))
+		return 0;
+
+	for (cep = ce->ce_entries; cep; cep = cep->ce_next)
+	{
+		if (!strcmp(cep->ce_varname, "permessage-deflate"))
+		{
+#ifndef HAVE_ZLIB
+			config_error("%s:%i: set::websocket::permessage-deflate: UnrealIRCd was compiled without zlib support",
+				cep->ce_fileptr->cf_filename, cep->ce_varlinenum);
+			errors++;
+			continue;
+#endif
+			for (cepp = cep->ce_entries; cepp; cepp = cepp->ce_next)
+			{
+				if (!cepp->ce_vardata)
+				{
+					config_error_empty(cepp->ce_fileptr->cf_filename, cepp->ce_varlinenum,
+						"set::websocket::permessage-deflate", cepp->ce_varname);
+					errors++;
+					continue;
+				} else
+				if (!strcmp(cepp->ce_varname, "enabled"))
+				{
+					char *v = cepp->ce_vardata;
+					if (strcasecmp(v, "yes") && strcasecmp(v, "no") &&
+					    strcasecmp(v, "on") && strcasecmp(v, "off") &&
+					    strcasecmp(v, "true") && strcasecmp(v, "false") &&
+					    strcmp(v, "1") && strcmp(v, "0"))
+					{
+						config_error("%s:%i: set::websocket::permessage-deflate::enabled must be 'yes' or 'no'",
+							cepp->ce_fileptr->cf_filename, cepp->ce_varlinenum);
+						errors++;
+					}
+				} else
+				if (!strcmp(cepp->ce_varname, "window-bits"))
+				{
+					int v = atoi(cepp->ce_vardata);
+					if ((v < 9) || (v > 15))
+					{
+						config_error("%s:%i: set::websocket::permessage-deflate::window-bits should be in range 9-15",
+							cepp->ce_fileptr->cf_filename, cepp->ce_varlinenum);
+						errors++;
+					}
+				} else
+				if (!strcmp(cepp->ce_varname, "memory-level") ||
+				    !strcmp(cepp->ce_varname, "compression-level"))
+				{
+					int v = atoi(cepp->ce_vardata);
+					if ((v < 1) || (v > 9))
+					{
+						config_error("%s:%i: set::websocket::permessage-deflate::%s should be in range 1-9",
+							cepp->ce_fileptr->cf_filename, cepp->ce_varlinenum, cepp->ce_varname);
+						errors++;
+					}
+				} else
+				{
+					config_error_unknown(cepp->ce_fileptr->cf_filename, cepp->ce_varlinenum,
+						"set::websocket::permessage-deflate", cepp->ce_varname);
+					errors++;
+				}
+			}
+		} else
+		{
+			config_error_unknown(cep->ce_fileptr->cf_filename, cep->ce_varlinenum,
+				"set::websocket", cep->ce_varname);
+			errors++;
+		}
+	}
+
+	*errs = errors;
+	return errors ? -1 : 1;
+}
+
+int websocket_set_config_run(ConfigFile *cf, ConfigEntry *ce, int type)
+{
+	ConfigEntry *cep, *cepp;
+
+	if (type != CONFIG_SET)
+		return 0;
+
+	/* We are only interrested in set::websocket.. */
+	if (!ce || strcmp(ce->ce_varname, "websocket"))
+		return 0;
+
+	for (cep = ce->ce_entries; cep; cep = cep->ce_next)
+	{
+		if (!strcmp(cep->ce_varname, "permessage-deflate"))
+		{
+			/* A permessage-deflate block without 'enabled no' means: enabled */
+			cfg.permessage_deflate = 1;
+			for (cepp = cep->ce_entries; cepp; cepp = cepp->ce_next)
+			{
+				if (!strcmp(cepp->ce_varname, "enabled"))
+					cfg.permessage_deflate = config_checkval(cepp->ce_vardata, CFG_YESNO);
+				else if (!strcmp(cepp->ce_varname, "window-bits"))
+					cfg.window_bits = atoi(cepp->ce_vardata);
+				else if (!strcmp(cepp->ce_varname, "memory-level"))
+					cfg.memory_level = atoi(cepp->ce_vardata);
+				else if (!strcmp(cepp->ce_varname, "compression-level"))
+					cfg.compression_level = atoi(cepp->ce_vardata);
+			}
+		}
+	}
+	return 1;
+}
+
 /** UnrealIRCd internals: free WebSocketUser object. */
 void websocket_mdata_free(ModData *m)
 {
@@ -223,10 +419,31 @@ void websocket_mdata_free(ModData *m)
 	{
 		safe_free(wsu->handshake_key);
 		safe_free(wsu->lefttoparse);
+#ifdef HAVE_ZLIB
+		if (wsu->compression)
+		{
+			websocket_compression_free(wsu->compression);
+			safe_free(wsu->compression);
+		}
+#endif
 		safe_free(m->ptr);
 	}
 }
 
+/** The last frame we created in websocket_packet_out().
+ * When a message is sent to a channel, all the recipients usually get
+ * exactly the same line. In that case we can simply hand out the
+ * frame(s) we created for the previous recipient, and skip the UTF8
+ * validation and frame building.
+ */
+static struct {
+	int opcode; /**< WSOP_TEXT or WSOP_BINARY, 0 if the cache is empty */
+	int len; /**< Length of msg */
+	char msg[1024]; /**< The original message (sendbufto_one() never sends more than this) */
+	char *frame; /**< The created frame(s), this points to a static buffer in websocket_create_packet() */
+	int framelen; /**< Length of the frame(s) */
+} websocket_last_frame;
+
 /** Outgoing packet hook.
  * This transforms the output to be Websocket-compliant, if necessary.
  */
@@ -234,15 +451,66 @@ int websocket_packet_out(Client *from, Client *to, Client *intended_to, char **m
 {
 	if (MyConnect(to) && WSU(to) && WSU(to)->handshake_completed)
 	{
+		int opcode;
+
 		if (WEBSOCKET_TYPE(to) == WEBSOCKET_TYPE_BINARY)
-			websocket_create_packet(WSOP_BINARY, msg, length);
+			opcode = WSOP_BINARY;
 		else if (WEBSOCKET_TYPE(to) == WEBSOCKET_TYPE_TEXT)
+			opcode = WSOP_TEXT;
+		else
+			return 0;
+
+#ifdef HAVE_ZLIB
+		if (WSU(to)->compression)
+		{
+			/* The compressed frames depend on the state of the
+			 * deflate stream of this particular client,
+			 * so these can't be shared with other clients.
+			 */
+			if (opcode == WSOP_TEXT)
+			{
+				char *safe_msg = unrl_utf8_make_valid(*msg);
+				*msg = safe_msg;
+				*length = *msg ? strlen(safe_msg) : 0;
+			}
+			/* On failure drop the line, the raw IRC line is not a valid frame */
+			if (websocket_create_packet(to, opcode, msg, length) < 0)
+				*msg = NULL;
+			return 0;
+		}
+#endif
+
+		/* Same message as last time? Then re-use the frame(s) */
+		if ((websocket_last_frame.opcode == opcode) &&
+		    (websocket_last_frame.len == *length) &&
+		    !memcmp(websocket_last_frame.msg, *msg, *length))
+		{
+			*msg = websocket_last_frame.frame;
+			*length = websocket_last_frame.framelen;
+			return 0;
+		}
+
+		websocket_last_frame.opcode = 0;
+		if ((*length > 0) && (*length <= sizeof(websocket_last_frame.msg)))
+		{
+			websocket_last_frame.len = *length;
+			memcpy(websocket_last_frame.msg, *msg, *length);
+		} else {
+			websocket_last_frame.len = -1;
+		}
+
+		if (opcode == WSOP_TEXT)
 		{
 			/* Some more conversions are needed */
 			char *safe_msg = unrl_utf8_make_valid(*msg);
 			*msg = safe_msg;
 			*length = *msg ? strlen(safe_msg) : 0;
-			websocket_create_packet(WSOP_TEXT, msg, length);
+		}
+		if ((websocket_create_packet(NULL, opcode, msg, length) == 0) && (websocket_last_frame.len > 0))
+		{
+			websocket_last_frame.opcode = opcode;
+			websocket_last_frame.frame = *msg;
+			websocket_last_frame.framelen = *length;
 		}
 		return 0;
 	}
@@ -251,27 +519,31 @@ int websocket_packet_out(Client *from, Client *to, Client *intended_to, char **m
 
 int websocket_handle_websocket(Client *client, char *readbuf2, int length2)
 {
+	WebSocketUser *wsu = WSU(client);
 	int n;
 	char *ptr;
 	int length;
-	int length1 = WSU(client)->lefttoparselen;
-	char readbuf[4096];
 
-	length = length1 + length2;
-	if (length > sizeof(readbuf)-1)
+	if (wsu->lefttoparselen > 0)
 	{
-		dead_socket(client, "Illegal buffer stacking/Excess flood");
-		return 0;
+		/* We have a partial frame from last time.
+		 * Append the new data to it and parse it from there.
+		 */
+		length = wsu->lefttoparselen + length2;
+		if (length > WEBSOCKET_MAX_FRAME_SIZE)
+		{
+			dead_socket(client, "Illegal buffer stacking/Excess flood");
+			return 0;
+		}
+		memcpy(wsu->lefttoparse + wsu->lefttoparselen, readbuf2, length2);
+		ptr = wsu->lefttoparse;
+	} else {
+		/* The common case: parse the frames directly from the read buffer */
+		length = length2;
+		ptr = readbuf2;
 	}
+	wsu->lefttoparselen = 0;
 
-	if (length1 > 0)
-		memcpy(readbuf, WSU(client)->lefttoparse, length1);
-	memcpy(readbuf+length1, readbuf2, length2);
-
-	safe_free(WSU(client)->lefttoparse);
-	WSU(client)->lefttoparselen = 0;
-
-	ptr = readbuf;
 	do {
 		n = websocket_handle_packet(client, ptr, length);
 		if (n < 0)
@@ -279,10 +551,18 @@ int websocket_handle_websocket(Client *client, char *readbuf2, int length2)
 		if (n == 0)
 		{
 			/* Short read. Stop processing for now, but save data for next time */
-			safe_free(WSU(client)->lefttoparse);
-			WSU(client)->lefttoparse = safe_alloc(length);
-			WSU(client)->lefttoparselen = length;
-			memcpy(WSU(client)->lefttoparse, ptr, length);
+			if (length > WEBSOCKET_MAX_FRAME_SIZE)
+			{
+				dead_socket(client, "Illegal buffer stacking/Excess flood");
+				return 0;
+			}
+			if (!wsu->lefttoparse)
+			{
+				/* Allocated once and then kept for the lifetime of the connection */
+				wsu->lefttoparse = safe_alloc(WEBSOCKET_MAX_FRAME_SIZE);
+			}
+			memmove(wsu->lefttoparse, ptr, length);
+			wsu->lefttoparselen = length;
 			return 0;
 		}
 		length -= n;
@@ -301,6 +581,14 @@ int websocket_handle_websocket(Client *client, char *readbuf2, int length2)
  * 0 means: don't process this data, but you can read another packet if you want
  * >0 means: process this data (regular IRC data, non-websocket stuff)
  */
+/** Opt in to our packet hooks for clients on a websocket port */
+int websocket_handshake(Client *client)
+{
+	if (WEBSOCKET_TYPE(client))
+		SetPacketHooks(client, websocket_packet_hooks);
+	return 0;
+}
+
 int websocket_packet_in(Client *client, char *readbuf, int *length)
 {
 	if ((client->local->receiveM == 0) && WEBSOCKET_TYPE(client) && !WSU(client) && (*length > 8) && !strncmp(readbuf, "GET ", 4))
@@ -502,6 +790,12 @@ int websocket_handle_handshake(Client *client, char *readbuf, int *length)
 			}
 			safe_strdup(WSU(client)->handshake_key, value);
 		}
+#ifdef HAVE_ZLIB
+		else if (!strcasecmp(key, "Sec-WebSocket-Extensions"))
+		{
+			websocket_negotiate_compression(client, value);
+		}
+#endif
 	}
 
 	if (end_of_request)
@@ -532,11 +826,41 @@ int websocket_handle_handshake(Client *client, char *readbuf, int *length)
 int websocket_complete_handshake(Client *client)
 {
 	char buf[512], hashbuf[64];
+	char extensions[128];
 	SHA_CTX hash;
 	char sha1out[20]; /* 160 bits */
 
 	WSU(client)->handshake_completed = 1;
 
+	*extensions = '\0';
+#ifdef HAVE_ZLIB
+	if (WSU(client)->compression)
+	{
+		WebSocketCompression *c = WSU(client)->compression;
+
+		if (websocket_compression_init(c))
+		{
+			char tmp[32];
+
+			snprintf(extensions, sizeof(extensions),
+			         "Sec-WebSocket-Extensions: permessage-deflate; server_max_window_bits=%d",
+			         c->window_bits);
+			if (c->server_no_context_takeover)
+				strlcat(extensions, "; server_no_context_takeover", sizeof(extensions));
+			if (c->client_max_window_bits_offered)
+			{
+				snprintf(tmp, sizeof(tmp), "; client_max_window_bits=%d", c->client_window_bits);
+				strlcat(extensions, tmp, sizeof(extensions));
+			}
+			strlcat(extensions, "\r\n", sizeof(extensions));
+		} else {
+			/* Unable to initialize zlib, continue without compression */
+			websocket_compression_free(c);
+			safe_free(WSU(client)->compression);
+		}
+	}
+#endif
+
 	snprintf(buf, sizeof(buf), "%s%s", WSU(client)->handshake_key, WEBSOCKET_MAGIC_KEY);
 	SHA1_Init(&hash);
 	SHA1_Update(&hash, buf, strlen(buf));
@@ -549,8 +873,10 @@ int websocket_complete_handshake(Client *client)
 	         "Upgrade: websocket\r\n"
 	         "Connection: Upgrade\r\n"
 	         "Sec-WebSocket-Accept: %s\r\n"
+	         "%s"
 	         "\r\n",
-	         hashbuf);
+	         hashbuf,
+	         extensions);
 
 	/* Caution: we bypass sendQ flood checking by doing it this way.
 	 * Risk is minimal, though, as we only permit limited text only
@@ -562,30 +888,6 @@ int websocket_complete_handshake(Client *client)
 	return 0;
 }
 
-/* Add LF (if needed) to a buffer. Max 4K. */
-void add_lf_if_needed(char **buf, int *len)
-{
-	static char newbuf[4096];
-	char *b = *buf;
-	int l = *len;
-
-	if (l <= 0)
-		return; /* too short */
-
-	if (b[l - 1] == '\n')
-		return; /* already contains \n */
-
-	if (l >= sizeof(newbuf)-2)
-		l = sizeof(newbuf)-2; /* cut-off if necessary */
-
-	memcpy(newbuf, b, l);
-	newbuf[l] = '\n';
-	newbuf[l + 1] = '\0'; /* not necessary, but I like zero termination */
-	l++;
-	*buf = newbuf; /* new buffer */
-	*len = l; /* new length */
-}
-
 /** WebSocket packet handler.
  * For more information on the format, check out page 28 of RFC6455.
  * @returns The number of bytes processed (the size of the frame)
@@ -594,6 +896,8 @@ void add_lf_if_needed(char **buf, int *len)
  */
 int websocket_handle_packet(Client *client, char *readbuf, int length)
 {
+	char fin; /**< Final fragment of a message */
+	char rsv1; /**< RSV1 bit, indicates a compressed message (RFC7692) */
 	char opcode; /**< Opcode */
 	char masked; /**< Masked */
 	int len; /**< Length of the packet */
@@ -607,13 +911,18 @@ int websocket_handle_packet(Client *client, char *readbuf, int length)
 		return 0;
 	}
 
-	/* fin    = readbuf[0] & 0x80; -- unused */
-	opcode = readbuf[0] & 0x7F;
+	fin    = readbuf[0] & 0x80;
+	rsv1   = readbuf[0] & 0x40;
+	opcode = readbuf[0] & 0x0F;
 	masked = readbuf[1] & 0x80;
 	len    = readbuf[1] & 0x7F;
 	p = &readbuf[2]; /* point to next element */
 
-	/* actually 'fin' is unused.. we don't care. */
+	if (readbuf[0] & 0x30)
+	{
+		dead_socket(client, "WebSocket protocol violation (RSV2/RSV3 set)");
+		return -1;
+	}
 
 	if (!masked)
 	{
@@ -658,20 +967,20 @@ int websocket_handle_packet(Client *client, char *readbuf, int length)
 		total_packet_size = len + 4 + 4; /* 4 for header, 4 for mask key, rest for payload */
 	}
 
+	/* Unmask this thing (page 33, section 5.3).
+	 * The unmasked payload is written 4 bytes to the left, over the
+	 * mask key. That way there is always room for adding a \n after
+	 * the payload without having to copy it to another buffer.
+	 */
 	memcpy(maskkey, p, 4);
-	p+= 4;
-	payload = (len > 0) ? p : NULL;
-
+	payload = p;
 	if (len > 0)
+		websocket_unmask(payload, p + 4, len, maskkey);
+
+	if (rsv1 && (opcode & 0x08))
 	{
-		/* Unmask this thing (page 33, section 5.3) */
-		int n;
-		char v;
-		for (n = 0; n < len; n++)
-		{
-			v = *p;
-			*p++ = v ^ maskkey[n % 4];
-		}
+		dead_socket(client, "WebSocket protocol violation (RSV1 set on control frame)");
+		return -1;
 	}
 
 	switch(opcode)
@@ -679,9 +988,33 @@ int websocket_handle_packet(Client *client, char *readbuf, int length)
 		case WSOP_CONTINUATION:
 		case WSOP_TEXT:
 		case WSOP_BINARY:
+			if (rsv1)
+			{
+				/* RSV1 may only be set on the first frame of a message,
+				 * and only if permessage-deflate was negotiated.
+				 */
+#ifdef HAVE_ZLIB
+				if (!WSU(client)->compression || (opcode == WSOP_CONTINUATION))
+#endif
+				{
+					dead_socket(client, "WebSocket protocol violation (unexpected RSV1)");
+					return -1;
+				}
+			}
+			if (opcode != WSOP_CONTINUATION)
+				WSU(client)->compressed_message = rsv1 ? 1 : 0;
+#ifdef HAVE_ZLIB
+			if (WSU(client)->compressed_message)
+			{
+				if (websocket_handle_compressed(client, payload, len, fin) < 0)
+					return -1;
+				return total_packet_size;
+			}
+#endif
 			if (len > 0)
 			{
-				add_lf_if_needed(&payload, &len);
+				if (payload[len - 1] != '\n')
+					payload[len++] = '\n'; /* safe, see above */
 				if (!process_packet(client, payload, len, 1)) /* let UnrealIRCd process this data */
 					return -1; /* fatal error occured (such as flood kill) */
 			}
@@ -709,6 +1042,35 @@ int websocket_handle_packet(Client *client, char *readbuf, int length)
 	return -1; /* NOTREACHED */
 }
 
+/** Unmask a websocket payload.
+ * This XOR's 8 bytes at a time, which is a lot faster than the
+ * simple byte-by-byte loop, and the compiler will often vectorize it.
+ * @param dst		The destination, this may be the same as 'src' or lie before it.
+ * @param src		The masked payload
+ * @param len		Length of the payload
+ * @param maskkey	The 4 byte mask key
+ */
+void websocket_unmask(char *dst, char *src, int len, char *maskkey)
+{
+	char mask8[8];
+	uint64_t mask, v;
+	int n = 0;
+
+	memcpy(mask8, maskkey, 4);
+	memcpy(mask8 + 4, maskkey, 4);
+	memcpy(&mask, mask8, 8);
+
+	for (; n + 8 <= len; n += 8)
+	{
+		memcpy(&v, src + n, 8);
+		v ^= mask;
+		memcpy(dst + n, &v, 8);
+	}
+
+	for (; n < len; n++)
+		dst[n] = src[n] ^ maskkey[n % 4];
+}
+
 int websocket_handle_packet_ping(Client *client, char *buf, int len)
 {
 	if (len > 500)
@@ -766,17 +1128,34 @@ int websocket_create_packet_simple(int opcode, char **buf, int *len)
  * The end result is one or more websocket frames,
  * all in a single packet *buf with size *len.
  */
-int websocket_create_packet(int opcode, char **buf, int *len)
+int websocket_create_packet(Client *client, int opcode, char **buf, int *len)
 {
 	static char sendbuf[WEBSOCKET_SEND_BUFFER_SIZE];
 	char *s = *buf; /* points to start of current line */
 	char *s2; /* used for searching of end of current line */
 	char *lastbyte = *buf + *len - 1; /* points to last byte in *buf that can be safely read */
+	char *payload; /* payload of the current frame */
 	int bytes_to_copy;
 	char newline;
-	char *o = sendbuf; /* points to current byte within 'sendbuf' of output buffer */
+	char *outbuf = sendbuf; /* output buffer */
+	char *o = outbuf; /* points to current byte within 'outbuf' */
 	int bytes_in_sendbuf = 0;
 	int bytes_single_frame;
+	char rsv1 = 0;
+#ifdef HAVE_ZLIB
+	/* Compressed frames use their own buffers, so the frame(s) in
+	 * 'sendbuf' stay valid for websocket_last_frame.
+	 */
+	static char zsendbuf[WEBSOCKET_SEND_BUFFER_SIZE];
+	static char zbuf[WEBSOCKET_SEND_BUFFER_SIZE];
+	WebSocketCompression *c = (client && WSU(client)) ? WSU(client)->compression : NULL;
+
+	if (c)
+	{
+		outbuf = o = zsendbuf;
+		rsv1 = 0x40;
+	}
+#endif
 
 	/* Sending 0 bytes makes no sense, and the code below may assume >0, so reject this. */
 	if (*len == 0)
@@ -794,6 +1173,17 @@ int websocket_create_packet(int opcode, char **buf, int *len)
 		 * (either at \r, \n or beyond the buffer).
 		 */
 		bytes_to_copy = s2 - s;
+		payload = s;
+
+#ifdef HAVE_ZLIB
+		/* For compressed frames check the worst case size (including
+		 * the sync flush marker) before feeding anything to the deflate
+		 * stream, otherwise a frame that is never sent would still end
+		 * up in the compression context.
+		 */
+		if (c)
+			bytes_to_copy = deflateBound(&c->deflate, s2 - s) + 6;
+#endif
 
 		if (bytes_to_copy < 126)
 			bytes_single_frame = 2 + bytes_to_copy;
@@ -805,23 +1195,48 @@ int websocket_create_packet(int opcode, char **buf, int *len)
 			/* Overflow. This should never happen. */
 			sendto_ops("[websocket] [BUG] Overflow prevented: %d + %d > %d",
 				bytes_in_sendbuf, bytes_single_frame, (int)sizeof(sendbuf));
+#ifdef HAVE_ZLIB
+			/* Any lines compressed so far are dropped as well */
+			if (c)
+				deflateReset(&c->deflate);
+#endif
 			return -1;
 		}
 
+#ifdef HAVE_ZLIB
+		if (c)
+		{
+			bytes_to_copy = websocket_compress(c, s, s2 - s, zbuf, sizeof(zbuf));
+			if (bytes_to_copy < 0)
+			{
+				/* Start over with a fresh context, this is always
+				 * safe for the client, like with no context takeover.
+				 */
+				deflateReset(&c->deflate);
+				return -1;
+			}
+			payload = zbuf;
+			if (bytes_to_copy < 126)
+				bytes_single_frame = 2 + bytes_to_copy;
+			else
+				bytes_single_frame = 4 + bytes_to_copy;
+		}
+#endif
+
 		/* Create the new frame */
-		o[0] = opcode | 0x80; /* opcode & final */
+		o[0] = opcode | rsv1 | 0x80; /* opcode & compressed & final */
 
 		if (bytes_to_copy < 126)
 		{
 			/* Short payload */
 			o[1] = (char)bytes_to_copy;
-			memcpy(&o[2], s, bytes_to_copy);
+			memcpy(&o[2], payload, bytes_to_copy);
 		} else {
 			/* Long payload */
 			o[1] = 126;
 			o[2] = (char)((bytes_to_copy >> 8) & 0xFF);
 			o[3] = (char)(bytes_to_copy & 0xFF);
-			memcpy(&o[4], s, bytes_to_copy);
+			memcpy(&o[4], payload, bytes_to_copy);
 		}
 
 		/* Advance destination pointer and counter */
@@ -832,7 +1247,7 @@ int websocket_create_packet(int opcode, char **buf, int *len)
 		for (s = s2; *s && (s <= lastbyte) && ((*s == '\n') || (*s == '\r')); s++);
 	} while(s <= lastbyte);
 
-	*buf = sendbuf;
+	*buf = outbuf;
 	*len = bytes_in_sendbuf;
 	return 0;
 }
@@ -856,3 +1271,311 @@ int websocket_send_pong(Client *client, char *buf, int len)
 	send_queued(client);
 	return 0;
 }
+
+/** Show WebSocket statistics (/STATS websocket) */
+int websocket_stats(Client *client, char *flag)
+{
+#ifdef HAVE_ZLIB
+	Client *acptr;
+	WebSocketCompression *c;
+	int websocket_clients = 0, compressed_clients = 0;
+	long long bytes_out_raw = 0, bytes_out = 0, bytes_in = 0, bytes_in_raw = 0, cpu_usec = 0;
+	long memory = 0;
+#endif
+
+	if (strcmp(flag, "websocket"))
+		return 0;
+
+#ifdef HAVE_ZLIB
+	sendtxtnumeric(client, "permessage-deflate: %s, window-bits: %d, memory-level: %d, compression-level: %d",
+		cfg.permessage_deflate ? "enabled" : "disabled",
+		cfg.window_bits, cfg.memory_level, cfg.compression_level);
+
+	list_for_each_entry(acptr, &lclient_list, lclient_node)
+	{
+		if (!WSU(acptr) || !WSU(acptr)->handshake_completed)
+			continue;
+		websocket_clients++;
+		c = WSU(acptr)->compression;
+		if (!c)
+			continue;
+		compressed_clients++;
+		bytes_out_raw += c->bytes_out_raw;
+		bytes_out += c->bytes_out;
+		bytes_in += c->bytes_in;
+		bytes_in_raw += c->bytes_in_raw;
+		cpu_usec += c->cpu_usec;
+		memory += websocket_compression_memory(c);
+		if (IsOper(client))
+		{
+			sendtxtnumeric(client, "%s: out %lld -> %lld bytes, in %lld -> %lld bytes, cpu %lld usec, memory ~%ld bytes, window-bits %d/%d%s",
+				acptr->name, c->bytes_out_raw, c->bytes_out, c->bytes_in, c->bytes_in_raw,
+				c->cpu_usec, websocket_compression_memory(c),
+				c->window_bits, c->client_window_bits,
+				c->server_no_context_takeover ? ", no context takeover" : "");
+		}
+	}
+
+	sendtxtnumeric(client, "WebSocket clients: %d, of which %d use compression",
+		websocket_clients, compressed_clients);
+	sendtxtnumeric(client, "Compression: out %lld -> %lld bytes (%lld%%), in %lld -> %lld bytes (%lld%%)",
+		bytes_out_raw, bytes_out, bytes_out_raw ? (bytes_out * 100 / bytes_out_raw) : 100LL,
+		bytes_in, bytes_in_raw, bytes_in_raw ? (bytes_in * 100 / bytes_in_raw) : 100LL);
+	sendtxtnumeric(client, "Compression: cpu %lld usec, memory ~%ld bytes",
+		cpu_usec, memory);
+#else
+	sendtxtnumeric(client, "permessage-deflate: not available (compiled without zlib)");
+#endif
+	return 1;
+}
+
+#ifdef HAVE_ZLIB
+/** Returns the number of microseconds that passed since 'start' */
+static long long websocket_usec_since(struct timeval *start)
+{
+	struct timeval now;
+
+	gettimeofday(&now, NULL);
+	return ((long long)(now.tv_sec - start->tv_sec) * 1000000) + (now.tv_usec - start->tv_usec);
+}
+
+/** Strip leading and trailing whitespace (in place) */
+static char *websocket_trim(char *str)
+{
+	char *p;
+
+	while ((*str == ' ') || (*str == '\t'))
+		str++;
+	for (p = str + strlen(str); (p > str) && ((p[-1] == ' ') || (p[-1] == '\t')); p--)
+		p[-1] = '\0';
+	return str;
+}
+
+/** Parse the Sec-WebSocket-Extensions header of the client and
+ * see if we can agree on permessage-deflate (RFC7692).
+ * The client may offer several configurations, we pick
+ * the first one that we support.
+ */
+void websocket_negotiate_compression(Client *client, char *value)
+{
+	char buf[512];
+	char *offer, *param, *val, *p, *p2;
+	int ok, n = 0;
+	int server_no_context_takeover, client_max_window_bits_offered;
+	int window_bits, client_window_bits;
+
+	if (!cfg.permessage_deflate || WSU(client)->compression)
+		return;
+
+	strlcpy(buf, value, sizeof(buf));
+	for (offer = strtoken(&p, buf, ","); offer; offer = strtoken(&p, NULL, ","))
+	{
+		param = strtoken(&p2, offer, ";");
+		if (!param || strcasecmp(websocket_trim(param), "permessage-deflate"))
+			continue; /* some other extension */
+
+		ok = 1;
+		server_no_context_takeover = 0;
+		client_max_window_bits_offered = 0;
+		window_bits = cfg.window_bits;
+		client_window_bits = 15; /* what the client uses if we don't say anything */
+
+		for (param = strtoken(&p2, NULL, ";"); param; param = strtoken(&p2, NULL, ";"))
+		{
+			val = strchr(param, '=');
+			if (val)
+			{
+				*val++ = '\0';
+				val = websocket_trim(val);
+				if (*val == '"')
+					val++; /* quoted-string form, atoi() stops at the closing quote */
+				n = atoi(val);
+			}
+			param = websocket_trim(param);
+			if (!strcasecmp(param, "server_no_context_takeover"))
+			{
+				server_no_context_takeover = 1;
+			} else
+			if (!strcasecmp(param, "client_no_context_takeover"))
+			{
+				/* Fine, nothing special needs to be done for inflate */
+			} else
+			if (!strcasecmp(param, "server_max_window_bits"))
+			{
+				/* zlib does not support a deflate window of 8 bits */
+				if (!val || (n < 9) || (n > 15))
+				{
+					ok = 0;
+					break;
+				}
+				if (n < window_bits)
+					window_bits = n;
+			} else
+			if (!strcasecmp(param, "client_max_window_bits"))
+			{
+				if (val && ((n < 8) || (n > 15)))
+				{
+					ok = 0;
+					break;
+				}
+				/* Ask the client to use a window no larger than ours,
+				 * this limits the memory needed for inflate.
+				 */
+				client_max_window_bits_offered = 1;
+				client_window_bits = cfg.window_bits;
+				if (val && (n < client_window_bits))
+					client_window_bits = n;
+			} else
+			{
+				/* Unknown parameter: decline this offer */
+				ok = 0;
+				break;
+			}
+		}
+
+		if (!ok)
+			continue;
+
+		WSU(client)->compression = safe_alloc(sizeof(WebSocketCompression));
+		WSU(client)->compression->server_no_context_takeover = server_no_context_takeover;
+		WSU(client)->compression->client_max_window_bits_offered = client_max_window_bits_offered;
+		WSU(client)->compression->window_bits = window_bits;
+		WSU(client)->compression->client_window_bits = client_window_bits;
+		WSU(client)->compression->memory_level = cfg.memory_level;
+		return;
+	}
+}
+/** Initialize the zlib streams after permessage-deflate was negotiated.
+ * @returns 1 on success, 0 on failure.
+ */
+int websocket_compression_init(WebSocketCompression *c)
+{
+	if (deflateInit2(&c->deflate, cfg.compression_level, Z_DEFLATED,
+	                 -c->window_bits, c->memory_level, Z_DEFAULT_STRATEGY) != Z_OK)
+	{
+		return 0;
+	}
+	if (inflateInit2(&c->inflate, -c->client_window_bits) != Z_OK)
+	{
+		deflateEnd(&c->deflate);
+		return 0;
+	}
+	c->initialized = 1;
+	return 1;
+}
+
+/** Free the zlib streams (but not the WebSocketCompression struct itself) */
+void websocket_compression_free(WebSocketCompression *c)
+{
+	if (c->initialized)
+	{
+		deflateEnd(&c->deflate);
+		inflateEnd(&c->inflate);
+		c->initialized = 0;
+	}
+}
+
+/** Approximate memory used by the zlib streams of a connection.
+ * This uses the formulas from zconf.h plus the size of the zlib
+ * internal state structures (roughly 6KB for deflate and 7KB for inflate).
+ */
+long websocket_compression_memory(WebSocketCompression *c)
+{
+	return sizeof(WebSocketCompression) +
+	       (1L << (c->window_bits + 2)) + (1L << (c->memory_level + 9)) + 6144 +
+	       (1L << c->client_window_bits) + 7168;
+}
+
+/** Compress a single message (line) for permessage-deflate.
+ * @param c		The compression context of the client
+ * @param in		The data to compress
+ * @param inlen		Length of 'in'
+ * @param out		The output buffer
+ * @param outlen	Size of the output buffer
+ * @returns Length of the compressed data, or -1 on error.
+ */
+int websocket_compress(WebSocketCompression *c, char *in, int inlen, char *out, int outlen)
+{
+	z_stream *z = &c->deflate;
+	struct timeval start;
+	int r, n;
+
+	gettimeofday(&start, NULL);
+
+	z->next_in = (Bytef *)in;
+	z->avail_in = inlen;
+	z->next_out = (Bytef *)out;
+	z->avail_out = outlen;
+	r = deflate(z, Z_SYNC_FLUSH);
+	if (((r != Z_OK) && (r != Z_BUF_ERROR)) || (z->avail_in > 0) || (z->avail_out == 0))
+		return -1;
+	n = outlen - z->avail_out;
+
+	/* Strip the 0x00 0x00 0xff 0xff at the end (RFC7692 section 7.2.1) */
+	if ((n >= 4) && !memcmp(out + n - 4, "\x00\x00\xff\xff", 4))
+		n -= 4;
+
+	if (c->server_no_context_takeover)
+		deflateReset(z);
+
+	c->bytes_out_raw += inlen;
+	c->bytes_out += n;
+	c->cpu_usec += websocket_usec_since(&start);
+	return n;
+}
+
+/** Handle a (fragment of a) compressed data message.
+ * The payload is decompressed and then handed over to process_packet().
+ * The maximum size of the decompressed data is WEBSOCKET_MAX_FRAME_SIZE,
+ * which also protects us against decompression bombs.
+ * @returns 0 on success, -1 if the client was killed.
+ */
+int websocket_handle_compressed(Client *client, char *payload, int len, int fin)
+{
+	static char buf[WEBSOCKET_MAX_FRAME_SIZE + 1]; /* +1 for the \n */
+	static char trailer[4] = { 0x00, 0x00, 0xff, 0xff };
+	WebSocketCompression *c = WSU(client)->compression;
+	z_stream *z = &c->inflate;
+	struct timeval start;
+	int r, n;
+
+	gettimeofday(&start, NULL);
+
+	z->next_out = (Bytef *)buf;
+	z->avail_out = WEBSOCKET_MAX_FRAME_SIZE;
+	z->next_in = (Bytef *)payload;
+	z->avail_in = len;
+	r = inflate(z, Z_SYNC_FLUSH);
+	if (fin && ((r == Z_OK) || (r == Z_BUF_ERROR)) && (z->avail_in == 0) && (z->avail_out > 0))
+	{
+		/* Add the 0x00 0x00 0xff 0xff that the client stripped off */
+		z->next_in = (Bytef *)trailer;
+		z->avail_in = sizeof(trailer);
+		r = inflate(z, Z_SYNC_FLUSH);
+	}
+	c->cpu_usec += websocket_usec_since(&start);
+
+	if ((r != Z_OK) && (r != Z_BUF_ERROR))
+	{
+		dead_socket(client, "WebSocket: decompression error");
+		return -1;
+	}
+	if ((z->avail_in > 0) || (z->avail_out == 0))
+	{
+		dead_socket(client, "WebSocket: oversized compressed message");
+		return -1;
+	}
+
+	n = WEBSOCKET_MAX_FRAME_SIZE - z->avail_out;
+	c->bytes_in += len;
+	c->bytes_in_raw += n;
+
+	if (fin && ((n == 0) || (buf[n - 1] != '\n')))
+		buf[n++] = '\n'; /* safe, see size of buf */
+
+	if ((n > 0) && !process_packet(client, buf, n, 1))
+		return -1; /* fatal error occured (such as flood kill) */
+
+	return 0;
+}
+#endif
@@ -54,9 +54,24 @@ ModuleHeader MOD_HEADER
 #define HasField(x, y) ((x)->fields & (y))
 #define IsMatch(x, y) ((x)->matchsel & (y))
 
-#define IsMarked(x)           (moddata_client(x, whox_md).l)
-#define SetMark(x)            do { moddata_client(x, whox_md).l = 1; } while(0)
-#define ClearMark(x)          do { moddata_client(x, whox_md).l = 0; } while(0)
+/* Clients are marked with the number of the current who_global() run,
+ * this way the marks never need to be cleared.
+ */
+#define IsMarked(x)           (moddata_client(x, whox_md).l == who_generation)
+#define SetMark(x)            do { moddata_client(x, whox_md).l = who_generation; } while(0)
+
+/* IP index: users grouped by the first 16 bits (IPv4) or 32 bits (IPv6)
+ * of their IP address, so an IRCOp doing "WHO 203.0.113.* i" only looks
+ * at the users in one bucket instead of at all users on the network.
+ */
+#define WHO_IPINDEX_SIZE	65536
+
+typedef struct WhoIPEntry WhoIPEntry;
+struct WhoIPEntry {
+	WhoIPEntry *prev, *next;
+	Client *client;
+	unsigned int key;
+};
 
 /* Structs */
 struct who_format
@@ -68,10 +83,14 @@ struct who_format
 	const char *querytype;
 	int show_realhost;
 	int show_ip;
+	MatchGlob *glob; /**< The mask, compiled once for all do_match() calls */
 };
 
 /* Global variables */
 ModDataInfo *whox_md = NULL;
+ModDataInfo *whox_ipindex_md = NULL;
+static long who_generation = 0;
+static WhoIPEntry *who_ipindex[WHO_IPINDEX_SIZE];
 
 /* Forward declarations */
 CMD_FUNC(cmd_whox);
@@ -83,6 +102,8 @@ static int convert_classical_who_request(Client *client, int *parc, char *parv[]
 char *whox_md_serialize(ModData *m);
 void whox_md_unserialize(char *str, ModData *m);
 void whox_md_free(ModData *md);
+void whox_ipindex_md_free(ModData *md);
+int whox_ipindex_add(Client *client);
 
 MOD_INIT()
 {
@@ -90,6 +111,11 @@ MOD_INIT()
 
 	MARK_AS_OFFICIAL_MODULE(modinfo);
 
+	/* The marks in the "whox" moddata survive a module reload,
+	 * so the generation counter has to survive it as well.
+	 */
+	LoadPersistentLong(modinfo, who_generation);
+
 	if (!CommandAdd(modinfo->handle, "WHO", cmd_whox, MAXPARA, CMD_USER))
 	{
 		config_warn("You cannot load both cmd_whox and cmd_who. You should ONLY load the cmd_whox module.");
@@ -110,17 +136,43 @@ MOD_INIT()
 		return MOD_FAILED;
 	}
 
+	memset(&mreq, 0, sizeof(mreq));
+	mreq.name = "whox_ipindex";
+	mreq.type = MODDATATYPE_CLIENT;
+	mreq.free = whox_ipindex_md_free;
+	whox_ipindex_md = ModDataAdd(modinfo->handle, mreq);
+	if (!whox_ipindex_md)
+	{
+		config_error("could not register whox moddata");
+		return MOD_FAILED;
+	}
+
+	HookAdd(modinfo->handle, HOOKTYPE_LOCAL_CONNECT, 0, whox_ipindex_add);
+	HookAdd(modinfo->handle, HOOKTYPE_REMOTE_CONNECT, 0, whox_ipindex_add);
+
 	ISupportAdd(modinfo->handle, "WHOX", NULL);
 	return MOD_SUCCESS;
 }
 
 MOD_LOAD()
 {
+	Client *acptr;
+
+	/* (Re)build the IP index. Entries of a previous instance of this
+	 * module are not linked to our index, so just drop them.
+	 */
+	list_for_each_entry(acptr, &client_list, client_node)
+	{
+		safe_free(moddata_client(acptr, whox_ipindex_md).ptr);
+		if (IsUser(acptr))
+			whox_ipindex_add(acptr);
+	}
 	return MOD_SUCCESS;
 }
 
 MOD_UNLOAD()
 {
+	SavePersistentLong(modinfo, who_generation);
 	return MOD_SUCCESS;
 }
 
@@ -147,6 +199,107 @@ void whox_md_free(ModData *md)
 	md->l = 0;
 }
 
+/** Convert an IP address to binary.
+ * @returns 4 for IPv4, 16 for IPv6, 0 if not a valid IP
+ */
+static int who_ip_to_binary(const char *ip, unsigned char *addr)
+{
+	if (inet_pton(AF_INET, ip, addr) == 1)
+		return 4;
+	if (inet_pton(AF_INET6, ip, addr) == 1)
+		return 16;
+	return 0;
+}
+
+static unsigned int who_ipindex_key(const unsigned char *addr, int len)
+{
+	if (len == 4)
+		return (addr[0] << 8) | addr[1];
+	/* The /32 of IPv6, folded into the same table */
+	return ((((unsigned int)addr[0] << 24) | (addr[1] << 16) | (addr[2] << 8) | addr[3]) * 2654435761U) >> 16;
+}
+
+/** Add a user to the IP index (on connect) */
+int whox_ipindex_add(Client *client)
+{
+	unsigned char addr[16];
+	WhoIPEntry *e;
+	int len;
+
+	if (!client->ip || !(len = who_ip_to_binary(client->ip, addr)))
+		return 0;
+
+	e = safe_alloc(sizeof(WhoIPEntry));
+	e->client = client;
+	e->key = who_ipindex_key(addr, len);
+	if (who_ipindex[e->key])
+		who_ipindex[e->key]->prev = e;
+	e->next = who_ipindex[e->key];
+	who_ipindex[e->key] = e;
+	moddata_client(client, whox_ipindex_md).ptr = e;
+	return 0;
+}
+
+/** Remove a user from the IP index (when the client is freed) */
+void whox_ipindex_md_free(ModData *md)
+{
+	WhoIPEntry *e = md->ptr;
+
+	if (!e)
+		return;
+	if (e->prev)
+		e->prev->next = e->next;
+	else
+		who_ipindex[e->key] = e->next;
+	if (e->next)
+		e->next->prev = e->prev;
+	safe_free(md->ptr);
+}
+
+/** Find the IP index bucket that holds all IP addresses matching 'mask'.
+ * This handles a plain IP address, CIDR masks of at least /16 (IPv4)
+ * or /32 (IPv6) and IPv4 masks like 203.0.* or 203.0.113.*
+ * @returns 1 and sets 'key' if the index can be used, 0 if not.
+ */
+static int who_ipindex_query(const char *mask, unsigned int *key)
+{
+	char buf[64], *p;
+	unsigned char addr[16];
+	const char *s;
+	int len, octet, i;
+
+	strlcpy(buf, mask, sizeof(buf));
+	if ((p = strchr(buf, '/')))
+	{
+		*p++ = '\0';
+		len = who_ip_to_binary(buf, addr);
+		if (!len || (atoi(p) < ((len == 4) ? 16 : 32)))
+			return 0;
+		*key = who_ipindex_key(addr, len);
+		return 1;
+	}
+
+	if ((len = who_ip_to_binary(buf, addr)))
+	{
+		*key = who_ipindex_key(addr, len);
+		return 1;
+	}
+
+	/* IPv4 with wildcards: the first two octets must be given literally */
+	for (s = mask, i = 0; i < 2; i++)
+	{
+		if (!isdigit(*s))
+			return 0;
+		for (octet = 0; isdigit(*s) && (octet <= 255); s++)
+			octet = (octet * 10) + (*s - '0');
+		if ((octet > 255) || (*s++ != '.'))
+			return 0;
+		addr[i] = octet;
+	}
+	*key = who_ipindex_key(addr, 4);
+	return 1;
+}
+
 /** cmd_whox: standardized "extended" version of WHO.
  * The good thing about WHOX is that it allows the client to define what
  * output they want to see. Another good thing is that it is standardized
@@ -362,13 +515,25 @@ CMD_FUNC(cmd_whox)
 	 * with "/who" ;) --fl
 	 */
 	if (!strcmp(mask, "0"))
+	{
 		who_global(client, NULL, 0, &fmt);
-	else
+	} else {
+		fmt.glob = match_glob_compile(mask);
 		who_global(client, mask, operspy, &fmt);
+		match_glob_free(fmt.glob);
+	}
 
 	sendnumeric(client, RPL_ENDOFWHO, mask);
 }
 
+/** Match a mask against a string, using the compiled mask if we have one */
+static inline int who_match_mask(struct who_format *fmt, const char *mask, const char *str)
+{
+	if (fmt->glob)
+		return match_glob(fmt->glob, str);
+	return match_simple(mask, str);
+}
+
 /* do_match
  * inputs	- pointer to client requesting who
  *		- pointer to client to do who on
@@ -383,39 +548,39 @@ static int do_match(Client *client, Client *acptr, char *mask, struct who_format
 		return 1;
 
 	/* default */
-	if (fmt->matchsel == 0 && (match_simple(mask, acptr->name) ||
-		match_simple(mask, acptr->user->username) ||
-		match_simple(mask, GetHost(acptr)) ||
+	if (fmt->matchsel == 0 && (who_match_mask(fmt, mask, acptr->name) ||
+		who_match_mask(fmt, mask, acptr->user->username) ||
+		who_match_mask(fmt, mask, GetHost(acptr)) ||
 		(IsOper(client) &&
-		(match_simple(mask, acptr->user->realhost) ||
+		(who_match_mask(fmt, mask, acptr->user->realhost) ||
 		(acptr->ip &&
-		match_simple(mask, acptr->ip))))))
+		who_match_mask(fmt, mask, acptr->ip))))))
 	{
 		return 1;
 	}
 
 	/* match nick */
-	if (IsMatch(fmt, WMATCH_NICK) && match_simple(mask, acptr->name))
+	if (IsMatch(fmt, WMATCH_NICK) && who_match_mask(fmt, mask, acptr->name))
 		return 1;
 
 	/* match username */
-	if (IsMatch(fmt, WMATCH_USER) && match_simple(mask, acptr->user->username))
+	if (IsMatch(fmt, WMATCH_USER) && who_match_mask(fmt, mask, acptr->user->username))
 		return 1;
 
 	/* match server */
-	if (IsMatch(fmt, WMATCH_SERVER) && IsOper(client) && match_simple(mask, acptr->user->server))
+	if (IsMatch(fmt, WMATCH_SERVER) && IsOper(client) && who_match_mask(fmt, mask, acptr->user->server))
 		return 1;
 
 	/* match hostname */
-	if (IsMatch(fmt, WMATCH_HOST) && (match_simple(mask, GetHost(acptr)) ||
-		(IsOper(client) && (match_simple(mask, acptr->user->realhost) ||
-		(acptr->ip && match_simple(mask, acptr->ip))))))
+	if (IsMatch(fmt, WMATCH_HOST) && (who_match_mask(fmt, mask, GetHost(acptr)) ||
+		(IsOper(client) && (who_match_mask(fmt, mask, acptr->user->realhost) ||
+		(acptr->ip && who_match_mask(fmt, mask, acptr->ip))))))
 	{
 		return 1;
 	}
 
 	/* match realname */
-	if (IsMatch(fmt, WMATCH_INFO) && match_simple(mask, acptr->info))
+	if (IsMatch(fmt, WMATCH_INFO) && who_match_mask(fmt, mask, acptr->info))
 		return 1;
 
 	/* match ip address */
@@ -425,7 +590,7 @@ static int do_match(Client *client, Client *acptr, char *mask, struct who_format
 
 	/* match account */
 	if (IsMatch(fmt, WMATCH_ACCOUNT) && !BadPtr(acptr->user->svid) &&
-		!isdigit(*acptr->user->svid) && match_simple(mask, acptr->user->svid))
+		!isdigit(*acptr->user->svid) && who_match_mask(fmt, mask, acptr->user->svid))
 	{
 		return 1;
 	}
@@ -516,23 +681,48 @@ static void who_common_channel(Client *client, Channel *channel,
  * output		- NONE
  * side effects		- do a global scan of all clients looking for match
  *			  this is slightly expensive on EFnet ...
- *			  marks assumed cleared for all clients initially
- *			  and will be left cleared on return
+ *			  uses a new generation of client marks
  */
 
+static void who_global_match(Client *client, Client *acptr, Client *hunted, char *mask,
+                             int operspy, int *maxmatches, struct who_format *fmt)
+{
+	if (!IsUser(acptr))
+		return;
+
+	if (IsInvisible(acptr) && !operspy && (client != acptr) && (acptr != hunted))
+		return;
+
+	if (IsMarked(acptr))
+		return;
+
+	if (IsMatch(fmt, WMATCH_OPER) && !IsOper(acptr))
+		return;
+
+	if (*maxmatches > 0)
+	{
+		if (do_match(client, acptr, mask, fmt))
+		{
+			do_who(client, acptr, NULL, fmt);
+			--(*maxmatches);
+		}
+	}
+}
+
 static void who_global(Client *client, char *mask, int operspy, struct who_format *fmt)
 {
 	Client *hunted = NULL;
 	Client *acptr;
+	WhoIPEntry *e;
+	unsigned int key;
 	int maxmatches = IsOper(client) ? INT_MAX : WHOLIMIT;
 
 	/* If searching for a nick explicitly, then include it later on in the result: */
 	if (mask && ((fmt->matchsel & WMATCH_NICK) || (fmt->matchsel == 0)))
 		hunted = find_person(mask, NULL);
 
-	/* Initialize the markers to zero */
-	list_for_each_entry(acptr, &client_list, client_node)
-		ClearMark(acptr);
+	/* New set of markers */
+	who_generation++;
 
 	/* First, if not operspy, then list all matching clients on common channels */
 	if (!operspy)
@@ -543,29 +733,17 @@ static void who_global(Client *client, char *mask, int operspy, struct who_forma
 			who_common_channel(client, lp->channel, mask, &maxmatches, fmt);
 	}
 
-	/* Second, list all matching visible clients. */
-	list_for_each_entry(acptr, &client_list, client_node)
+	/* Second, list all matching visible clients.
+	 * For a search on IP only we just need to look at one bucket
+	 * of the IP index (do_match() will still check the full mask).
+	 */
+	if (mask && (fmt->matchsel == WMATCH_IP) && IsOper(client) && who_ipindex_query(mask, &key))
 	{
-		if (!IsUser(acptr))
-			continue;
-
-		if (IsInvisible(acptr) && !operspy && (client != acptr) && (acptr != hunted))
-			continue;
-
-		if (IsMarked(acptr))
-			continue;
-
-		if (IsMatch(fmt, WMATCH_OPER) && !IsOper(acptr))
-			continue;
-
-		if (maxmatches > 0)
-		{
-			if (do_match(client, acptr, mask, fmt))
- 			{
-				do_who(client, acptr, NULL, fmt);
-				--maxmatches;
- 			}
- 		}
+		for (e = who_ipindex[key]; e; e = e->next)
+			who_global_match(client, e->client, hunted, mask, operspy, &maxmatches, fmt);
+	} else {
+		list_for_each_entry(acptr, &client_list, client_node)
+			who_global_match(client, acptr, hunted, mask, operspy, &maxmatches, fmt);
 	}
 
 	if (maxmatches <= 0)
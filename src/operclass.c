@@ -216,7 +216,16 @@ unsigned char OperClass_evaluateACLEntry(OperClassACLEntry *entry, OperClassACLP
 	return eval;	
 }
 
-OperPermission ValidatePermissionsForPathEx(OperClassACL *acl, OperClassACLPath *path, OperClassCheckParams *params)
+/** Evaluate the ACL for the specified path.
+ * @param acl		The (top level) ACL that matched the first path element
+ * @param path		The full path
+ * @param params	The client, victim, channel, etc. Or NULL if we are only
+ *			compiling, in which case any entry with variables makes
+ *			us bail out.
+ * @param dynamic	Set to 1 if the result depends on variables (params)
+ * @returns OPER_ALLOW or OPER_DENY
+ */
+static OperPermission OperClass_validateACL(OperClassACL *acl, OperClassACLPath *path, OperClassCheckParams *params, int *dynamic)
 {
 	/** Evaluate into ACL struct as deep as possible **/
 	OperClassACLPath *basePath = path;
@@ -259,6 +268,13 @@ OperPermission ValidatePermissionsForPathEx(OperClassACL *acl, OperClassACLPath
 		if (entry->type == OPERCLASSENTRY_DENY && deny)
 			continue;
 
+		if (entry->variables)
+		{
+			*dynamic = 1;
+			if (!params)
+				return OPER_DENY; /* only compiling, result is thrown away */
+		}
+
 		result = OperClass_evaluateACLEntry(entry,basePath,params);
 		if (entry->type == OPERCLASSENTRY_ALLOW)
 		{
@@ -279,54 +295,25 @@ OperPermission ValidatePermissionsForPathEx(OperClassACL *acl, OperClassACLPath
 	return OPER_DENY;
 }
 
-OperPermission ValidatePermissionsForPath(char *path, Client *client, Client *victim, Channel *channel, void *extra)
+OperPermission ValidatePermissionsForPathEx(OperClassACL *acl, OperClassACLPath *path, OperClassCheckParams *params)
 {
-	ConfigItem_oper *ce_oper;
-	ConfigItem_operclass *ce_operClass;
-	OperClass *oc = NULL;
-	OperClassACLPath *operPath;
-
-	if (!client)
-		return OPER_DENY;
+	int dynamic = 0;
 
-	/* Trust Servers, U-Lines and remote opers */
-	if (IsServer(client) || IsULine(client) || (IsOper(client) && !MyUser(client)))
-		return OPER_ALLOW;
-
-	if (!IsOper(client))
-		return OPER_DENY;
+	return OperClass_validateACL(acl, path, params, &dynamic);
+}
 
-	ce_oper = find_oper(client->user->operlogin);
-	if (!ce_oper)
-	{
-		return OPER_DENY;
-	}
-	
-	ce_operClass = find_operclass(ce_oper->operclass);
-	if (!ce_operClass)
-	{
-		return OPER_DENY;
-	}
+/** Evaluate a path against an operclass, following the parent operclasses.
+ * See OperClass_validateACL() for the parameters.
+ */
+static OperPermission OperClass_evaluatePath(ConfigItem_operclass *ce_operClass, OperClassACLPath *operPath, OperClassCheckParams *params, int *dynamic)
+{
+	OperClass *oc = ce_operClass->classStruct;
 
-	oc = ce_operClass->classStruct;
-	operPath = OperClass_parsePath(path);
 	while (oc && operPath)
 	{
 		OperClassACL *acl = OperClass_FindACL(oc->acls,operPath->identifier);
 		if (acl)
-		{
-			OperPermission perm;
-			OperClassCheckParams *params = safe_alloc(sizeof(OperClassCheckParams));
-			params->client = client;
-			params->victim = victim;
-			params->channel = channel;
-			params->extra = extra;
-			
-			perm = ValidatePermissionsForPathEx(acl, operPath, params);
-			OperClass_freePath(operPath);
-			safe_free(params);
-			return perm;
-		}
+			return OperClass_validateACL(acl, operPath, params, dynamic);
 		if (!oc->ISA)
 		{
 			break;
@@ -339,6 +326,222 @@ OperPermission ValidatePermissionsForPath(char *path, Client *client, Client *vi
 			break; /* parent not found */
 		}
 	}
-	OperClass_freePath(operPath);
 	return OPER_DENY;
 }
+
+/*
+ * Compiled permissions.
+ *
+ * Every permission path that is checked gets a small integer ID, and
+ * the parsed path is kept. For each local IRCOp we then evaluate all
+ * permissions once (at the first check after /OPER or a rehash) and
+ * store the result as a bit, so a typical permission check is a hash
+ * lookup (or nothing at all, when the caller uses the ID directly)
+ * followed by a bit test. Only permissions that hit ACL entries with
+ * variables, such as operclass::permissions::xyz { channel "#x"; },
+ * are still evaluated on every call.
+ */
+
+typedef struct OperPermissionPath OperPermissionPath;
+struct OperPermissionPath
+{
+	OperPermissionPath *hnext;
+	int id;
+	char *name;
+	OperClassACLPath *path;
+};
+
+#define OPERPERM_HASH_TABLE_SIZE	512
+#define PERMBIT_ISSET(set, id)		((set)[(id) >> 3] & (1 << ((id) & 7)))
+#define PERMBIT_SET(set, id)		((set)[(id) >> 3] |= (1 << ((id) & 7)))
+
+static OperPermissionPath *operPermHash[OPERPERM_HASH_TABLE_SIZE];
+static OperPermissionPath **operPermByID = NULL; /**< Indexed by ID, 0 is never used */
+static int operPermCount = 0; /**< Highest ID handed out */
+static int operPermSize = 0; /**< Allocated entries in operPermByID */
+static char siphashkey_operperm[SIPHASH_KEY_LENGTH];
+
+/** Increased on every rehash, this invalidates all compiled permissions */
+MODVAR int operclass_generation = 0;
+
+/** Get the ID of a permission path, such as "immune:server-ban:spamfilter".
+ * The ID stays valid for the lifetime of the process, so callers that check
+ * the same permission often can look it up once and then use
+ * ValidatePermissionsForID().
+ */
+int OperClassGetPermissionID(char *path)
+{
+	OperPermissionPath *e;
+	unsigned int hashv;
+
+	if (!operPermByID)
+		siphash_generate_key(siphashkey_operperm);
+
+	hashv = siphash(path, siphashkey_operperm) % OPERPERM_HASH_TABLE_SIZE;
+	for (e = operPermHash[hashv]; e; e = e->hnext)
+		if (!strcmp(e->name, path))
+			return e->id;
+
+	/* New permission path */
+	if (operPermCount + 1 >= operPermSize)
+	{
+		OperPermissionPath **newtable = safe_alloc(sizeof(OperPermissionPath *) * (operPermSize + 256));
+		if (operPermByID)
+			memcpy(newtable, operPermByID, sizeof(OperPermissionPath *) * operPermSize);
+		safe_free(operPermByID);
+		operPermByID = newtable;
+		operPermSize += 256;
+	}
+
+	e = safe_alloc(sizeof(OperPermissionPath));
+	safe_strdup(e->name, path);
+	e->path = OperClass_parsePath(path);
+	e->id = ++operPermCount;
+	e->hnext = operPermHash[hashv];
+	operPermHash[hashv] = e;
+	operPermByID[e->id] = e;
+	return e->id;
+}
+
+/** Free the compiled permissions of an IRCOp, eg after (re)opering */
+void OperClassPermissionsReset(Client *client)
+{
+	OperPermissionCache *cache;
+
+	if (!client->user || !client->user->operperms)
+		return;
+
+	cache = client->user->operperms;
+	safe_free(cache->compiled);
+	safe_free(cache->dynamic);
+	safe_free(cache->allowed);
+	safe_free(client->user->operperms);
+}
+
+/** Make sure the bitsets in the cache have room for all IDs handed out so far */
+static void OperClass_growCache(OperPermissionCache *cache)
+{
+	unsigned char *compiled, *dynamic, *allowed;
+	int oldbytes = cache->size / 8;
+	int newbytes = operPermSize / 8;
+
+	if (cache->size >= operPermSize)
+		return;
+
+	compiled = safe_alloc(newbytes);
+	dynamic = safe_alloc(newbytes);
+	allowed = safe_alloc(newbytes);
+	if (oldbytes)
+	{
+		memcpy(compiled, cache->compiled, oldbytes);
+		memcpy(dynamic, cache->dynamic, oldbytes);
+		memcpy(allowed, cache->allowed, oldbytes);
+	}
+	safe_free(cache->compiled);
+	safe_free(cache->dynamic);
+	safe_free(cache->allowed);
+	cache->compiled = compiled;
+	cache->dynamic = dynamic;
+	cache->allowed = allowed;
+	cache->size = operPermSize;
+}
+
+/** Evaluate the permission with this ID once and store the result */
+static void OperClass_compilePermission(OperPermissionCache *cache, int id)
+{
+	int dynamic = 0;
+
+	OperClass_growCache(cache);
+	if (OperClass_evaluatePath(cache->operclass, operPermByID[id]->path, NULL, &dynamic) == OPER_ALLOW)
+		PERMBIT_SET(cache->allowed, id);
+	if (dynamic)
+		PERMBIT_SET(cache->dynamic, id);
+	PERMBIT_SET(cache->compiled, id);
+}
+
+/** Return the compiled permissions of a local IRCOp, compiling them if needed.
+ * @returns The permissions, or NULL if the oper block or operclass no longer exists.
+ */
+static OperPermissionCache *OperClass_getCache(Client *client)
+{
+	OperPermissionCache *cache = client->user->operperms;
+	ConfigItem_oper *ce_oper;
+	ConfigItem_operclass *ce_operClass;
+	int id;
+
+	if (cache && (cache->generation == operclass_generation))
+		return cache;
+
+	OperClassPermissionsReset(client);
+
+	ce_oper = find_oper(client->user->operlogin);
+	if (!ce_oper)
+		return NULL;
+
+	ce_operClass = find_operclass(ce_oper->operclass);
+	if (!ce_operClass)
+		return NULL;
+
+	cache = safe_alloc(sizeof(OperPermissionCache));
+	cache->generation = operclass_generation;
+	cache->operclass = ce_operClass;
+	client->user->operperms = cache;
+
+	for (id = 1; id <= operPermCount; id++)
+		OperClass_compilePermission(cache, id);
+
+	return cache;
+}
+
+/** Check if the client has the permission with the specified ID.
+ * This is the same as ValidatePermissionsForPath() but skips the lookup
+ * of the path, see OperClassGetPermissionID().
+ */
+OperPermission ValidatePermissionsForID(int id, Client *client, Client *victim, Channel *channel, void *extra)
+{
+	OperPermissionCache *cache;
+	OperClassCheckParams params;
+	int dynamic = 0;
+
+	if (!client)
+		return OPER_DENY;
+
+	/* Trust Servers, U-Lines and remote opers */
+	if (IsServer(client) || IsULine(client) || (IsOper(client) && !MyUser(client)))
+		return OPER_ALLOW;
+
+	if (!IsOper(client) || (id <= 0) || (id > operPermCount))
+		return OPER_DENY;
+
+	cache = OperClass_getCache(client);
+	if (!cache)
+		return OPER_DENY;
+
+	if ((id >= cache->size) || !PERMBIT_ISSET(cache->compiled, id))
+		OperClass_compilePermission(cache, id); /* new path since we compiled */
+
+	if (!PERMBIT_ISSET(cache->dynamic, id))
+		return PERMBIT_ISSET(cache->allowed, id) ? OPER_ALLOW : OPER_DENY;
+
+	/* Depends on the victim, channel, etc. */
+	params.client = client;
+	params.victim = victim;
+	params.channel = channel;
+	params.extra = extra;
+	return OperClass_evaluatePath(cache->operclass, operPermByID[id]->path, &params, &dynamic);
+}
+
+OperPermission ValidatePermissionsForPath(char *path, Client *client, Client *victim, Channel *channel, void *extra)
+{
+	if (!client)
+		return OPER_DENY;
+
+	/* Trust Servers, U-Lines and remote opers */
+	if (IsServer(client) || IsULine(client) || (IsOper(client) && !MyUser(client)))
+		return OPER_ALLOW;
+
+	if (!IsOper(client))
+		return OPER_DENY;
+
+	return ValidatePermissionsForID(OperClassGetPermissionID(path), client, victim, channel, extra);
+}
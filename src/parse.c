@@ -50,6 +50,16 @@ static int client_lagged_up(Client *client);
  */
 int process_packet(Client *client, char *readbuf, int length, int killsafely)
 {
+#ifdef HAVE_ZLIB
+	int r;
+
+	if (zip_in_active(client))
+	{
+		/* Compressed server link: decompress to the recvQ */
+		if (!zip_uncompress(client, readbuf, length))
+			return 0;
+	} else
+#endif
 	dbuf_put(&client->local->recvQ, readbuf, length);
 
 	/* parse some of what we have (inducing fakelag, etc) */
@@ -59,10 +69,22 @@ int process_packet(Client *client, char *readbuf, int length, int killsafely)
 	if (IsDead(client))
 		return 0;
 
+#ifdef HAVE_ZLIB
+	/* Decompression stops at the recvQ limit, continue now that it is parsed */
+	while ((r = zip_uncompress_more(client)) > 0)
+	{
+		parse_client_queued(client);
+		if (IsDead(client))
+			return 0;
+	}
+	if (r < 0)
+		return 0;
+#endif
+
 	/* flood from unknown connection */
 	if (IsUnknown(client) && (DBufLength(&client->local->recvQ) > UNKNOWN_FLOOD_AMOUNT*1024))
 	{
-		sendto_snomask(SNO_FLOOD, "Flood from unknown connection %s detected",
+		sendto_snomask_coalesced(SNO_FLOOD, "Flood from unknown connection %s detected",
 			client->local->sockhost);
 		if (!killsafely)
 			ban_flooder(client);
@@ -74,7 +96,7 @@ int process_packet(Client *client, char *readbuf, int length, int killsafely)
 	/* excess flood check */
 	if (IsUser(client) && DBufLength(&client->local->recvQ) > get_recvq(client))
 	{
-		sendto_snomask(SNO_FLOOD,
+		sendto_snomask_coalesced(SNO_FLOOD,
 			"*** Flood -- %s!%s@%s (%d) exceeds %d recvQ",
 			client->name[0] ? client->name : "*",
 			client->user ? client->user->username : "*",
@@ -183,6 +205,8 @@ void parse(Client *cptr, char *buffer, int length)
 	 */
 	for (h = Hooks[HOOKTYPE_PACKET]; h; h = h->next)
 	{
+		if (!PacketHookWanted(h, from))
+			continue;
 		(*(h->func.intfunc))(from, &me, NULL, &buffer, &length);
 		if(!buffer)
 			return;
@@ -195,7 +219,7 @@ void parse(Client *cptr, char *buffer, int length)
 
 	if ((cptr->local->receiveK >= UNKNOWN_FLOOD_AMOUNT) && IsUnknown(cptr))
 	{
-		sendto_snomask(SNO_FLOOD, "Flood from unknown connection %s detected",
+		sendto_snomask_coalesced(SNO_FLOOD, "Flood from unknown connection %s detected",
 			cptr->local->sockhost);
 		ban_flooder(cptr);
 		return;
@@ -216,6 +240,11 @@ void parse(Client *cptr, char *buffer, int length)
 	for (ch = buffer; *ch == ' '; ch++)
 		;
 
+	/* Message tags created while processing this command are
+	 * allocated from the arena, which is released at the end.
+	 */
+	mtag_arena_begin();
+
 	/* Now, parse message tags, if any */
 	if (*ch == '@')
 	{
@@ -233,6 +262,7 @@ void parse(Client *cptr, char *buffer, int length)
 		RunHook3(HOOKTYPE_POST_COMMAND, from, mtags, ch);
 
 	free_message_tags(mtags);
+	mtag_arena_end();
 	return;
 }
 
@@ -254,6 +284,7 @@ static void parse2(Client *cptr, Client **fromptr, MessageTag *mtags, char *ch)
 #endif
 	RealCommand *cmptr = NULL;
 	int bytes;
+	long long start;
 
 	*fromptr = cptr; /* The default, unless a source is specified (and permitted) */
 
@@ -495,6 +526,7 @@ static void parse2(Client *cptr, Client **fromptr, MessageTag *mtags, char *ch)
 	if (IsUser(cptr) && (cmptr->flags & CMD_RESETIDLE))
 		cptr->local->last = TStime();
 
+	start = profile_now();
 #ifndef DEBUGMODE
 	if (cmptr->flags & CMD_ALIAS)
 	{
@@ -526,6 +558,7 @@ static void parse2(Client *cptr, Client **fromptr, MessageTag *mtags, char *ch)
 		cptr->local->cputime += ticks;
 	}
 #endif
+	latency_add(&cmptr->latency, profile_now() - start);
 }
 
 /** Ban user that is "flooding from an unknown connection".
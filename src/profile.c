@@ -0,0 +1,423 @@
+/* Command, hook and event latency profiler
+ * (C) Copyright 2020-present the UnrealIRCd team
+ * License: GPLv2
+ */
+
+/** @file
+ * @brief Command, hook and event latency profiler.
+ *
+ * When the server lags it is often hard to tell which command,
+ * module or event is responsible. For this we always measure:
+ * - the time spent in each command handler (see parse2()),
+ * - the time spent in each hook, per hook type and per hook
+ *   so it can be attributed to a module (see the RunHook macros),
+ * - the time spent in each event (see DoEvents()),
+ * - the time spent in the main loop itself (see SocketLoop()).
+ *
+ * Times are taken from the monotonic clock, which is cheap (no system
+ * call on most systems), and are put in a LatencyHistogram. The
+ * histogram has log-linear buckets: 4 buckets for each power of two,
+ * so any value is stored with an error of at most 25%, while the
+ * whole range from 1ns to several seconds fits in 128 counters.
+ *
+ * The results can be viewed with STATS R (profile), which shows the
+ * top entries and writes the full report to a file. The main loop
+ * statistics can also be exported to a monitoring system, see the
+ * metrics module.
+ */
+
+#include "unrealircd.h"
+
+/** Number of entries of each type shown in STATS R */
+#define PROFILE_SHOW_TOP	10
+
+/** Name of the full report file, in the log directory */
+#define PROFILE_REPORT_FILE	"profile.txt"
+
+extern MODVAR Event *events;
+
+/** Time spent in hooks, per hook type */
+static LatencyHistogram hook_latency[MAXHOOKTYPES];
+
+/** Current time in nanoseconds from a monotonic clock.
+ * Only useful for measuring the time between two calls.
+ */
+long long profile_now(void)
+{
+#ifndef _WIN32
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (long long)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+#else
+	static LARGE_INTEGER freq;
+	LARGE_INTEGER now;
+
+	if (!freq.QuadPart)
+		QueryPerformanceFrequency(&freq);
+	QueryPerformanceCounter(&now);
+	return (long long)((double)now.QuadPart * 1000000000.0 / (double)freq.QuadPart);
+#endif
+}
+
+/** Histogram bucket for a value */
+static int latency_bucket(unsigned long long value)
+{
+	int shift = 0;
+	int bucket;
+
+	if (value < 4)
+		return (int)value;
+	/* Reduce the value to 4..7, the last two bits of which
+	 * select one of the 4 buckets of this power of two.
+	 */
+	while (value >= 8)
+	{
+		value >>= 1;
+		shift++;
+	}
+	bucket = 4 + shift * 4 + (int)(value - 4);
+	if (bucket >= LATENCY_BUCKETS)
+		bucket = LATENCY_BUCKETS - 1;
+	return bucket;
+}
+
+/** Lowest value that is put in this histogram bucket */
+static unsigned long long latency_bucket_value(int bucket)
+{
+	if (bucket < 4)
+		return bucket;
+	bucket -= 4;
+	return (unsigned long long)(4 + bucket % 4) << (bucket / 4);
+}
+
+/** Add a measurement to a histogram.
+ * @param h		The histogram
+ * @param value		The measured time, in nanoseconds
+ */
+void latency_add(LatencyHistogram *h, long long value)
+{
+	if (value < 0)
+		value = 0;
+	h->count++;
+	h->total += value;
+	if (value > h->max)
+		h->max = value;
+	h->buckets[latency_bucket(value)]++;
+}
+
+/** Estimate a percentile from a histogram.
+ * @param h		The histogram
+ * @param percentile	The percentile (eg: 99 for p99)
+ * @returns The upper bound of the bucket the percentile falls in
+ *          (and never more than the maximum seen), or 0 if empty.
+ */
+unsigned long long latency_percentile(LatencyHistogram *h, int percentile)
+{
+	unsigned long long want, seen = 0;
+	int i;
+
+	if (h->count == 0)
+		return 0;
+
+	want = (h->count * percentile + 99) / 100;
+	if (want == 0)
+		want = 1;
+
+	for (i = 0; i < LATENCY_BUCKETS - 1; i++)
+	{
+		seen += h->buckets[i];
+		if (seen >= want)
+		{
+			unsigned long long value = latency_bucket_value(i + 1) - 1;
+			return MIN(value, h->max);
+		}
+	}
+	return h->max;
+}
+
+/** Count the measurements below a value, eg. for exporting the
+ * histogram with fixed boundaries.
+ * @param h		The histogram
+ * @param value		The value
+ * @returns The number of measurements lower than the value. This is
+ *          exact if the value is below 8 or a power of two.
+ */
+unsigned long long latency_count_below(LatencyHistogram *h, unsigned long long value)
+{
+	unsigned long long cnt = 0;
+	int i, bucket;
+
+	bucket = latency_bucket(value);
+	for (i = 0; i < bucket; i++)
+		cnt += h->buckets[i];
+	return cnt;
+}
+
+/** Record the time spent in a hook, called from the RunHook macros.
+ * @param h		The hook that was just called
+ * @param start		The profile_now() time from before the call
+ */
+void hook_profile_done(Hook *h, long long start)
+{
+	long long spent = profile_now() - start;
+
+	h->calls++;
+	h->total += spent;
+	if (spent > h->max)
+		h->max = spent;
+	if ((h->type >= 0) && (h->type < MAXHOOKTYPES))
+		latency_add(&hook_latency[h->type], spent);
+}
+
+/** Format a time in nanoseconds in a human readable way */
+static char *profile_time(unsigned long long ns, char *buf, size_t buflen)
+{
+	if (ns < 1000)
+		snprintf(buf, buflen, "%lluns", ns);
+	else if (ns < 1000000)
+		snprintf(buf, buflen, "%.1fus", (double)ns / 1000.0);
+	else if (ns < 1000000000)
+		snprintf(buf, buflen, "%.2fms", (double)ns / 1000000.0);
+	else
+		snprintf(buf, buflen, "%.2fs", (double)ns / 1000000000.0);
+	return buf;
+}
+
+/** Name of the module that a command, hook or event belongs to */
+static char *profile_owner(Module *owner)
+{
+	return owner ? owner->header->name : "core";
+}
+
+/** One line of the profile report */
+typedef struct ProfileEntry ProfileEntry;
+struct ProfileEntry {
+	char name[128];
+	unsigned long bytes;
+	int has_bytes;
+	LatencyHistogram *h;
+	/* For individual hooks, which only have counters */
+	unsigned long long calls, total, max;
+};
+
+static int profile_entry_compare(const void *a, const void *b)
+{
+	const ProfileEntry *x = a, *y = b;
+
+	if (x->total == y->total)
+		return 0;
+	return (x->total < y->total) ? 1 : -1;
+}
+
+/** Format a single profile entry */
+static void profile_format(ProfileEntry *e, char *buf, size_t buflen)
+{
+	char total[32], avg[32], max[32], p50[32], p99[32];
+	char bytes[48];
+
+	*bytes = '\0';
+	if (e->has_bytes)
+		snprintf(bytes, sizeof(bytes), ", %lu bytes", e->bytes);
+
+	if (e->h)
+	{
+		snprintf(buf, buflen, "%s: %llu calls%s, total %s, avg %s, p50 %s, p99 %s, max %s",
+			e->name, e->calls, bytes,
+			profile_time(e->total, total, sizeof(total)),
+			profile_time(e->total / e->calls, avg, sizeof(avg)),
+			profile_time(latency_percentile(e->h, 50), p50, sizeof(p50)),
+			profile_time(latency_percentile(e->h, 99), p99, sizeof(p99)),
+			profile_time(e->max, max, sizeof(max)));
+	} else {
+		snprintf(buf, buflen, "%s: %llu calls, total %s, avg %s, max %s",
+			e->name, e->calls,
+			profile_time(e->total, total, sizeof(total)),
+			profile_time(e->total / e->calls, avg, sizeof(avg)),
+			profile_time(e->max, max, sizeof(max)));
+	}
+}
+
+/** Sort the entries, send the top ones to the client and all of them to the file */
+static void profile_section(Client *client, FILE *fd, char *title, ProfileEntry *entries, int cnt)
+{
+	char buf[512];
+	int i, j;
+
+	qsort(entries, cnt, sizeof(ProfileEntry), profile_entry_compare);
+
+	sendnumericfmt(client, RPL_STATSDEBUG, "%s (top %d of %d by total time):",
+		title, MIN(cnt, PROFILE_SHOW_TOP), cnt);
+	if (fd)
+		fprintf(fd, "%s:\n", title);
+
+	for (i = 0; i < cnt; i++)
+	{
+		profile_format(&entries[i], buf, sizeof(buf));
+		if (i < PROFILE_SHOW_TOP)
+			sendnumericfmt(client, RPL_STATSDEBUG, "  %s", buf);
+		if (fd)
+		{
+			fprintf(fd, "  %s\n", buf);
+			/* The file also gets the full histogram */
+			if (entries[i].h)
+			{
+				for (j = 0; j < LATENCY_BUCKETS; j++)
+				{
+					if (entries[i].h->buckets[j])
+					{
+						fprintf(fd, "    >= %-10s %llu\n",
+							profile_time(latency_bucket_value(j), buf, sizeof(buf)),
+							entries[i].h->buckets[j]);
+					}
+				}
+			}
+		}
+	}
+	if (fd)
+		fprintf(fd, "\n");
+}
+
+/** Set the entry to show a histogram */
+static void profile_entry_histogram(ProfileEntry *e, LatencyHistogram *h)
+{
+	e->h = h;
+	e->calls = h->count;
+	e->total = h->total;
+	e->max = h->max;
+}
+
+/** Show the profile (STATS R) and write the full report to a file.
+ * @param client	The client to send the report to
+ */
+void profile_report(Client *client)
+{
+	ProfileEntry *entries;
+	RealCommand *cmd;
+	Event *e;
+	Hook *h;
+	Module *owner;
+	FILE *fd;
+	char file[512];
+	int cnt, max, i;
+
+	snprintf(file, sizeof(file), "%s/%s", LOGDIR, PROFILE_REPORT_FILE);
+	fd = fopen(file, "w");
+	if (fd)
+		fprintf(fd, "Profile of %s at %lld, up %lld seconds\n\n", me.name, (long long)TStime(), (long long)(TStime() - me.local->since));
+
+	/* Allocate enough for the largest section */
+	max = MAXHOOKTYPES;
+	cnt = 0;
+	for (i = 0; i < 256; i++)
+		for (cmd = CommandHash[i]; cmd; cmd = cmd->next)
+			cnt++;
+	max = MAX(max, cnt);
+	cnt = 0;
+	for (i = 0; i < MAXHOOKTYPES; i++)
+		for (h = Hooks[i]; h; h = h->next)
+			cnt++;
+	max = MAX(max, cnt);
+	cnt = 0;
+	for (e = events; e; e = e->next)
+		cnt++;
+	max = MAX(max, cnt);
+	entries = safe_alloc(sizeof(ProfileEntry) * max);
+
+	/* Commands */
+	cnt = 0;
+	for (i = 0; i < 256; i++)
+	{
+		for (cmd = CommandHash[i]; cmd; cmd = cmd->next)
+		{
+			if (!cmd->latency.count)
+				continue;
+			owner = cmd->overriders ? cmd->overriders->owner : cmd->owner;
+			snprintf(entries[cnt].name, sizeof(entries[cnt].name), "%s (%s)",
+				cmd->cmd, profile_owner(owner));
+			entries[cnt].bytes = cmd->bytes;
+			entries[cnt].has_bytes = 1;
+			profile_entry_histogram(&entries[cnt], &cmd->latency);
+			cnt++;
+		}
+	}
+	profile_section(client, fd, "Commands", entries, cnt);
+
+	/* Hook types */
+	memset(entries, 0, sizeof(ProfileEntry) * max);
+	cnt = 0;
+	for (i = 0; i < MAXHOOKTYPES; i++)
+	{
+		if (!hook_latency[i].count)
+			continue;
+		snprintf(entries[cnt].name, sizeof(entries[cnt].name), "hook type %d", i);
+		profile_entry_histogram(&entries[cnt], &hook_latency[i]);
+		cnt++;
+	}
+	profile_section(client, fd, "Hook types", entries, cnt);
+
+	/* Individual hooks, so the time can be attributed to a module */
+	memset(entries, 0, sizeof(ProfileEntry) * max);
+	cnt = 0;
+	for (i = 0; i < MAXHOOKTYPES; i++)
+	{
+		for (h = Hooks[i]; h; h = h->next)
+		{
+			if (!h->calls)
+				continue;
+			snprintf(entries[cnt].name, sizeof(entries[cnt].name), "hook type %d in %s",
+				i, profile_owner(h->owner));
+			entries[cnt].calls = h->calls;
+			entries[cnt].total = h->total;
+			entries[cnt].max = h->max;
+			cnt++;
+		}
+	}
+	profile_section(client, fd, "Hooks", entries, cnt);
+
+	/* Events */
+	memset(entries, 0, sizeof(ProfileEntry) * max);
+	cnt = 0;
+	for (e = events; e; e = e->next)
+	{
+		if (e->deleted || !e->latency.count)
+			continue;
+		snprintf(entries[cnt].name, sizeof(entries[cnt].name), "%s (%s)",
+			e->name ? e->name : "<unnamed>", profile_owner(e->owner));
+		profile_entry_histogram(&entries[cnt], &e->latency);
+		cnt++;
+	}
+	profile_section(client, fd, "Events", entries, cnt);
+
+	/* The main loop itself, see SocketLoop() */
+	memset(entries, 0, sizeof(ProfileEntry) * max);
+	cnt = 0;
+	strlcpy(entries[cnt].name, "loop iteration (excluding I/O wait)", sizeof(entries[cnt].name));
+	profile_entry_histogram(&entries[cnt++], &loopstats.iteration_time);
+	strlcpy(entries[cnt].name, "I/O callbacks", sizeof(entries[cnt].name));
+	profile_entry_histogram(&entries[cnt++], &loopstats.io_time);
+	strlcpy(entries[cnt].name, "DoEvents()", sizeof(entries[cnt].name));
+	profile_entry_histogram(&entries[cnt++], &loopstats.events_time);
+	strlcpy(entries[cnt].name, "process_clients()", sizeof(entries[cnt].name));
+	profile_entry_histogram(&entries[cnt++], &loopstats.process_clients_time);
+	for (i = 0; i < cnt; i++)
+	{
+		if (!entries[i].calls)
+		{
+			/* Only possible right after boot, avoid dividing by zero */
+			cnt = 0;
+			break;
+		}
+	}
+	profile_section(client, fd, "Main loop", entries, cnt);
+
+	safe_free(entries);
+
+	if (fd)
+	{
+		fclose(fd);
+		sendnumericfmt(client, RPL_STATSDEBUG, "Full report with histograms written to %s", file);
+	} else {
+		sendnumericfmt(client, RPL_STATSDEBUG, "Could not write the full report to %s: %s", file, strerror(errno));
+	}
+}
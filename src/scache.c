@@ -1,7 +1,7 @@
 /* License: GPLv1 */
 
 /** @file
- * @brief String cache - only used for server names.
+ * @brief String cache - interned, reference counted strings.
  */
 
 #include "unrealircd.h"
@@ -18,38 +18,65 @@
  * I could have tucked this code into hash.c I suppose but lets keep it
  * separate for now -Dianora
  */
+/*
+ * The same reasoning applies to IP addresses and hosts: behind a NAT or
+ * a webchat gateway thousands of users share the same IP and vhost.
+ * These are interned via scache_add() / scache_del() and reference
+ * counted, so the string is freed when the last user of it is gone.
+ * Because each unique string is stored only once, two interned strings
+ * are equal if and only if the pointers are equal.
+ * Server names from find_or_add() are never freed.
+ */
 
-#define SCACHE_HASH_SIZE 257
+#define SCACHE_HASH_SIZE 8192
 
 typedef struct SCACHE SCACHE;
 struct SCACHE {
-	char name[HOSTLEN + 1];
 	SCACHE *next;
+	int refcnt;		/**< Number of scache_add() references */
+	unsigned char permanent;	/**< Added via find_or_add(), never freed */
+	char name[1];		/**< The string (allocated to the appropriate length) */
 };
 
 static SCACHE *scache_hash[SCACHE_HASH_SIZE];
+static char siphashkey_scache[SIPHASH_KEY_LENGTH];
+static int scache_entries = 0;
+static long scache_refs = 0;
+static long scache_bytes = 0;
 
 /*
- * renamed to keep it consistent with the other hash functions -Dianora 
+ * renamed to keep it consistent with the other hash functions -Dianora
  */
 /*
- * orabidoo had named it init_scache_hash(); 
+ * orabidoo had named it init_scache_hash();
  */
 
 void clear_scache_hash_table(void)
 {
 	memset((char *)scache_hash, '\0', sizeof(scache_hash));
+	siphash_generate_key(siphashkey_scache);
 }
 
-static int hash(char *string)
+/* Case insensitive so find_or_add() can do case insensitive lookups.
+ * scache_add() compares case sensitive within the bucket.
+ */
+static unsigned int hash(const char *string)
 {
-	int  hash_value;
+	return siphash_nocase(string, siphashkey_scache) % SCACHE_HASH_SIZE;
+}
 
-	hash_value = 0;
-	while (*string)
-		hash_value += (*string++ & 0xDF);
+static SCACHE *scache_new(const char *name, unsigned int hash_index)
+{
+	SCACHE *e;
+	int len = strlen(name);
 
-	return hash_value % SCACHE_HASH_SIZE;
+	e = safe_alloc(sizeof(SCACHE) + len);
+	memcpy(e->name, name, len + 1);
+	e->next = scache_hash[hash_index];
+	scache_hash[hash_index] = e;
+	scache_entries++;
+	scache_bytes += sizeof(SCACHE) + len;
+	return e;
 }
 
 /** Add a string to the string cache.
@@ -60,40 +87,105 @@ static int hash(char *string)
  * existing, servername.  use the hash in list.c for those.  -orabidoo
  * @param name	A valid server name
  * @returns Pointer to the server name
+ * @note The returned string stays valid forever.
  */
 char *find_or_add(char *name)
 {
-	int  hash_index;
-	SCACHE *ptr, *newptr;
+	unsigned int hash_index = hash(name);
+	SCACHE *e;
 
-	ptr = scache_hash[hash_index = hash(name)];
-	while (ptr)
+	for (e = scache_hash[hash_index]; e; e = e->next)
 	{
-		if (!mycmp(ptr->name, name))
-		{
-			return (ptr->name);
-		}
-		else
+		if (!mycmp(e->name, name))
 		{
-			ptr = ptr->next;
+			e->permanent = 1;
+			return e->name;
 		}
 	}
 
-	/*
-	 * not found -- add it 
-	 */
-	if ((ptr = scache_hash[hash_index]))
+	e = scache_new(name, hash_index);
+	e->permanent = 1;
+	return e->name;
+}
+
+/** Intern a string.
+ * @param str	The string (case sensitive)
+ * @returns A shared copy of the string. Don't modify it, and release
+ *          it with scache_del() instead of safe_free().
+ */
+char *scache_add(const char *str)
+{
+	unsigned int hash_index = hash(str);
+	SCACHE *e;
+
+	for (e = scache_hash[hash_index]; e; e = e->next)
+		if (!strcmp(e->name, str))
+			break;
+
+	if (!e)
+		e = scache_new(str, hash_index);
+
+	e->refcnt++;
+	scache_refs++;
+	return e->name;
+}
+
+/** Release a string previously returned by scache_add().
+ * @param str	The interned string (may be NULL)
+ */
+void scache_del(char *str)
+{
+	SCACHE *e, **prev;
+	unsigned int hash_index;
+
+	if (!str)
+		return;
+
+	e = (SCACHE *)(str - offsetof(SCACHE, name));
+	if (e->refcnt <= 0)
 	{
-		newptr = scache_hash[hash_index] = safe_alloc(sizeof(SCACHE));
-		strlcpy(newptr->name, name, sizeof(newptr->name));
-		newptr->next = ptr;
-		return (newptr->name);
+		ircd_log(LOG_ERROR, "[BUG] scache_del() called on '%s' which has no references", str);
+		return;
 	}
-	else
+	scache_refs--;
+	if (--e->refcnt || e->permanent)
+		return;
+
+	hash_index = hash(str);
+	for (prev = &scache_hash[hash_index]; *prev; prev = &(*prev)->next)
 	{
-		ptr = scache_hash[hash_index] = safe_alloc(sizeof(SCACHE));
-		strlcpy(ptr->name, name, sizeof(newptr->name));
-		ptr->next = (SCACHE *) NULL;
-		return (ptr->name);
+		if (*prev == e)
+		{
+			*prev = e->next;
+			break;
+		}
 	}
+	scache_entries--;
+	scache_bytes -= sizeof(SCACHE) + strlen(e->name);
+	safe_free(e);
+}
+
+/** Set an interned string variable, releasing the old value.
+ * This is the scache equivalent of safe_strdup().
+ * @param dst	Pointer to the variable
+ * @param str	The new value, or NULL to release only
+ */
+void scache_set(char **dst, const char *str)
+{
+	char *old = *dst;
+
+	*dst = str ? scache_add(str) : NULL;
+	scache_del(old);
+}
+
+/** Report string cache usage.
+ * @param entries	Number of unique strings
+ * @param refs		Number of references to them
+ * @param bytes		Memory used by the cache
+ */
+void scache_stats(int *entries, long *refs, long *bytes)
+{
+	*entries = scache_entries;
+	*refs = scache_refs;
+	*bytes = scache_bytes + sizeof(scache_hash);
 }
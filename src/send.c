@@ -30,6 +30,7 @@
 void vsendto_one(Client *to, MessageTag *mtags, const char *pattern, va_list vl);
 void vsendto_prefix_one(Client *to, Client *from, MessageTag *mtags, const char *pattern, va_list vl);
 static int vmakebuf_local_withprefix(char *buf, size_t buflen, Client *from, const char *pattern, va_list vl);
+static void mtags_cache_end(void);
 
 #define ADD_CRLF(buf, len) { if (len > 510) len = 510; \
                              buf[len++] = '\r'; buf[len++] = '\n'; buf[len] = '\0'; } while(0)
@@ -47,6 +48,117 @@ static char sendbuf2[4096];
  */
 MODVAR int  current_serial;
 
+/* Serializing message tags for a recipient means checking every tag
+ * against its handler (CAP, can_send) and escaping the values. When a
+ * message is sent to a whole channel the result only differs per
+ * "class" of recipient: the CAPs that are enabled plus the outcome of
+ * the few can_send callbacks. So during a broadcast we remember the
+ * string for each class we come across.
+ */
+#define MTAGS_CACHE_CLASSES	8
+#define MTAGS_CACHE_CANSEND	16
+
+typedef struct MTagsCacheEntry MTagsCacheEntry;
+struct MTagsCacheEntry {
+	long caps;		/**< CAPs of the recipients in this class */
+	unsigned int cansend;	/**< Bit for each can_send handler that allowed the tag */
+	char *str;		/**< The serialized tags (NULL if none to send) */
+};
+
+static struct {
+	MessageTag *mtags;	/**< The message tags of the current broadcast, or NULL if inactive */
+	int usable;		/**< Zero if the tags can't be cached (too many can_send handlers) */
+	int ncansend;
+	MessageTagHandler *cansend[MTAGS_CACHE_CANSEND];
+	int nentries;
+	MTagsCacheEntry entry[MTAGS_CACHE_CLASSES];
+} mtags_cache;
+
+/** Start caching the serialized 'mtags' for the duration of a broadcast.
+ * The tags may not be changed until mtags_cache_end() is called.
+ */
+static void mtags_cache_begin(MessageTag *mtags)
+{
+	MessageTagHandler *h;
+	MessageTag *m;
+
+	mtags_cache_end(); /* in case of nesting, just to be safe */
+	mtags_cache.mtags = mtags;
+	mtags_cache.usable = 1;
+	mtags_cache.ncansend = 0;
+	mtags_cache.nentries = 0;
+
+	if (!mtags)
+		return;
+
+	/* Resolve the handlers once, rather than for each recipient.
+	 * We only need the ones with an outgoing filter.
+	 */
+	for (m = mtags; m; m = m->next)
+	{
+		h = MessageTagHandlerFind(m->name);
+		if (!h || !h->can_send)
+			continue;
+		if (mtags_cache.ncansend == MTAGS_CACHE_CANSEND)
+		{
+			mtags_cache.usable = 0;
+			return;
+		}
+		mtags_cache.cansend[mtags_cache.ncansend++] = h;
+	}
+}
+
+/** End of broadcast, free the cached strings. */
+static void mtags_cache_end(void)
+{
+	int i;
+
+	for (i = 0; i < mtags_cache.nentries; i++)
+		safe_free(mtags_cache.entry[i].str);
+	mtags_cache.nentries = 0;
+	mtags_cache.mtags = NULL;
+}
+
+/** Return the message tag string for 'to', like mtags_to_string(),
+ * but use the broadcast cache if possible.
+ */
+static char *mtags_to_string_cached(MessageTag *mtags, Client *to)
+{
+	MTagsCacheEntry *e;
+	unsigned int cansend = 0;
+	char *str;
+	int i;
+
+	/* Only local users are cached: these are the only ones that are
+	 * filtered by CAP, and there's at most one message per server link.
+	 */
+	if (!mtags || (mtags != mtags_cache.mtags) || !mtags_cache.usable || !MyUser(to))
+		return mtags ? mtags_to_string(mtags, to) : NULL;
+
+	for (i = 0; i < mtags_cache.ncansend; i++)
+		if (mtags_cache.cansend[i]->can_send(to))
+			cansend |= 1 << i;
+
+	for (i = 0; i < mtags_cache.nentries; i++)
+	{
+		e = &mtags_cache.entry[i];
+		if ((e->caps == to->local->caps) && (e->cansend == cansend))
+			return e->str;
+	}
+
+	str = mtags_to_string(mtags, to);
+	if (mtags_cache.nentries < MTAGS_CACHE_CLASSES)
+	{
+		e = &mtags_cache.entry[mtags_cache.nentries++];
+		e->caps = to->local->caps;
+		e->cansend = cansend;
+		e->str = NULL;
+		safe_strdup(e->str, str);
+		return e->str;
+	}
+	return str;
+}
+
 /** Mark the socket as "dead".
  * This is used when exit_client() cannot be used from the
  * current code because doing so would be (too) unexpected.
@@ -110,6 +222,16 @@ int send_queued(Client *to)
 	if (IsDeadSocket(to))
 		return -1;
 
+	/* Server burst in progress: generate more if the sendQ is (nearly) drained */
+	if (to->local->burst && (DBufLength(&to->local->sendQ) < BURST_CHUNK_SIZE))
+		burst_continue(to);
+
+#ifdef HAVE_ZLIB
+	/* Compressed link: flush whatever is still inside zlib */
+	if (to->local->zip)
+		zip_flush(to);
+#endif
+
 	while (DBufLength(&to->local->sendQ) > 0)
 	{
 		block = container_of(to->local->sendQ.dbuf_list.next, dbufbuf, dbuf_node);
@@ -148,8 +270,11 @@ int send_queued(Client *to)
 		}
 	}
 	
-	/* Nothing left to write, stop asking for write-ready notification. */
-	if ((DBufLength(&to->local->sendQ) == 0) && (to->local->fd >= 0))
+	/* Nothing left to write, stop asking for write-ready notification.
+	 * Except during a server burst, then we want to be called again
+	 * so we can generate the next part of the burst.
+	 */
+	if ((DBufLength(&to->local->sendQ) == 0) && (to->local->fd >= 0) && !to->local->burst)
 		fd_setselect(to->local->fd, FD_SELECT_WRITE, NULL, to);
 
 	return (IsDeadSocket(to)) ? -1 : 0;
@@ -158,7 +283,8 @@ int send_queued(Client *to)
 /** Mark "to" with "there is data to be send" */
 void mark_data_to_send(Client *to)
 {
-	if (!IsDeadSocket(to) && (to->local->fd >= 0) && (DBufLength(&to->local->sendQ) > 0))
+	/* For compressed links the data may still be in zlib (and not in the sendQ yet) */
+	if (!IsDeadSocket(to) && (to->local->fd >= 0) && ((DBufLength(&to->local->sendQ) > 0) || to->local->zip))
 	{
 		fd_setselect(to->local->fd, FD_SELECT_WRITE, send_queued_cb, to);
 	}
@@ -207,7 +333,7 @@ void sendto_one(Client *to, MessageTag *mtags, FORMAT_STRING(const char *pattern
  */
 void vsendto_one(Client *to, MessageTag *mtags, const char *pattern, va_list vl)
 {
-	char *mtags_str = mtags ? mtags_to_string(mtags, to) : NULL;
+	char *mtags_str = mtags_to_string_cached(mtags, to);
 
 	ircvsnprintf(sendbuf, sizeof(sendbuf), pattern, vl);
 
@@ -335,6 +461,8 @@ void sendbufto_one(Client *to, char *msg, unsigned int quick)
 
 	for (h = Hooks[HOOKTYPE_PACKET]; h; h = h->next)
 	{
+		if (!PacketHookWanted(h, to))
+			continue;
 		(*(h->func.intfunc))(&me, to, intended_to, &msg, &len);
 		if (!msg)
 			return;
@@ -352,7 +480,7 @@ void sendbufto_one(Client *to, char *msg, unsigned int quick)
 	}
 #endif
 
-	if (DBufLength(&to->local->sendQ) > get_sendq(to))
+	if (DBufLength(&to->local->sendQ) + (to->local->burst ? DBufLength(&to->local->burst->held) : 0) > get_sendq(to))
 	{
 		if (IsServer(to))
 			sendto_ops("Max SendQ limit exceeded for %s: %u > %d",
@@ -362,7 +490,16 @@ void sendbufto_one(Client *to, char *msg, unsigned int quick)
 		return;
 	}
 
-	dbuf_put(&to->local->sendQ, msg, len);
+	if (to->local->burst && burst_hold(to, msg, len))
+	{
+		/* Held back until the server burst is complete */
+	}
+#ifdef HAVE_ZLIB
+	else if (zip_out_active(to))
+		zip_compress(to, msg, len);
+#endif
+	else
+		dbuf_put(&to->local->sendQ, msg, len);
 
 	/*
 	 * Update statistics. The following is slightly incorrect
@@ -437,8 +574,10 @@ void sendto_channel(Channel *channel, Client *from, Client *skip,
 	va_list vl;
 	Member *lp;
 	Client *acptr;
+	long umode_noctcp = (sendflags & SKIP_CTCP) ? find_user_mode('T') : 0;
 
 	++current_serial;
+	mtags_cache_begin(mtags);
 	for (lp = channel->members; lp; lp = lp->next)
 	{
 		acptr = lp->client;
@@ -450,7 +589,7 @@ void sendto_channel(Channel *channel, Client *from, Client *skip,
 		if (IsDeaf(acptr) && (sendflags & SKIP_DEAF))
 			continue;
 		/* Don't send to NOCTCP clients */
-		if (has_user_mode(acptr, 'T') && (sendflags & SKIP_CTCP))
+		if (acptr->umodes & umode_noctcp)
 			continue;
 		/* Now deal with 'prefix' (if non-zero) */
 		if (!prefix)
@@ -527,6 +666,7 @@ good:
 			}
 		}
 	}
+	mtags_cache_end();
 }
 
 /** Send a message to a server, taking into account server options if needed.
@@ -591,6 +731,7 @@ void sendto_local_common_channels(Client *user, Client *skip, long clicap, Messa
 	va_end(vl);
 
 	++current_serial;
+	mtags_cache_begin(mtags);
 
 	if (user->user)
 	{
@@ -620,6 +761,7 @@ void sendto_local_common_channels(Client *user, Client *skip, long clicap, Messa
 			}
 		}
 	}
+	mtags_cache_end();
 }
 
 /*
@@ -657,11 +799,17 @@ void sendto_match_butone(Client *one, Client *from, char *mask, int what,
 	va_list vl;
 	Client *acptr;
 	char cansendlocal, cansendglobal;
+	static int perm_notice_local = 0, perm_notice_global = 0;
 
 	if (MyConnect(from))
 	{
-		cansendlocal = (ValidatePermissionsForPath("chat:notice:local",from,NULL,NULL,NULL)) ? 1 : 0;
-		cansendglobal = (ValidatePermissionsForPath("chat:notice:global",from,NULL,NULL,NULL)) ? 1 : 0;
+		if (!perm_notice_local)
+		{
+			perm_notice_local = OperClassGetPermissionID("chat:notice:local");
+			perm_notice_global = OperClassGetPermissionID("chat:notice:global");
+		}
+		cansendlocal = (ValidatePermissionsForID(perm_notice_local,from,NULL,NULL,NULL)) ? 1 : 0;
+		cansendglobal = (ValidatePermissionsForID(perm_notice_global,from,NULL,NULL,NULL)) ? 1 : 0;
 	}
 	else
 		cansendlocal = cansendglobal = 1;
@@ -693,6 +841,63 @@ void sendto_match_butone(Client *one, Client *from, char *mask, int what,
 	}
 }
 
+/** Returns the snomasks that are set by at least one locally connected IRCOp.
+ * The list of local IRCOps is what we use as the snomask subscriber list:
+ * snomasks can only be set by IRCOps and the list is short, so this is
+ * cheap compared to formatting a notice that nobody will receive.
+ */
+static long local_oper_snomasks(void)
+{
+	Client *acptr;
+	long snomasks = 0;
+
+	list_for_each_entry(acptr, &oper_list, special_node)
+		snomasks |= acptr->user->snomask;
+	return snomasks;
+}
+
+/** Returns 1 if there is at least one local user with all of these user modes set.
+ * When the mode includes UMODE_OPER only the list of local IRCOps is checked,
+ * otherwise we have to walk all local clients.
+ */
+static int has_local_umode_subscribers(long umodes)
+{
+	Client *acptr;
+
+	if (umodes & UMODE_OPER)
+	{
+		list_for_each_entry(acptr, &oper_list, special_node)
+			if ((acptr->umodes & umodes) == umodes)
+				return 1;
+		return 0;
+	}
+
+	list_for_each_entry(acptr, &lclient_list, lclient_node)
+		if (IsUser(acptr) && (acptr->umodes & umodes) == umodes)
+			return 1;
+	return 0;
+}
+
+/** Send an already formatted notice to all local users with these user modes.
+ * Helper for sendto_umode() and sendto_umode_global().
+ */
+static void sendto_umode_local(long umodes, const char *text)
+{
+	Client *acptr;
+
+	if (umodes & UMODE_OPER)
+	{
+		list_for_each_entry(acptr, &oper_list, special_node)
+			if ((acptr->umodes & umodes) == umodes)
+				sendto_one(acptr, NULL, ":%s NOTICE %s :%s", me.name, acptr->name, text);
+		return;
+	}
+
+	list_for_each_entry(acptr, &lclient_list, lclient_node)
+		if (IsUser(acptr) && (acptr->umodes & umodes) == umodes)
+			sendto_one(acptr, NULL, ":%s NOTICE %s :%s", me.name, acptr->name, text);
+}
+
 /** Send a message to all locally connected IRCOps
  * @param pattern	The format string / pattern to use.
  * @param ...		Format string parameters.
@@ -702,16 +907,20 @@ void sendto_ops(FORMAT_STRING(const char *pattern), ...)
 	va_list vl;
 	Client *acptr;
 	char nbuf[1024];
+	int formatted = 0;
 
 	list_for_each_entry(acptr, &lclient_list, lclient_node)
 		if (!IsServer(acptr) && !IsMe(acptr) && SendServNotice(acptr))
 		{
-			ircsnprintf(nbuf, sizeof(nbuf), ":%s NOTICE %s :*** ", me.name, acptr->name);
-			strlcat(nbuf, pattern, sizeof nbuf);
-
-			va_start(vl, pattern);
-			vsendto_one(acptr, NULL, nbuf, vl);
-			va_end(vl);
+			/* Format only once, and only if there is a recipient */
+			if (!formatted)
+			{
+				va_start(vl, pattern);
+				ircvsnprintf(nbuf, sizeof(nbuf), pattern, vl);
+				va_end(vl);
+				formatted = 1;
+			}
+			sendto_one(acptr, NULL, ":%s NOTICE %s :*** %s", me.name, acptr->name, nbuf);
 		}
 }
 
@@ -758,15 +967,15 @@ void sendto_realops(FORMAT_STRING(const char *pattern), ...)
 	Client *acptr;
 	char nbuf[1024];
 
-	list_for_each_entry(acptr, &oper_list, special_node)
-	{
-		ircsnprintf(nbuf, sizeof(nbuf), ":%s NOTICE %s :*** ", me.name, acptr->name);
-		strlcat(nbuf, pattern, sizeof nbuf);
+	if (list_empty(&oper_list))
+		return;
 
-		va_start(vl, pattern);
-		vsendto_one(acptr, NULL, nbuf, vl);
-		va_end(vl);
-	}
+	va_start(vl, pattern);
+	ircvsnprintf(nbuf, sizeof(nbuf), pattern, vl);
+	va_end(vl);
+
+	list_for_each_entry(acptr, &oper_list, special_node)
+		sendto_one(acptr, NULL, ":%s NOTICE %s :*** %s", me.name, acptr->name, nbuf);
 }
 
 /** Send a message to all locally connected IRCOps and also log the error.
@@ -811,19 +1020,16 @@ void sendto_realops_and_log(FORMAT_STRING(const char *fmt), ...)
 void sendto_umode(int umodes, FORMAT_STRING(const char *pattern), ...)
 {
 	va_list vl;
-	Client *acptr;
 	char nbuf[1024];
 
-	list_for_each_entry(acptr, &lclient_list, lclient_node)
-		if (IsUser(acptr) && (acptr->umodes & umodes) == umodes)
-		{
-			ircsnprintf(nbuf, sizeof(nbuf), ":%s NOTICE %s :", me.name, acptr->name);
-			strlcat(nbuf, pattern, sizeof nbuf);
+	if (!has_local_umode_subscribers(umodes))
+		return;
 
-			va_start(vl, pattern);
-			vsendto_one(acptr, NULL, nbuf, vl);
-			va_end(vl);
-		}
+	va_start(vl, pattern);
+	ircvsnprintf(nbuf, sizeof(nbuf), pattern, vl);
+	va_end(vl);
+
+	sendto_umode_local(umodes, nbuf);
 }
 
 /** Send a message to all users with specified user mode (local & remote users).
@@ -839,6 +1045,7 @@ void sendto_umode_global(int umodes, FORMAT_STRING(const char *pattern), ...)
 	int i;
 	char modestr[128];
 	char *p;
+	int local;
 
 	/* Convert 'umodes' (int) to 'modestr' (string) */
 	*modestr = '\0';
@@ -852,24 +1059,21 @@ void sendto_umode_global(int umodes, FORMAT_STRING(const char *pattern), ...)
 	}
 	*p = '\0';
 
-	list_for_each_entry(acptr, &lclient_list, lclient_node)
+	local = has_local_umode_subscribers(umodes);
+	if (!local && (!*modestr || list_empty(&server_list)))
+		return; /* Nobody to send it to */
+
+	va_start(vl, pattern);
+	ircvsnprintf(nbuf, sizeof(nbuf), pattern, vl);
+	va_end(vl);
+
+	if (local)
+		sendto_umode_local(umodes, nbuf);
+
+	if (*modestr)
 	{
-		if (IsUser(acptr) && (acptr->umodes & umodes) == umodes)
-		{
-			ircsnprintf(nbuf, sizeof(nbuf), ":%s NOTICE %s :", me.name, acptr->name);
-			strlcat(nbuf, pattern, sizeof nbuf);
-
-			va_start(vl, pattern);
-			vsendto_one(acptr, NULL, nbuf, vl);
-			va_end(vl);
-		} else
-		if (IsServer(acptr) && *modestr)
-		{
-			snprintf(nbuf, sizeof(nbuf), ":%s SENDUMODE %s :%s", me.id, modestr, pattern);
-			va_start(vl, pattern);
-			vsendto_one(acptr, NULL, nbuf, vl);
-			va_end(vl);
-		}
+		list_for_each_entry(acptr, &server_list, special_node)
+			sendto_one(acptr, NULL, ":%s SENDUMODE %s :%s", me.id, modestr, nbuf);
 	}
 }
 
@@ -884,6 +1088,9 @@ void sendto_snomask(int snomask, FORMAT_STRING(const char *pattern), ...)
 	Client *acptr;
 	char nbuf[2048];
 
+	if (!(local_oper_snomasks() & snomask))
+		return; /* No subscribers, don't bother formatting */
+
 	va_start(vl, pattern);
 	ircvsnprintf(nbuf, sizeof(nbuf), pattern, vl);
 	va_end(vl);
@@ -907,6 +1114,9 @@ void sendto_snomask_global(int snomask, FORMAT_STRING(const char *pattern), ...)
 	int  i;
 	char nbuf[2048], snobuf[32], *p;
 
+	if (!(local_oper_snomasks() & snomask) && list_empty(&server_list))
+		return; /* Nobody to send it to */
+
 	va_start(vl, pattern);
 	ircvsnprintf(nbuf, sizeof(nbuf), pattern, vl);
 	va_end(vl);
@@ -927,6 +1137,102 @@ void sendto_snomask_global(int snomask, FORMAT_STRING(const char *pattern), ...)
 	sendto_server(NULL, 0, 0, NULL, ":%s SENDSNO %s :%s", me.id, snobuf, nbuf);
 }
 
+/** Number of different notices that sendto_snomask_coalesced() tracks */
+#define SNO_COALESCE_SLOTS	16
+/** Number of similar notices sent per second before we start coalescing */
+#define SNO_COALESCE_BURST	5
+
+typedef struct SnomaskCoalesce SnomaskCoalesce;
+/** State of one type of notice for sendto_snomask_coalesced() */
+struct SnomaskCoalesce {
+	const char *pattern;	/**< Format string, notices with the same one are "similar" */
+	int snomask;		/**< Snomask the notices go to */
+	time_t since;		/**< Start of the current (one second) window */
+	int sent;		/**< Notices sent in the current window */
+	int suppressed;		/**< Notices held back and not reported yet */
+	char last[512];		/**< Text of the last notice that was held back */
+};
+
+static SnomaskCoalesce sno_coalesce[SNO_COALESCE_SLOTS];
+
+/** Report the notices that were held back, if any */
+static void sno_coalesce_report(SnomaskCoalesce *s)
+{
+	if (s->suppressed > 1)
+		sendto_snomask(s->snomask, "%s [x%d similar]", s->last, s->suppressed);
+	else if (s->suppressed == 1)
+		sendto_snomask(s->snomask, "%s", s->last);
+	s->suppressed = 0;
+}
+
+/** Send a message to all locally connected users with specified snomask,
+ * coalescing repetitive notices.
+ * This is like sendto_snomask(), but if more than SNO_COALESCE_BURST
+ * notices with the same format string are sent in one second then the
+ * rest is held back and reported as a single "... [x123 similar]" notice
+ * afterwards. Use this for notices that can be triggered by floods.
+ * @param snomask	The snomask that the recipient should have set (one of SNO_*)
+ * @param pattern	The format string / pattern to use.
+ * @param ...		Format string parameters.
+ */
+void sendto_snomask_coalesced(int snomask, FORMAT_STRING(const char *pattern), ...)
+{
+	va_list vl;
+	SnomaskCoalesce *s, *e = NULL;
+	char nbuf[512];
+
+	if (!(local_oper_snomasks() & snomask))
+		return; /* No subscribers, don't bother formatting */
+
+	for (s = sno_coalesce; s < &sno_coalesce[SNO_COALESCE_SLOTS]; s++)
+	{
+		if ((s->pattern == pattern) && (s->snomask == snomask))
+			break;
+		/* Remember the slot that was used least recently, in case we need a new one */
+		if (!e || (s->since < e->since))
+			e = s;
+	}
+	if (s == &sno_coalesce[SNO_COALESCE_SLOTS])
+	{
+		s = e;
+		sno_coalesce_report(s);
+		memset(s, 0, sizeof(SnomaskCoalesce));
+		s->pattern = pattern;
+		s->snomask = snomask;
+	}
+
+	if (s->since != TStime())
+	{
+		sno_coalesce_report(s);
+		s->since = TStime();
+		s->sent = 0;
+	}
+
+	va_start(vl, pattern);
+	ircvsnprintf(nbuf, sizeof(nbuf), pattern, vl);
+	va_end(vl);
+
+	if (s->sent < SNO_COALESCE_BURST)
+	{
+		s->sent++;
+		sendto_snomask(snomask, "%s", nbuf);
+		return;
+	}
+
+	strlcpy(s->last, nbuf, sizeof(s->last));
+	s->suppressed++;
+}
+
+/** Report notices held back by sendto_snomask_coalesced() once their window is over */
+EVENT(sno_coalesce_flush)
+{
+	SnomaskCoalesce *s;
+
+	for (s = sno_coalesce; s < &sno_coalesce[SNO_COALESCE_SLOTS]; s++)
+		if (s->suppressed && (s->since != TStime()))
+			sno_coalesce_report(s);
+}
+
 /** Send CAP DEL and CAP NEW notification to clients supporting it.
  * This function is mostly meant to be used by the CAP and SASL modules.
  * @param add		Whether the CAP token is added (1) or removed (0)
@@ -1048,7 +1354,7 @@ void sendto_prefix_one(Client *to, Client *from, MessageTag *mtags, FORMAT_STRIN
  */
 void vsendto_prefix_one(Client *to, Client *from, MessageTag *mtags, const char *pattern, va_list vl)
 {
-	char *mtags_str = mtags ? mtags_to_string(mtags, to) : NULL;
+	char *mtags_str = mtags_to_string_cached(mtags, to);
 
 	if (to && from && MyUser(to) && from->user)
 		vmakebuf_local_withprefix(sendbuf, sizeof sendbuf, from, pattern, vl);
@@ -1072,9 +1378,13 @@ void sendto_connectnotice(Client *newuser, int disconnect, char *comment)
 	char connect[512], secure[256];
 
 	if (!disconnect)
-	{
 		RunHook(HOOKTYPE_LOCAL_CONNECT, newuser);
 
+	if (!(local_oper_snomasks() & SNO_CLIENT))
+		return;
+
+	if (!disconnect)
+	{
 		*secure = '\0';
 		if (IsSecure(newuser))
 			snprintf(secure, sizeof(secure), " [secure %s]", tls_get_cipher(newuser->local->ssl));
@@ -1103,6 +1413,9 @@ void sendto_fconnectnotice(Client *newuser, int disconnect, char *comment)
 	Client *acptr;
 	char connect[512], secure[256];
 
+	if (!(local_oper_snomasks() & SNO_FCLIENT))
+		return;
+
 	if (!disconnect)
 	{
 		*secure = '\0';
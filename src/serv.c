@@ -214,9 +214,15 @@ void send_proto(Client *client, ConfigItem_link *aconf)
 		me.id, (long long)TStime());
 
 	/* Third line */
-	sendto_one(client, NULL, "PROTOCTL NICKCHARS=%s CHANNELCHARS=%s",
+	sendto_one(client, NULL, "PROTOCTL NICKCHARS=%s CHANNELCHARS=%s%s",
 		charsys_get_current_languages(),
-		allowed_channelchars_valtostr(iConf.allowed_channelchars));
+		allowed_channelchars_valtostr(iConf.allowed_channelchars),
+#ifdef HAVE_ZLIB
+		" ZIP"
+#else
+		""
+#endif
+		);
 }
 
 #ifndef IRCDTOTALVERSION
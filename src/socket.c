@@ -690,6 +690,11 @@ void close_connection(Client *client)
 
 	}
 
+#ifdef HAVE_ZLIB
+	zip_free(client);
+#endif
+	burst_free(client);
+
 	client->direction = NULL;
 }
 
@@ -825,11 +830,14 @@ static int check_too_many_unknown_connections(Client *client)
 	int cnt = 1;
 	Client *c;
 
-	if (!find_tkl_exception(TKL_CONNECT_FLOOD, client))
+	/* Metrics clients stay unknown until they are closed, they are
+	 * not limited and don't count towards the limit of others.
+	 */
+	if (!IsMetricsListener(client->local->listener) && !find_tkl_exception(TKL_CONNECT_FLOOD, client))
 	{
 		list_for_each_entry(c, &unknown_list, lclient_node)
 		{
-			if (!strcmp(client->ip,GetIP(c)))
+			if (!strcmp(client->ip,GetIP(c)) && !IsMetricsListener(c->local->listener))
 			{
 				cnt++;
 				if (cnt > iConf.max_unknown_connections_per_ip)
@@ -886,7 +894,7 @@ refuse_client:
 
 	/* Fill in sockhost & ip ASAP */
 	set_sockhost(client, ip);
-	safe_strdup(client->ip, ip);
+	scache_set(&client->ip, ip);
 	client->local->port = port;
 	client->local->fd = fd;
 
@@ -897,6 +905,8 @@ refuse_client:
 		SetLocalhost(client);
 	}
 
+	client->local->listener = listener;
+
 	/* Check set::max-unknown-connections-per-ip */
 	if (check_too_many_unknown_connections(client))
 	{
@@ -911,7 +921,6 @@ refuse_client:
 	if (check_banned(client, NO_EXIT_CLIENT))
 		goto refuse_client;
 
-	client->local->listener = listener;
 	if (client->local->listener != NULL)
 		client->local->listener->clients++;
 	add_client_to_list(client);
@@ -967,6 +976,12 @@ void start_of_normal_client_handshake(Client *client)
 
 	RunHook(HOOKTYPE_HANDSHAKE, client);
 
+	/* A hook may have killed the client already, eg. the blacklist
+	 * module when the result was in its cache.
+	 */
+	if (IsDead(client))
+		return;
+
 	if (!DONT_RESOLVE)
 	{
 		if (should_show_connect_info(client))
@@ -1104,6 +1119,8 @@ void read_packet(int fd, int revents, void *data)
 		processdata = 1;
 		for (h = Hooks[HOOKTYPE_RAWPACKET_IN]; h; h = h->next)
 		{
+			if (!PacketHookWanted(h, client))
+				continue;
 			processdata = (*(h->func.intfunc))(client, readbuf, &length);
 			if (processdata < 0)
 				return;
@@ -1310,7 +1327,7 @@ static int connect_server_helper(ConfigItem_link *aconf, Client *client)
 	if (strchr(aconf->connect_ip, ':'))
 		SetIPV6(client);
 	
-	safe_strdup(client->ip, aconf->connect_ip);
+	scache_set(&client->ip, aconf->connect_ip);
 	
 	snprintf(buf, sizeof buf, "Outgoing connection: %s", get_client_name(client, TRUE));
 	client->local->fd = fd_socket(IsIPV6(client) ? AF_INET6 : AF_INET, SOCK_STREAM, 0, buf);
@@ -245,14 +245,17 @@ size_t strlncat(char *dst, const char *src, size_t size, size_t n)
 char *strldup(const char *src, size_t max)
 {
 	char *ptr;
+	const char *end;
 	int n;
 
 	if ((max == 0) || !src)
 		return NULL;
 
-	n = strlen(src);
-	if (n > max-1)
-		n = max-1;
+	/* Don't use strlen() here: callers such as the config parser
+	 * pass a pointer into a huge buffer and only want a few bytes.
+	 */
+	end = memchr(src, '\0', max-1);
+	n = end ? (end - src) : (max-1);
 
 	ptr = safe_alloc(n+1);
 	memcpy(ptr, src, n);
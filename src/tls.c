@@ -911,7 +911,7 @@ static int fatal_ssl_error(int ssl_error, int where, int my_errno, Client *clien
 	 * IRC protocol wasn`t SSL enabled .. --vejeta
 	 */
 	SetDeadSocket(client);
-	sendto_snomask(SNO_JUNK, "Exiting ssl client %s: %s: %s%s",
+	sendto_snomask_coalesced(SNO_JUNK, "Exiting ssl client %s: %s: %s%s",
 		get_client_name(client, TRUE), ssl_func, ssl_errstr, additional_info);
 
 	if (where == SAFE_SSL_CONNECT)
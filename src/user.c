@@ -66,7 +66,7 @@ void iNAH_host(Client *client, char *host)
 
 	userhost_save_current(client);
 
-	safe_strdup(client->user->virthost, host);
+	scache_set(&client->user->virthost, host);
 	if (MyConnect(client))
 		sendto_server(NULL, 0, 0, NULL, ":%s SETHOST :%s", client->id, client->user->virthost);
 	client->umodes |= UMODE_SETHOST;
@@ -43,10 +43,10 @@ void add_history(Client *client, int online)
 	if (new->hashv != -1)
 	{
 		safe_free(new->name);
-		safe_free(new->hostname);
-		safe_free(new->virthost);
+		scache_set(&new->hostname, NULL);
+		scache_set(&new->virthost, NULL);
 		safe_free(new->realname);
-		safe_free(new->username);
+		scache_set(&new->username, NULL);
 		new->servername = NULL;
 
 		if (new->online)
@@ -57,12 +57,12 @@ void add_history(Client *client, int online)
 	new->logoff = TStime();
 	new->umodes = client->umodes;
 	safe_strdup(new->name, client->name);
-	safe_strdup(new->username, client->user->username);
-	safe_strdup(new->hostname, client->user->realhost);
+	scache_set(&new->username, client->user->username);
+	scache_set(&new->hostname, client->user->realhost);
 	if (client->user->virthost)
-		safe_strdup(new->virthost, client->user->virthost);
+		scache_set(&new->virthost, client->user->virthost);
 	else
-		safe_strdup(new->virthost, "");
+		scache_set(&new->virthost, "");
 	new->servername = client->user->server;
 	safe_strdup(new->realname, client->info);
 
@@ -0,0 +1,328 @@
+/* Compressed server links
+ * (C) Copyright 2020-present the UnrealIRCd team
+ * License: GPLv2
+ */
+
+/** @file
+ * @brief Compressed server links (PROTOCTL ZIP).
+ *
+ * Server to server traffic is very repetitive (think of UID, SJOIN
+ * and MD lines during a netburst) and compresses very well.
+ *
+ * How a link becomes compressed:
+ * 1. Servers that can decompress include ZIP in their PROTOCTL.
+ * 2. If the link block has link::options::compression and the
+ *    other side sent PROTOCTL ZIP, we send PROTOCTL ZIP=START just
+ *    before the burst (in server_sync). Everything after that line
+ *    is one long zlib stream.
+ * 3. When we receive PROTOCTL ZIP=START we decompress everything
+ *    that follows that line. This is only accepted from servers.
+ * Each direction is compressed independently.
+ *
+ * Outgoing data is compressed as it is queued in sendbufto_one()
+ * without flushing, so a burst compresses as one large block.
+ * The zlib stream is flushed in send_queued(), that is: when the
+ * event loop is idle and the socket is writable.
+ *
+ * Incoming data is queued in ZipLink::inq and decompressed only until
+ * the recvQ exceeds its limit. The rest is decompressed after the recvQ
+ * has been parsed, see zip_uncompress_more(). This way a small amount of
+ * compressed data can never fill the recvQ without limit.
+ */
+
+#include "unrealircd.h"
+
+#ifdef HAVE_ZLIB
+#include <zlib.h>
+
+/** Size of the buffer used for (de)compressed output */
+#define ZIP_BUFFER_SIZE		16384
+
+/** Compression level used for server links */
+#define ZIP_LEVEL		6
+
+struct ZipLink {
+	z_stream in; /**< Incoming (decompression) stream */
+	z_stream out; /**< Outgoing (compression) stream */
+	char in_active; /**< We are decompressing incoming data */
+	char out_active; /**< We are compressing outgoing data */
+	char out_pending; /**< Data was compressed but not flushed yet */
+	char in_more; /**< inflate() may have more output without more input */
+	dbuf inq; /**< Compressed data received but not decompressed yet */
+	long long in_bytes; /**< Compressed bytes received */
+	long long in_bytes_raw; /**< Bytes received, after decompression */
+	long long out_bytes_raw; /**< Bytes sent, before compression */
+	long long out_bytes; /**< Compressed bytes sent */
+	long flushes; /**< Number of times the outgoing stream was flushed */
+};
+
+static char zipbuf[ZIP_BUFFER_SIZE];
+
+/** Allocate the ZipLink struct for a client, if needed */
+static ZipLink *zip_get(Client *client)
+{
+	if (!client->local->zip)
+	{
+		client->local->zip = safe_alloc(sizeof(ZipLink));
+		dbuf_queue_init(&client->local->zip->inq);
+	}
+	return client->local->zip;
+}
+
+/** The maximum size of the recvQ that we decompress to */
+static int zip_recvq_limit(Client *client)
+{
+	if (IsServer(client))
+		return get_recvq(client);
+	return UNKNOWN_FLOOD_AMOUNT*1024;
+}
+
+/** Decompress queued incoming data and add it to the recvQ, until all
+ * data is decompressed or the recvQ exceeds zip_recvq_limit().
+ * @returns 1 on success, 0 on error (the client is marked as dead).
+ */
+static int zip_inflate(Client *client)
+{
+	ZipLink *zip = client->local->zip;
+	int limit = zip_recvq_limit(client);
+	dbufbuf *block = NULL;
+	int r, n;
+
+	while ((DBufLength(&zip->inq) || zip->in_more) && (DBufLength(&client->local->recvQ) <= limit))
+	{
+		if (DBufLength(&zip->inq))
+		{
+			block = list_entry(zip->inq.dbuf_list.next, dbufbuf, dbuf_node);
+			zip->in.next_in = (Bytef *)block->data;
+			zip->in.avail_in = block->size;
+		} else {
+			block = NULL;
+			zip->in.next_in = NULL;
+			zip->in.avail_in = 0;
+		}
+		zip->in.next_out = (Bytef *)zipbuf;
+		zip->in.avail_out = sizeof(zipbuf);
+		r = inflate(&zip->in, Z_NO_FLUSH);
+		if ((r != Z_OK) && (r != Z_BUF_ERROR))
+		{
+			dead_socket(client, (r == Z_STREAM_END) ? "Link compression stream ended" : "Link decompression error");
+			return 0;
+		}
+		if (block)
+			dbuf_delete(&zip->inq, block->size - zip->in.avail_in);
+		n = sizeof(zipbuf) - zip->in.avail_out;
+		if (n > 0)
+		{
+			dbuf_put(&client->local->recvQ, zipbuf, n);
+			zip->in_bytes_raw += n;
+		}
+		zip->in_more = (zip->in.avail_out == 0) ? 1 : 0;
+	}
+
+	return 1;
+}
+
+/** Start compressing all outgoing data to this server.
+ * This sends PROTOCTL ZIP=START, which is the last uncompressed line.
+ * @param client	The server (directly connected)
+ * @returns 1 on success, 0 if compression could not be started.
+ */
+int zip_start_out(Client *client)
+{
+	ZipLink *zip = zip_get(client);
+
+	if (zip->out_active)
+		return 1;
+
+	if (deflateInit(&zip->out, ZIP_LEVEL) != Z_OK)
+	{
+		sendto_realops("Unable to initialize compression for link %s, continuing uncompressed",
+			client->name);
+		return 0;
+	}
+
+	sendto_one(client, NULL, "PROTOCTL ZIP=START");
+	zip->out_active = 1;
+	return 1;
+}
+
+/** Start decompressing all incoming data from this server.
+ * This is called when PROTOCTL ZIP=START is received. Any data that
+ * is still in the recvQ was sent after that line, so that is
+ * compressed data as well and is moved to the decompression queue.
+ * @param client	The server (directly connected)
+ * @returns 1 on success, 0 if the client was killed.
+ */
+int zip_start_in(Client *client)
+{
+	ZipLink *zip = zip_get(client);
+
+	if (zip->in_active)
+		return 1;
+
+	if (inflateInit(&zip->in) != Z_OK)
+	{
+		dead_socket(client, "Unable to initialize link decompression");
+		return 0;
+	}
+	zip->in_active = 1;
+
+	zip->in_bytes += DBufLength(&client->local->recvQ);
+	list_splice_tail_init(&client->local->recvQ.dbuf_list, &zip->inq.dbuf_list);
+	zip->inq.length += client->local->recvQ.length;
+	client->local->recvQ.length = 0;
+
+	return zip_inflate(client);
+}
+
+/** Returns 1 if incoming data from this client is compressed */
+int zip_in_active(Client *client)
+{
+	return (client->local->zip && client->local->zip->in_active) ? 1 : 0;
+}
+
+/** Returns 1 if outgoing data to this client is compressed */
+int zip_out_active(Client *client)
+{
+	return (client->local->zip && client->local->zip->out_active) ? 1 : 0;
+}
+
+/** Decompress incoming data and add it to the recvQ.
+ * This stops when the recvQ exceeds its limit, the caller must parse
+ * the recvQ and then call zip_uncompress_more().
+ * @param client	The server
+ * @param buf		The compressed data
+ * @param len		Length of the data
+ * @returns 1 on success, 0 on error (the client is marked as dead).
+ */
+int zip_uncompress(Client *client, char *buf, int len)
+{
+	ZipLink *zip = client->local->zip;
+
+	zip->in_bytes += len;
+	dbuf_put(&zip->inq, buf, len);
+	return zip_inflate(client);
+}
+
+/** Continue decompressing after the recvQ has been parsed.
+ * @param client	The server
+ * @returns 1 if more data was added to the recvQ (parse it and call this
+ *          function again), 0 if there is nothing left to decompress,
+ *          -1 on error or if the recvQ was not parsed (the client is
+ *          marked as dead).
+ */
+int zip_uncompress_more(Client *client)
+{
+	ZipLink *zip = client->local->zip;
+
+	if (!zip || !zip->in_active || (!DBufLength(&zip->inq) && !zip->in_more))
+		return 0;
+
+	if (DBufLength(&client->local->recvQ) > zip_recvq_limit(client))
+	{
+		dead_socket(client, "Flood of compressed data");
+		return -1;
+	}
+
+	return zip_inflate(client) ? 1 : -1;
+}
+
+/** Run the outgoing stream through deflate() and add the output to the sendQ.
+ * @returns 1 on success, 0 on error (the client is marked as dead).
+ */
+static int zip_deflate(Client *client, int flush)
+{
+	ZipLink *zip = client->local->zip;
+	int r, n;
+
+	do {
+		zip->out.next_out = (Bytef *)zipbuf;
+		zip->out.avail_out = sizeof(zipbuf);
+		r = deflate(&zip->out, flush);
+		if ((r != Z_OK) && (r != Z_BUF_ERROR))
+		{
+			dead_socket(client, "Link compression error");
+			return 0;
+		}
+		n = sizeof(zipbuf) - zip->out.avail_out;
+		if (n > 0)
+		{
+			dbuf_put(&client->local->sendQ, zipbuf, n);
+			zip->out_bytes += n;
+		}
+	} while ((zip->out.avail_in > 0) || (zip->out.avail_out == 0));
+
+	return 1;
+}
+
+/** Compress outgoing data and add it to the sendQ.
+ * The data is not flushed, that happens in zip_flush().
+ * @param client	The server
+ * @param buf		The data to compress
+ * @param len		Length of the data
+ */
+void zip_compress(Client *client, char *buf, int len)
+{
+	ZipLink *zip = client->local->zip;
+
+	zip->out.next_in = (Bytef *)buf;
+	zip->out.avail_in = len;
+	zip->out_bytes_raw += len;
+	zip->out_pending = 1;
+	zip_deflate(client, Z_NO_FLUSH);
+}
+
+/** Flush any pending compressed data to the sendQ.
+ * This is called from send_queued(), so right before we write.
+ */
+void zip_flush(Client *client)
+{
+	ZipLink *zip = client->local->zip;
+
+	if (!zip || !zip->out_active || !zip->out_pending)
+		return;
+
+	zip->out.next_in = NULL;
+	zip->out.avail_in = 0;
+	zip->out_pending = 0;
+	zip->flushes++;
+	zip_deflate(client, Z_SYNC_FLUSH);
+}
+
+/** Free the compression state of a client */
+void zip_free(Client *client)
+{
+	ZipLink *zip = client->local->zip;
+
+	if (!zip)
+		return;
+
+	if (zip->in_active)
+		inflateEnd(&zip->in);
+	if (zip->out_active)
+		deflateEnd(&zip->out);
+	DBufClear(&zip->inq);
+	safe_free(client->local->zip);
+}
+
+/** Compression statistics for a link, for /STATS L.
+ * @returns A string with the statistics, or NULL if the link is not compressed.
+ */
+char *zip_stats(Client *client)
+{
+	static char buf[256];
+	ZipLink *zip = client->local->zip;
+
+	if (!zip)
+		return NULL;
+
+	snprintf(buf, sizeof(buf),
+	         "in: %lld => %lld bytes (%.1f%%), out: %lld => %lld bytes (%.1f%%), flushes: %ld",
+	         zip->in_bytes, zip->in_bytes_raw,
+	         zip->in_bytes_raw ? (100.0 * zip->in_bytes / zip->in_bytes_raw) : 100.0,
+	         zip->out_bytes_raw, zip->out_bytes,
+	         zip->out_bytes_raw ? (100.0 * zip->out_bytes / zip->out_bytes_raw) : 100.0,
+	         zip->flushes);
+	return buf;
+}
+#endif